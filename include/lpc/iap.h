@@ -0,0 +1,57 @@
+#ifndef __IAP_H__
+#define __IAP_H__
+
+#include "lpc/lpc2378.h"
+
+/* The IAP routines live in the boot block, in Thumb code. */
+#define IAP_LOCATION 0x7FFFFFF1
+
+/* IAP commands. */
+#define IAP_PREPARE_SECTORS  50
+#define IAP_COPY_RAM_TO_FLASH 51
+#define IAP_ERASE_SECTORS    52
+#define IAP_BLANK_CHECK      53
+
+/* IAP status codes. */
+#define IAP_CMD_SUCCESS      0
+#define IAP_BUSY             11
+
+/* Flash can only be programmed in these sizes, from word-aligned RAM to a
+ * 256-byte aligned flash address.
+ */
+#define IAP_MIN_COPY_SIZE    256
+
+/*
+ * The IAP routines stop flash reads while they run, so interrupts (whose
+ * handlers are in flash) must be disabled by the caller around each of these.
+ * They return an IAP status code.
+ */
+
+/**
+ * Prepare sectors for an erase or a write. This must precede each erase and
+ * each copy.
+ */
+uint32_t IAPPrepareSectors(uint32_t start, uint32_t end);
+
+/**
+ * Program flash from RAM.
+ * @param dst a 256-byte aligned flash address
+ * @param src a word-aligned RAM address
+ * @param size 256, 512, 1024 or 4096
+ * @param cclkKHz the CPU clock in kHz
+ */
+uint32_t IAPCopyRamToFlash(uint32_t dst, const void * src, uint32_t size,
+                           uint32_t cclkKHz);
+
+/**
+ * Erase sectors start through end.
+ * @param cclkKHz the CPU clock in kHz
+ */
+uint32_t IAPEraseSectors(uint32_t start, uint32_t end, uint32_t cclkKHz);
+
+/**
+ * Map a flash address to its sector number.
+ */
+uint32_t IAPSectorOf(uint32_t address);
+
+#endif
@@ -32,4 +32,11 @@ TKThreadEntryType monitor;
  */
 TKThreadEntryType idle;
 
+#ifdef TK_BENCHMARK
+/**
+ * Benchmark thread
+ */
+TKThreadEntryType benchmark;
+#endif
+
 #endif
@@ -68,8 +68,14 @@ typedef volatile struct __attribute__ ((__packed__,aligned(4))) _LPC23XX_UART {
 
 #define PCONP (0xE01FC0C4)
 #define PCUART0 (1UL<<3)
+#define PCUART1 (1UL<<4)
+#define PCUART2 (1UL<<24)
+#define PCUART3 (1UL<<25)
 
 #define P_UART0_REGS ((LPC23XX_UART *)0xE000C000)
+#define P_UART1_REGS ((LPC23XX_UART *)0xE0010000)
+#define P_UART2_REGS ((LPC23XX_UART *)0xE0078000)
+#define P_UART3_REGS ((LPC23XX_UART *)0xE007C000)
 
 #define U0_TX_PINSEL_REG   PINSEL0
 #define U0_TX_PINSEL       (1UL<<4)              
@@ -78,6 +84,30 @@ typedef volatile struct __attribute__ ((__packed__,aligned(4))) _LPC23XX_UART {
 #define U0_RX_PINSEL       (1UL<<6)              
 #define U0_RX_PINMASK      (3UL<<6)              
 
+/* TXD1 on P0.15, RXD1 on P0.16 */
+#define U1_TX_PINSEL_REG   PINSEL0
+#define U1_TX_PINSEL       (1UL<<30)
+#define U1_TX_PINMASK      (3UL<<30)
+#define U1_RX_PINSEL_REG   PINSEL1
+#define U1_RX_PINSEL       (1UL<<0)
+#define U1_RX_PINMASK      (3UL<<0)
+
+/* TXD2 on P0.10, RXD2 on P0.11 */
+#define U2_TX_PINSEL_REG   PINSEL0
+#define U2_TX_PINSEL       (1UL<<20)
+#define U2_TX_PINMASK      (3UL<<20)
+#define U2_RX_PINSEL_REG   PINSEL0
+#define U2_RX_PINSEL       (1UL<<22)
+#define U2_RX_PINMASK      (3UL<<22)
+
+/* TXD3 on P0.0, RXD3 on P0.1 */
+#define U3_TX_PINSEL_REG   PINSEL0
+#define U3_TX_PINSEL       (2UL<<0)
+#define U3_TX_PINMASK      (3UL<<0)
+#define U3_RX_PINSEL_REG   PINSEL0
+#define U3_RX_PINSEL       (2UL<<2)
+#define U3_RX_PINMASK      (3UL<<2)
+
 #define ULCR_STOPBIT_SHIFT (2UL)
 #define ULCR_PARITY_ODD    (0UL)
 #define ULCR_PARITY_EVEN   (1UL)
@@ -0,0 +1,12 @@
+#ifndef __TK_BENCHMARKS_H__
+#define __TK_BENCHMARKS_H__
+
+/**
+ * Time reads, writes and ioctls through the DDF on the null, zero and loopback
+ * drivers, across buffer sizes, and print calls per second and bytes per
+ * second for each. The drivers do next to no work, so the numbers are DDF
+ * overhead: validation, locking and dispatch. Call this from a thread.
+ */
+void TKRunBenchmarks(void);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef __TK_BLOCK_H__
+#define __TK_BLOCK_H__
+
+#include "lpc/lpc2378.h"
+
+#include "tk/ddf.h"
+#include "tk/status.h"
+
+/* The block size the cache works in. Block devices used through this layer
+ * must use it.
+ */
+#define TK_BLOCK_SIZE (512)
+
+/* The number of blocks in the cache, which all block devices share. */
+#define TK_BLOCK_CACHE_SLOTS (2)
+
+/**
+ * Initialize the block cache, dropping anything in it.
+ */
+void TKInitBlockCache(void);
+
+/**
+ * Read blocks from a block device through the block cache. Cached blocks are
+ * copied from the cache. A single uncached block is read into the cache; a
+ * run of several uncached blocks is read straight into the caller's buffer
+ * with one driver request, so streaming reads don't flush the cache.
+ *
+ * @param handle a driver handle
+ * @param block the first block to read
+ * @param count the number of blocks to read
+ * @param buffer a buffer of at least count * TK_BLOCK_SIZE bytes
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_BLOCK_BAD_SIZE if the device's blocks are not TK_BLOCK_SIZE bytes
+ * TK_BLOCK_OUT_OF_RANGE if the blocks are not all on the device
+ * an error code otherwise
+ */
+TKStatus TKBlockRead(TKDriverHandle handle,
+                     uint32_t block,
+                     uint32_t count,
+                     uint8_t * buffer);
+
+/**
+ * Write blocks to a block device through the block cache. Blocks that are
+ * cached, and single uncached blocks, are written back later; a run of
+ * several uncached blocks goes to the device at once in one driver request.
+ * When a dirty block is evicted, it is written back together with any dirty
+ * neighbours that hold the following or preceding blocks of the same device.
+ *
+ * @param handle a driver handle
+ * @param block the first block to write
+ * @param count the number of blocks to write
+ * @param buffer a buffer of count * TK_BLOCK_SIZE bytes
+ * @return TKStatus
+ * See TKBlockRead.
+ */
+TKStatus TKBlockWrite(TKDriverHandle handle,
+                      uint32_t block,
+                      uint32_t count,
+                      const uint8_t * buffer);
+
+/**
+ * Write back every dirty cached block of a device, then flush the device.
+ * Call this before closing a block device, or its cached writes are lost.
+ *
+ * @param handle a driver handle
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * an error code otherwise
+ */
+TKStatus TKBlockFlush(TKDriverHandle handle);
+
+#endif
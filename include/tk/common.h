@@ -6,4 +6,10 @@
 
 #define ARRAYLEN(x) (sizeof(x) / sizeof(x[0]))
 
+/* Keep the compiler from moving memory accesses across this point. The core
+ * doesn't reorder them, so this is enough to order accesses against
+ * interrupt handlers.
+ */
+#define TK_COMPILER_BARRIER() __asm__ __volatile__ ("" : : : "memory")
+
 #endif
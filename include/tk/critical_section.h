@@ -52,6 +52,23 @@ TKStatus _TKEnterCriticalSection(struct TKCriticalSection * cs,
                             struct TKThread * thread);
 TKStatus TKEnterCriticalSection(struct TKCriticalSection * cs);
 
+/**
+* Take the critical section for this thread, blocking for at most the given
+* number of ticks.
+*
+* @param cs Critical section container
+* @param thread A thread pointer
+* @param timeout Timeout in ticks, or TK_WAIT_FOREVER
+* @return 0 Critical section was taken
+* @return TIMEOUT Critical section was not released in time
+* @return non-zero An error code
+*/
+TKStatus _TKEnterCriticalSectionTimeout(struct TKCriticalSection * cs,
+                                        struct TKThread * thread,
+                                        uint32_t timeout);
+TKStatus TKEnterCriticalSectionTimeout(struct TKCriticalSection * cs,
+                                       uint32_t timeout);
+
 /**
 * Release the critical section for this thread.
 *
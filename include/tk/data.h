@@ -7,6 +7,7 @@
 struct TKThreadQueue FreeQueue;
 struct TKThreadQueue RunQueue;
 struct TKThreadQueue SleepQueue;
+struct TKTimeoutList TimeoutList;
 
 struct TKThread * CurrentThread;
 uint32_t TickHz;
@@ -18,4 +19,11 @@ volatile TKTickCount TickCount;
  */
 void TKInitKernelData(void);
 
+/**
+ * Get a thread from the thread table, whether or not it is in use.
+ * @param index the index, below TK_MAX_THREADS
+ * @return the thread
+ */
+struct TKThread * TKGetThread(uint32_t index);
+
 #endif
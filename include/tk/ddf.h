@@ -7,12 +7,29 @@
 
 #include "tk/semaphore.h"
 #include "tk/status.h"
+#include "tk/timing.h"
 
 #define TK_MAX_DRIVER_NAME_LENGTH (11)
 
+/* Limits of the driver registry. Every minor of every driver is a device with
+ * its own entry. Major and minor numbers index the lookup table directly, so
+ * keep them small.
+ */
+#define TK_MAX_DEVICES (16)
+#define TK_MAX_MAJOR (8)
+#define TK_MAX_MINOR (4)
+
+/* Readiness events for TKDriverPoll. */
+#define TK_POLL_READ (1 << 0)
+#define TK_POLL_WRITE (1 << 1)
+
 typedef enum TKPowerState {
     TK_POWER_ON,
-    TK_POWER_OFF
+    TK_POWER_OFF,
+    /* Powered down by autosuspend. Unlike TK_POWER_OFF, the next operation
+     * powers the device back up instead of failing.
+     */
+    TK_POWER_SUSPENDED
 } TKPowerState;
 
 /* An enum specifying what type of buffers an ioctl expects. */
@@ -23,46 +40,262 @@ enum TKIoctlType {
     TK_IOCTL_IN_OUT,
 };
 
+/* Which way data flows through a buffer loaned out by a driver. */
+enum TKBufferDirection {
+    TK_BUFFER_READ,
+    TK_BUFFER_WRITE
+};
+
+/* How the DDF serializes the operations of a driver. */
+enum TKDriverConcurrency {
+    /* Every operation is serialized behind a single lock. */
+    TK_CONCURRENCY_SERIALIZED,
+    /* Reads and writes have independent locks, so a read and a write may run
+     * at the same time. Control operations (ioctls, power, close) take both.
+     */
+    TK_CONCURRENCY_PER_DIRECTION,
+    /* The driver is internally thread-safe and the DDF takes no lock. */
+    TK_CONCURRENCY_NONE
+};
+
 struct TKIoctlInfo {
     enum TKIoctlType type;
     uint32_t inSize;
     uint32_t outSize;
-    TKStatus (*op)(const void * inBuf, void * outBuf);
+    TKStatus (*op)(void * context, const void * inBuf, void * outBuf);
+};
+
+/* One segment of a vectored (scatter/gather) read or write. For writes, the
+ * buffer is only read from.
+ */
+struct TKIoVec {
+    uint8_t * buffer;
+    uint32_t size;
+};
+
+/* One ioctl of a TKDriverIoctlBatch. status receives the result. */
+struct TKIoctlRequest {
+    uint32_t code;
+    const void * inBuf;
+    uint32_t inSize;
+    void * outBuf;
+    uint32_t outSize;
+    TKStatus status;
 };
 
+/* Every op except ioctlInfo gets the context of the device (minor) it is
+ * called on; see struct TKDriver.
+ */
 struct TKDriverOps {
-    void (*init)(void);
-    void (*open)(void);
-    void (*close)(void);
-    int (*read)(TKStatus * status, uint8_t * buffer, uint32_t size);
-    int (*write)(TKStatus * status, const uint8_t * buffer, uint32_t size);
-    struct TKIoctlInfo * (*ioctlInfo)(uint32_t code);
-    TKStatus (*powerUp)(void);
-    TKStatus (*powerDown)(void);
+    /* Optional; called once per minor from TKInitDrivers. */
+    void (*init)(void * context);
+    void (*open)(void * context);
+    void (*close)(void * context);
+    /* Byte-stream I/O. Optional, for devices that only do block I/O. */
+    int (*read)(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size);
+    int (*write)(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size);
+    /* Optional; if NULL, the DDF falls back to one read/write per segment. */
+    int (*readv)(void * context,
+                 TKStatus * status,
+                 const struct TKIoVec * vec,
+                 uint32_t count);
+    int (*writev)(void * context,
+                  TKStatus * status,
+                  const struct TKIoVec * vec,
+                  uint32_t count);
+    /* Optional; writes the bytes exactly as given, for drivers whose write
+     * changes data on the way out, such as the serial driver's newline
+     * translation. If NULL, raw writes go through writev or write.
+     */
+    int (*writeRawv)(void * context,
+                     TKStatus * status,
+                     const struct TKIoVec * vec,
+                     uint32_t count);
+    /* Optional zero-copy buffer loans. acquireBuffer lends out a region of the
+     * driver's own storage and sets size to its length: for reads, the region
+     * holds data ready to be consumed; for writes, it is free space to fill.
+     * commitBuffer then consumes or publishes the first size bytes of the
+     * region. The DDF guarantees commit size never exceeds the loaned size.
+     */
+    uint8_t * (*acquireBuffer)(void * context,
+                               TKStatus * status,
+                               enum TKBufferDirection direction,
+                               uint32_t * size);
+    TKStatus (*commitBuffer)(void * context,
+                             enum TKBufferDirection direction,
+                             uint32_t size);
+    /* Optional; returns which of the requested TK_POLL_* events would not
+     * block right now. It is called without the driver lock, so it should
+     * only look at state, not change it. If NULL, the device is always ready.
+     * A driver should call TKDriverNotifyPoll when a device becomes ready;
+     * otherwise pollers only notice at the next tick.
+     */
+    uint32_t (*poll)(void * context, uint32_t events);
+    /* Optional block I/O, for storage devices. A block device has blockCount
+     * blocks of blockSize bytes and transfers count consecutive blocks
+     * starting at block; the DDF checks the range. flush writes back any
+     * cache the device has of its own, and may be NULL if it has none.
+     */
+    TKStatus (*geometry)(void * context,
+                         uint32_t * blockSize,
+                         uint32_t * blockCount);
+    TKStatus (*readBlocks)(void * context,
+                           uint32_t block,
+                           uint32_t count,
+                           uint8_t * buffer);
+    TKStatus (*writeBlocks)(void * context,
+                            uint32_t block,
+                            uint32_t count,
+                            const uint8_t * buffer);
+    TKStatus (*flush)(void * context);
+    const struct TKIoctlInfo * (*ioctlInfo)(uint32_t code);
+    TKStatus (*powerUp)(void * context);
+    TKStatus (*powerDown)(void * context);
 };
 
+/* A driver descriptor. Descriptors are constant and live in flash; anything
+ * that changes at runtime belongs in struct TKDriverEntry.
+ */
 struct TKDriver {
     char name[TK_MAX_DRIVER_NAME_LENGTH + 1];
     uint32_t major;
+    /* The driver serves minors minor through minor + minorCount - 1. */
     uint32_t minor;
-    TKPowerState powerstate;
-    struct TKDriverOps ops;
+    uint32_t minorCount;
+    enum TKDriverConcurrency concurrency;
+    const struct TKDriverOps * ops;
+    /* An array of minorCount per-device contexts, each contextSize bytes,
+     * handed to the ops of the matching minor. NULL if the driver needs none.
+     */
+    void * contexts;
+    uint32_t contextSize;
+    /* Ticks an open device may sit idle before the DDF suspends it, or 0 to
+     * never suspend it. Needs powerUp and powerDown ops and DDF locking.
+     */
+    uint32_t autosuspendDelay;
+};
+
+/**
+ * Define a driver descriptor and register it with the DDF, e.g.
+ *
+ *   TK_DRIVER_DEFINE(FooDriver) = {
+ *       .name = "foo",
+ *       ...
+ *   };
+ *
+ * The descriptor is placed in the .tk_drivers section, which the linker script
+ * gathers into flash between __tk_drivers_start and __tk_drivers_end, and
+ * TKInitDrivers picks up everything in it. Being const, descriptors don't
+ * depend on initialized globals being copied into RAM at startup.
+ */
+#define TK_DRIVER_DEFINE(name) \
+    static const struct TKDriver name \
+    __attribute__ ((section(".tk_drivers"), used, aligned(4)))
+
+/* DDF ioctl codes. The DDF serves these itself, for every driver, so driver
+ * ioctl codes must stay below TK_DDF_IOCTL_BASE.
+ */
+#define TK_DDF_IOCTL_BASE (0x80000000)
+/* Out: struct TKDriverStats */
+#define TK_DDF_IOCTL_STATS (TK_DDF_IOCTL_BASE + 0)
+#define TK_DDF_IOCTL_STATS_RESET (TK_DDF_IOCTL_BASE + 1)
+
+/* The number of distinct error statuses a device's stats count separately. */
+#define TK_DRIVER_STATS_ERROR_KINDS (4)
+
+/* Time spent in some part of an operation, in cycles (see TKGetCyclesHz). */
+struct TKDriverTiming {
+    uint64_t total;
+    /* The longest single span, saturating at 0xFFFFFFFF. */
+    uint32_t max;
+};
+
+/* Counters of the operations on a device since it was initialized, or its
+ * stats were last reset. Every operation attempted is counted, including
+ * those that fail.
+ */
+struct TKDriverStats {
+    /* Reads and writes include vectored ones; power counts power ups and
+     * power downs.
+     */
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t ioctls;
+    uint32_t powerOps;
+    uint32_t bytesRead;
+    uint32_t bytesWritten;
+    /* All failed operations. The first few distinct statuses seen are also
+     * counted separately; unused kinds have a count of 0.
+     */
+    uint32_t errors;
+    uint16_t errorCount[TK_DRIVER_STATS_ERROR_KINDS];
+    uint8_t errorStatus[TK_DRIVER_STATS_ERROR_KINDS];
+    /* Waiting for the driver lock, and running in the driver with it held. */
+    struct TKDriverTiming lockWait;
+    struct TKDriverTiming service;
+    /* Autosuspend. resume is the time taken to power back up, which the
+     * operation that found the device suspended had to wait for.
+     */
+    uint32_t suspends;
+    uint32_t resumes;
+    uint32_t suspendedTicks;
+    struct TKDriverTiming resume;
 };
 
 struct TKDriverEntry {
-    struct TKDriver * driver;
+    const struct TKDriver * driver;
+    void * context;
+    TKPowerState powerstate;
+    /* sem serializes everything for TK_CONCURRENCY_SERIALIZED drivers. For
+     * TK_CONCURRENCY_PER_DIRECTION drivers, it guards reads and writeSem
+     * guards writes.
+     */
     struct TKSemaphore sem;
+    struct TKSemaphore writeSem;
     bool used;
+    uint8_t minor;
+
+    /* Outstanding buffer loans, indexed by enum TKBufferDirection. The lock for
+     * that direction is held for as long as the loan is outstanding.
+     */
+    bool loaned[2];
+    struct TKThread * loanOwner[2];
+    uint32_t loanSize[2];
+
+    /* For autosuspend: the delay, from the descriptor unless a test changed
+     * it, when the driver lock was last released, and when the device was
+     * suspended.
+     */
+    uint32_t autosuspendDelay;
+    TKTickCount lastUse;
+    TKTickCount suspendedAt;
+
+    struct TKDriverStats stats;
 };
 
 typedef struct TKDriverEntry * TKDriverHandle;
 
 /**
- * Initialize the TK driver subsystem.
- * @param table a driver table
+ * Initialize the TK driver subsystem from the descriptors registered with
+ * TK_DRIVER_DEFINE. Drivers that share a major and minor number are a fatal
+ * error.
  */
 void TKInitDrivers(void);
 
+/**
+ * Get the name of the driver of a device.
+ * @param major the major number of the device
+ * @param minor the minor number of the device
+ * @return the name, or NULL if there is no such device
+ */
+const char * TKDriverName(uint32_t major, uint32_t minor);
+
 /**
  * Open a handle to a given driver.
  * @param major the major number of the driver
@@ -112,10 +345,185 @@ int TKDriverWrite(TKDriverHandle handle,
                   const uint8_t * buffer,
                   uint32_t size);
 
+/**
+ * Read from a device, giving up after a number of ticks. The timeout covers
+ * both waiting for the driver lock and the read itself; drivers that block
+ * check it with TKTimeoutRemaining.
+ * @param handle a driver handle
+ * @param status a pointer to a TKStatus, which will receive the read status
+ * @param buffer a buffer to receive the data
+ * @param size the size of the buffer, in bytes
+ * @param timeout the timeout in ticks, or TK_WAIT_FOREVER
+ * @return int
+ * the number of bytes read, if successful or if the read timed out partway,
+ * in which case status is TK_TIMEOUT
+ * -1 otherwise
+ */
+int TKDriverReadTimeout(TKDriverHandle handle,
+                        TKStatus * status,
+                        uint8_t * buffer,
+                        uint32_t size,
+                        uint32_t timeout);
+
+/**
+ * Write to a device, giving up after a number of ticks. See
+ * TKDriverReadTimeout.
+ * @param handle a driver handle
+ * @param status a pointer to a TKStatus, which will receive the write status
+ * @param buffer a buffer containing data to be written
+ * @param size the size of the buffer, in bytes
+ * @param timeout the timeout in ticks, or TK_WAIT_FOREVER
+ * @return int
+ * the number of bytes written, if successful or if the write timed out
+ * partway, in which case status is TK_TIMEOUT
+ * -1 otherwise
+ */
+int TKDriverWriteTimeout(TKDriverHandle handle,
+                         TKStatus * status,
+                         const uint8_t * buffer,
+                         uint32_t size,
+                         uint32_t timeout);
+
+/**
+ * Read from a device into several buffers, taking the driver lock only once.
+ * Segments are filled in order; a short read from the driver ends the transfer.
+ * @param handle a driver handle
+ * @param status a pointer to a TKStatus, which will receive the read status
+ * @param vec an array of buffer segments to read into
+ * @param count the number of segments in vec
+ * @return int
+ * the total number of bytes read, if successful
+ * -1 otherwise
+ */
+int TKDriverReadv(TKDriverHandle handle,
+                  TKStatus * status,
+                  const struct TKIoVec * vec,
+                  uint32_t count);
+
+/**
+ * Write several buffers to a device, taking the driver lock only once.
+ * Segments are written in order; a short write from the driver ends the
+ * transfer.
+ * @param handle a driver handle
+ * @param status a pointer to a TKStatus, which will receive the write status
+ * @param vec an array of buffer segments to write
+ * @param count the number of segments in vec
+ * @return int
+ * the total number of bytes written, if successful
+ * -1 otherwise
+ */
+int TKDriverWritev(TKDriverHandle handle,
+                   TKStatus * status,
+                   const struct TKIoVec * vec,
+                   uint32_t count);
+
+/**
+ * Write several buffers to a device byte for byte, for binary data. This is
+ * TKDriverWritev, except that a driver which translates what it writes, like
+ * the serial driver, leaves the data as it is.
+ * @param handle a driver handle
+ * @param status a pointer to a TKStatus, which will receive the write status
+ * @param vec an array of buffer segments to write
+ * @param count the number of segments in vec
+ * @return int
+ * the total number of bytes written, if successful
+ * -1 otherwise
+ */
+int TKDriverWriteRawv(TKDriverHandle handle,
+                      TKStatus * status,
+                      const struct TKIoVec * vec,
+                      uint32_t count);
+
+/**
+ * Get the shape of a block device.
+ * @param handle a driver handle
+ * @param blockSize receives the size of a block, in bytes
+ * @param blockCount receives the number of blocks on the device
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_UNSUPPORTED if the device is not a block device
+ * an error code otherwise
+ */
+TKStatus TKDriverBlockGeometry(TKDriverHandle handle,
+                               uint32_t * blockSize,
+                               uint32_t * blockCount);
+
+/**
+ * Read whole blocks from a block device, bypassing the block cache. Most
+ * callers want TKBlockRead instead.
+ * @param handle a driver handle
+ * @param block the first block to read
+ * @param count the number of blocks to read
+ * @param buffer a buffer of at least count blocks
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_BLOCK_OUT_OF_RANGE if the blocks are not all on the device
+ * an error code otherwise
+ */
+TKStatus TKDriverReadBlocks(TKDriverHandle handle,
+                            uint32_t block,
+                            uint32_t count,
+                            uint8_t * buffer);
+
+/**
+ * Write whole blocks to a block device, bypassing the block cache. See
+ * TKDriverReadBlocks.
+ */
+TKStatus TKDriverWriteBlocks(TKDriverHandle handle,
+                             uint32_t block,
+                             uint32_t count,
+                             const uint8_t * buffer);
+
+/**
+ * Ask a block device to write back any cache of its own.
+ * @param handle a driver handle
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * an error code otherwise
+ */
+TKStatus TKDriverFlush(TKDriverHandle handle);
+
+/**
+ * Borrow a region of the driver's own storage so data can be produced or
+ * consumed in place, without copying through a caller buffer. The driver lock
+ * is held from a successful acquire until the matching TKDriverCommitBuffer,
+ * so the loan must be committed promptly and by the same thread.
+ * @param handle a driver handle
+ * @param direction TK_BUFFER_READ to consume driver data, TK_BUFFER_WRITE to
+ *                  fill driver storage
+ * @param buffer receives a pointer to the loaned region
+ * @param size receives the size of the loaned region, in bytes
+ * @return TKStatus
+ * TK_OK if the buffer was acquired
+ * TK_UNSUPPORTED if direction is not a TKBufferDirection
+ * an error code otherwise
+ */
+TKStatus TKDriverAcquireBuffer(TKDriverHandle handle,
+                               enum TKBufferDirection direction,
+                               uint8_t ** buffer,
+                               uint32_t * size);
+
+/**
+ * Return a loaned buffer to the driver. For reads, the first size bytes are
+ * consumed; for writes, the first size bytes are published to the device.
+ * @param handle a driver handle
+ * @param direction the direction the buffer was acquired for
+ * @param size the number of bytes used; at most the acquired size
+ * @return TKStatus
+ * TK_OK if the buffer was committed
+ * TK_UNSUPPORTED if direction is not a TKBufferDirection
+ * an error code otherwise
+ */
+TKStatus TKDriverCommitBuffer(TKDriverHandle handle,
+                              enum TKBufferDirection direction,
+                              uint32_t size);
+
 /**
  * Issue an ioctl (special control code).
  * @param handle a driver handle
- * @param code the ioctl code; this is driver-specific
+ * @param code the ioctl code; this is driver-specific, or one of the DDF
+ *             ioctls (TK_DDF_IOCTL_*), which work even when the device is
+ *             powered down and don't wait for the driver lock
  * @param inBuf a constant buffer for ioctl input; could be NULL
  * @param inSize the size of inBuf, in bytes
  * @param outBuf a buffer to receive ioctl output; could be NULL
@@ -132,7 +540,66 @@ TKStatus TKDriverIoctl(TKDriverHandle handle,
                        uint32_t outSize);
 
 /**
- * Power up a device.
+ * Send an ioctl to a device, giving up with TK_TIMEOUT if the driver lock
+ * cannot be taken within a number of ticks.
+ * @param timeout the timeout in ticks, or TK_WAIT_FOREVER
+ * See TKDriverIoctl for the other parameters and return values.
+ */
+TKStatus TKDriverIoctlTimeout(TKDriverHandle handle,
+                              uint32_t code,
+                              const void * inBuf,
+                              uint32_t inSize,
+                              void * outBuf,
+                              uint32_t outSize,
+                              uint32_t timeout);
+
+/**
+ * Send a sequence of ioctls to a device under a single lock, so no other
+ * thread can use the device in between. Every request is validated before
+ * any of them runs. They then run in order, stopping at the first one that
+ * fails; the ones after it are not run and get TK_IOCTL_SKIPPED.
+ * @param handle a driver handle
+ * @param requests an array of ioctl requests
+ * @param count the number of requests
+ * @return TKStatus
+ * TK_OK if every request succeeded
+ * the status of the first request that failed validation or failed to run;
+ * if validation failed, no request was run
+ * an error code otherwise
+ */
+TKStatus TKDriverIoctlBatch(TKDriverHandle handle,
+                            struct TKIoctlRequest requests[],
+                            uint32_t count);
+
+/**
+ * Wait until at least one of several devices is ready for I/O. The caller
+ * blocks between checks, until a driver calls TKDriverNotifyPoll or the next
+ * tick, so threads of any priority can run meanwhile.
+ * @param handles an array of driver handles
+ * @param events an array holding, for each handle, the TK_POLL_* events to
+ * wait for. On return, each entry holds the events that are ready.
+ * @param count the number of entries in handles and events
+ * @param timeout the timeout in ticks, 0 to check once, or TK_WAIT_FOREVER
+ * @return TKStatus
+ * TK_OK if at least one event is ready
+ * TK_TIMEOUT if none became ready in time, in which case every entry of
+ * events is 0
+ * an error code otherwise, in which case events is unchanged
+ */
+TKStatus TKDriverPoll(TKDriverHandle handles[],
+                      uint32_t events[],
+                      uint32_t count,
+                      uint32_t timeout);
+
+/**
+ * Wake the threads blocked in TKDriverPoll so they check their devices again.
+ * Drivers call this when a device may have become ready. This can be called
+ * from interrupt handlers.
+ */
+void TKDriverNotifyPoll(void);
+
+/**
+ * Power up a device. This also resumes a suspended device.
  * @param handle a driver handle
  * @return TKStatus
  * TK_OK if the operation succeeded
@@ -141,7 +608,8 @@ TKStatus TKDriverIoctl(TKDriverHandle handle,
 TKStatus TKDriverPowerUp(TKDriverHandle handle);
 
 /**
- * Power down a device.
+ * Power down a device. A suspended device is already powered down, so this
+ * only stops it from being resumed.
  * @param handle a driver handle
  * @return TKStatus
  * TK_OK if the operation succeeded
@@ -159,4 +627,35 @@ TKStatus TKDriverPowerDown(TKDriverHandle handle);
  */
 TKStatus TKDriverPowerState(TKDriverHandle handle, TKPowerState * state);
 
+/**
+ * Suspend every open device that has been idle for its autosuspend delay. A
+ * device whose lock is held is skipped rather than waited for.
+ */
+void TKDriverAutosuspend(void);
+
+/**
+ * A thread that calls TKDriverAutosuspend once a second, forever.
+ * @param p unused
+ */
+void TKAutosuspendThread(void * p);
+
+/**
+ * Check whether any device has an autosuspend delay, and so whether the
+ * autosuspend thread has anything to do.
+ * @return true if some device may be autosuspended
+ */
+bool TKDriverAutosuspendUsed(void);
+
+/**
+ * Change a device's autosuspend delay. This is for tests, which need a device
+ * that autosuspends; other devices get theirs from the driver descriptor.
+ * @param handle the device
+ * @param delay the ticks the device may sit idle, or 0 to never suspend it
+ * @return TK_OK if the delay was set
+ * @return TK_NULL if handle is NULL
+ * @return TK_POWER_STATES_UNSUPPORTED if the driver has no power ops or no
+ * DDF locking
+ */
+TKStatus _TKDriverSetAutosuspendDelay(TKDriverHandle handle, uint32_t delay);
+
 #endif
@@ -0,0 +1,10 @@
+#ifndef __TK_LOOPBACK_DRIVER_H__
+#define __TK_LOOPBACK_DRIVER_H__
+
+#define TK_LOOPBACK_MAJOR (5)
+#define TK_LOOPBACK_MINOR (0)
+
+/* The number of bytes the loopback can hold before writes come up short. */
+#define TK_LOOPBACK_SIZE (64)
+
+#endif
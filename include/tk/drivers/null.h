@@ -0,0 +1,10 @@
+#ifndef __TK_NULL_DRIVER_H__
+#define __TK_NULL_DRIVER_H__
+
+#define TK_NULL_MAJOR (3)
+#define TK_NULL_MINOR (0)
+
+/* Does nothing, for timing the ioctl path. */
+#define TK_NULL_IOCTL_NOP (0)
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __TK_PIPE_DRIVER_H__
+#define __TK_PIPE_DRIVER_H__
+
+#define TK_PIPE_MAJOR (6)
+
+/* Each minor is a separate pipe. Both ends of a pipe share its one handle:
+ * one thread writes to it and another reads from it.
+ */
+#define TK_PIPE_MINOR (0)
+#define TK_PIPE_COUNT (2)
+
+/* The bytes a pipe holds before writers block. A power of two. */
+#define TK_PIPE_SIZE (128)
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __TK_RAMDISK_DRIVER_H__
+#define __TK_RAMDISK_DRIVER_H__
+
+#define TK_RAMDISK_MAJOR (2)
+#define TK_RAMDISK_MINOR (0)
+
+/* The disk size, in TK_BLOCK_SIZE blocks. RAM is scarce, so keep it small. */
+#define TK_RAMDISK_BLOCKS (4)
+
+#define TK_RAMDISK_IOCTL_STATS (0)
+
+/* Counts of the requests the disk has served since it was initialized, as
+ * returned by TK_RAMDISK_IOCTL_STATS.
+ */
+struct TKRamdiskStats {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t blocksRead;
+    uint32_t blocksWritten;
+};
+
+#endif
@@ -2,16 +2,20 @@
 #define __TK_SERIAL_DRIVER_H__
 
 #define TK_SERIAL_MAJOR (1)
+
+/* Minor n is UARTn. UART0 is the console and is set up at boot; the others
+ * are powered and pinned out on open, but need a TK_SERIAL_IOCTL_BAUD before
+ * use. Writes send "\n\r" for every '\n'; TKDriverWriteRawv sends bytes as
+ * they are.
+ */
 #define TK_SERIAL_MINOR (0)
+#define TK_SERIAL_PORT_COUNT (4)
 
+/* In: struct TKSerialBaudInfo */
 #define TK_SERIAL_IOCTL_BAUD (0)
 
-struct TKDriver TKSerialDriver;
-
-void TKSerialDriverInit(void);
-
 /* Note that these enums have carefully selected values in order to correspond
- * with the right bits to set in the UART0 LCR.
+ * with the right bits to set in the UART LCR.
  */
 enum TKSerialDataBits {
     TK_SERIAL_DATA_BITS_5 = 0,
@@ -2,15 +2,20 @@
 #define __TK_TEST_DRIVER_H__
 
 #define TK_TEST_MAJOR (0)
+
+/* Minors of the test driver. They all share one device, but differ in which
+ * optional ops they provide and how the DDF locks them.
+ */
 #define TK_TEST_MINOR (0)
+#define TK_TEST_BASIC_MINOR (1)
+#define TK_TEST_DUPLEX_MINOR (2)
+#define TK_TEST_UNLOCKED_MINOR (3)
 
 #define TK_TEST_IOCTL_NONE (0)
 #define TK_TEST_IOCTL_IN (1)
 #define TK_TEST_IOCTL_OUT (2)
 #define TK_TEST_IOCTL_IN_OUT (3)
-
-struct TKDriver TKTestDriver;
-
-void TKTestDriverInit(void);
+/* Always fails with TK_UNEXPECTED. */
+#define TK_TEST_IOCTL_FAIL (4)
 
 #endif
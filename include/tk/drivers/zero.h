@@ -0,0 +1,7 @@
+#ifndef __TK_ZERO_DRIVER_H__
+#define __TK_ZERO_DRIVER_H__
+
+#define TK_ZERO_MAJOR (4)
+#define TK_ZERO_MINOR (0)
+
+#endif
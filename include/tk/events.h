@@ -0,0 +1,214 @@
+#ifndef __TK_EVENTS_H__
+#define __TK_EVENTS_H__
+
+#include <stdbool.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/thread.h"
+
+/*
+ * Kernel event tracing, built in with -DTK_EVENT_TRACING. The kernel records
+ * context switches, wakeups, semaphore ups and downs, driver operations and
+ * the tick interrupt into a ring, each with a cycle count timestamp. The ring
+ * keeps the most recent TK_EVENT_RING_SIZE events. TKDumpEvents streams them
+ * over serial as text lines starting with "#TKE", which tools/tkevents.py
+ * turns into Chrome trace JSON for Perfetto or chrome://tracing.
+ *
+ * Threads and semaphores are named in events by the low 16 bits of their
+ * address, which are unique within the 32KB of RAM. Devices are named by
+ * major << 8 | minor.
+ *
+ * As a flight recorder, the tracer watches for latency outliers. When a
+ * trigger set with TKSetFlightTrigger fires, or TKFatal is called, the last
+ * TK_FLIGHT_RECORD_SIZE events are copied into a .noinit RAM region, which
+ * startup code doesn't clear, so the record survives a warm reset and can be
+ * dumped with TKDumpFlightRecord at the next boot. The first record is kept
+ * until it is dumped, so later outliers don't overwrite it.
+ */
+
+#ifndef TK_EVENT_RING_SIZE
+#define TK_EVENT_RING_SIZE (128)
+#endif
+
+#ifndef TK_FLIGHT_RECORD_SIZE
+#define TK_FLIGHT_RECORD_SIZE (64)
+#endif
+
+/* Places a variable in RAM that startup code leaves alone. */
+#define TK_NOINIT __attribute__ ((section(".noinit")))
+
+enum TKEventType {
+    /* Object is the thread switched to. */
+    TK_EVENT_SWITCH,
+    /* Object is the thread made runnable. */
+    TK_EVENT_WAKE,
+    /* Object is the semaphore. Detail is 1 if a waiter was woken. */
+    TK_EVENT_SEM_UP,
+    /* Object is the semaphore. Detail is 1 if the caller had to block. */
+    TK_EVENT_SEM_DOWN,
+    /* Object is the device. Detail is a TKEventDriverOp. */
+    TK_EVENT_DRIVER_ENTER,
+    TK_EVENT_DRIVER_EXIT,
+    /* Detail is the VIC channel. */
+    TK_EVENT_ISR_ENTER,
+    TK_EVENT_ISR_EXIT
+};
+
+enum TKEventDriverOp {
+    TK_EVENT_DRIVER_READ,
+    TK_EVENT_DRIVER_WRITE,
+    TK_EVENT_DRIVER_IOCTL,
+    TK_EVENT_DRIVER_POWER
+};
+
+struct TKEvent {
+    uint32_t timestamp;
+    uint8_t type;
+    uint8_t detail;
+    uint16_t object;
+};
+
+/* What froze a flight record. The values of the latency triggers are in
+ * cycles.
+ */
+enum TKFlightTrigger {
+    /* A scheduler pass in the tick interrupt took too long. */
+    TK_FLIGHT_SCHEDULE,
+    /* A thread above TK_PRIORITY_NORMAL waited too long to run after it was
+     * woken.
+     */
+    TK_FLIGHT_WAKE_LATENCY,
+    /* The tick interrupt ran too long after the timer matched, which means
+     * interrupts were disabled for that long.
+     */
+    TK_FLIGHT_IRQ_LATENCY,
+    /* TKFatal was called. */
+    TK_FLIGHT_FATAL,
+    /* TKFreezeEvents was called by the application. */
+    TK_FLIGHT_MANUAL,
+    TK_FLIGHT_TRIGGERS
+};
+
+struct TKFlightRecord {
+    uint32_t magic;
+    uint32_t trigger;
+    uint32_t value;
+    uint32_t count;
+    struct TKEvent events[TK_FLIGHT_RECORD_SIZE];
+    /* Catches records left over from a power-on, which start as garbage. */
+    uint32_t check;
+};
+
+/* The 16-bit name of a thread or semaphore in events. */
+#define TK_EVENT_OBJECT(p) ((uint16_t) (uint32_t) (p))
+
+#ifdef TK_EVENT_TRACING
+
+#define TK_EVENT(type, detail, object) TKRecordEvent(type, detail, object)
+#define TK_EVENT_WAKE(thread) TKRecordWake(thread)
+#define TK_EVENT_SWITCH(thread) TKRecordSwitch(thread)
+#define TK_FLIGHT_CHECK(trigger, value) TKCheckFlightTrigger(trigger, value)
+
+/**
+ * Record an event. Use TK_EVENT rather than calling this directly, so the
+ * call compiles away when tracing is off. This can be called from interrupt
+ * handlers.
+ * @param type a TKEventType
+ * @param detail depends on type
+ * @param object depends on type
+ */
+void TKRecordEvent(uint32_t type, uint32_t detail, uint32_t object);
+
+/**
+ * Record a thread being made runnable, and note when for the wakeup latency
+ * trigger.
+ * @param thread the thread
+ */
+void TKRecordWake(struct TKThread * thread);
+
+/**
+ * Record a context switch, and check the thread's wakeup latency.
+ * @param thread the thread switched to
+ */
+void TKRecordSwitch(struct TKThread * thread);
+
+/**
+ * Set the limit of a latency trigger.
+ * @param trigger TK_FLIGHT_SCHEDULE, TK_FLIGHT_WAKE_LATENCY or
+ * TK_FLIGHT_IRQ_LATENCY
+ * @param us the limit in microseconds, or 0 to disable the trigger
+ */
+void TKSetFlightTrigger(uint32_t trigger, uint32_t us);
+
+/**
+ * Freeze the events if a measurement is over its trigger's limit. Use
+ * TK_FLIGHT_CHECK rather than calling this directly.
+ * @param trigger the trigger
+ * @param value the measurement in cycles
+ */
+void TKCheckFlightTrigger(uint32_t trigger, uint32_t value);
+
+/**
+ * Copy the last events into the flight record, unless it already holds one.
+ * This can be called from interrupt handlers.
+ * @param trigger what caused the freeze
+ * @param value the measurement that caused it, if any
+ */
+void TKFreezeEvents(uint32_t trigger, uint32_t value);
+
+/**
+ * Get the flight record, if there is one.
+ * @return the record, or NULL if it doesn't hold one
+ */
+const struct TKFlightRecord * TKGetFlightRecord(void);
+
+/**
+ * Print the flight record in the same form as TKDumpEvents, with the trigger
+ * first, and then clear it so the next outlier can be caught. This does
+ * nothing if there is no record.
+ */
+void TKDumpFlightRecord(void);
+
+/**
+ * Clear the flight record.
+ */
+void TKClearFlightRecord(void);
+
+/**
+ * Get the events recorded since the last dump, oldest first. This is for
+ * tests; use TKDumpEvents to get them out of the board.
+ * @param events filled in with up to count events
+ * @param count the size of events
+ * @param lost set to the number of events overwritten before they were dumped
+ * @return the number of events copied
+ */
+uint32_t TKTakeEvents(struct TKEvent * events,
+                      uint32_t count,
+                      uint32_t * lost);
+
+/**
+ * Print the events recorded since the last dump, along with the thread and
+ * device names and the cycle rate. Recording is paused while the dump runs,
+ * so it doesn't trace its own serial writes.
+ */
+void TKDumpEvents(void);
+
+/**
+ * Throw away all recorded events.
+ */
+void TKResetEvents(void);
+
+#else
+
+#define TK_EVENT(type, detail, object) do { } while (0)
+#define TK_EVENT_WAKE(thread) do { } while (0)
+#define TK_EVENT_SWITCH(thread) do { } while (0)
+/* The value is still evaluated, since it may be a call made for other
+ * reasons.
+ */
+#define TK_FLIGHT_CHECK(trigger, value) ((void) (value))
+
+#endif
+
+#endif
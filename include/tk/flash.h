@@ -0,0 +1,90 @@
+#ifndef __TK_FLASH_H__
+#define __TK_FLASH_H__
+
+#include "lpc/lpc2378.h"
+
+#include "tk/status.h"
+
+/*
+ * A region of NOR flash, split into equal sectors. Offsets are relative to the
+ * start of the region. Flash semantics apply: erasing sets a sector to 0xFF,
+ * and each page may be programmed once between erases.
+ */
+struct TKFlashOps {
+    uint32_t sectorSize;
+    uint32_t sectorCount;
+    /* The programming unit. It divides sectorSize. */
+    uint32_t pageSize;
+
+    /**
+     * Read from the region.
+     * @param offset the offset to read from
+     * @param buffer the buffer to read into
+     * @param size the number of bytes to read
+     * @return TK_OK, or TK_FLASH_ERROR
+     */
+    TKStatus (*read)(uint32_t offset, void * buffer, uint32_t size);
+
+    /**
+     * Program one page.
+     * @param offset a page-aligned offset
+     * @param page pageSize bytes, word-aligned
+     * @return TK_OK, or TK_FLASH_ERROR
+     */
+    TKStatus (*program)(uint32_t offset, const void * page);
+
+    /**
+     * Erase one sector.
+     * @param sector the sector to erase, from 0 to sectorCount - 1
+     * @return TK_OK, or TK_FLASH_ERROR
+     */
+    TKStatus (*erase)(uint32_t sector);
+};
+
+/* The on-chip flash reserved for storage, sectors 24 through 27. The linker
+ * script keeps code out of it.
+ */
+#define TK_IAP_FLASH_BASE (0x7A000)
+#define TK_IAP_FLASH_SECTOR_SIZE (0x1000)
+#define TK_IAP_FLASH_SECTORS (4)
+#define TK_IAP_FLASH_PAGE_SIZE (256)
+
+/* The simulated flash, sized to fit in RAM. */
+#define TK_SIM_FLASH_SECTOR_SIZE (128)
+#define TK_SIM_FLASH_SECTORS (4)
+#define TK_SIM_FLASH_PAGE_SIZE (32)
+
+/**
+ * Get the on-chip flash, programmed through the IAP routines. Interrupts are
+ * disabled while a page is programmed or a sector is erased, which takes
+ * milliseconds.
+ * @return the flash ops
+ */
+const struct TKFlashOps * TKIapFlash(void);
+
+/**
+ * Get the simulated flash. It lives in RAM and enforces flash semantics, so
+ * code written against TKFlashOps can be tested without wearing out the chip.
+ * @return the flash ops
+ */
+const struct TKFlashOps * TKSimFlash(void);
+
+/**
+ * Erase all of the simulated flash and clear its counters.
+ */
+void TKSimFlashReset(void);
+
+/**
+ * Get the simulated flash contents, so tests can corrupt them.
+ * @return the TK_SIM_FLASH_SECTORS * TK_SIM_FLASH_SECTOR_SIZE bytes of flash
+ */
+uint8_t * TKSimFlashData(void);
+
+/**
+ * Get the number of times a simulated sector has been erased.
+ * @param sector the sector
+ * @return the erase count
+ */
+uint32_t TKSimFlashEraseCount(uint32_t sector);
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef __TK_HRTIMER_H__
+#define __TK_HRTIMER_H__
+
+#include <stdbool.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/status.h"
+
+/*
+ * High resolution one-shot timers, for delays finer than a tick. Deadlines
+ * are in cycles (see TKGetCycles). Pending timers are kept in a queue, soonest
+ * first, and the soonest one is armed on Timer0's MR1 match register if it is
+ * due before the next tick; later ones wait for the tick that precedes them,
+ * which arms them then. Either way a timer fires within a few microseconds of
+ * its deadline, and the tick rate stays as it is.
+ *
+ * Callbacks run in the timer interrupt with interrupts disabled, so they must
+ * be short and must not block. A thread made runnable by one is switched to
+ * right away if it has the highest priority.
+ */
+
+typedef void (*TKHrTimerCallback)(void * data);
+
+struct TKHrTimer {
+    /* Private; set up by TKStartHrTimer. */
+    struct TKHrTimer * next;
+    uint64_t deadline;
+    TKHrTimerCallback callback;
+    void * data;
+    bool pending;
+};
+
+/**
+ * Initialize the high resolution timer queue.
+ */
+void TKInitHrTimers(void);
+
+/**
+ * Start a timer that fires at a given cycle count. Use this to space events
+ * exactly, by adding the period to the last deadline rather than starting
+ * from the current time. A deadline that has already passed fires at once,
+ * or when the callback returns if this is called from a timer callback.
+ * @param timer the timer, which must stay allocated until it fires or is
+ * cancelled
+ * @param deadline the cycle count to fire at
+ * @param callback called when the timer fires
+ * @param data passed to callback
+ * @return TK_OK if the timer was started
+ * @return TK_NULL if timer or callback is NULL
+ * @return TK_BUSY if the timer is already pending
+ */
+TKStatus TKStartHrTimerAt(struct TKHrTimer * timer,
+                          uint64_t deadline,
+                          TKHrTimerCallback callback,
+                          void * data);
+
+/**
+ * Start a timer that fires after a delay.
+ * @param timer the timer, which must stay allocated until it fires or is
+ * cancelled
+ * @param us the delay in microseconds
+ * @param callback called when the timer fires
+ * @param data passed to callback
+ * @return as for TKStartHrTimerAt
+ */
+TKStatus TKStartHrTimer(struct TKHrTimer * timer,
+                        uint32_t us,
+                        TKHrTimerCallback callback,
+                        void * data);
+
+/**
+ * Cancel a pending timer.
+ * @param timer the timer
+ * @return TK_OK if the timer was cancelled before it fired
+ * @return TK_NULL if timer is NULL
+ * @return TK_UNEXPECTED if the timer wasn't pending
+ */
+TKStatus TKCancelHrTimer(struct TKHrTimer * timer);
+
+/**
+ * Block the calling thread for a number of microseconds, without the
+ * rounding to ticks of TKThreadSleep.
+ * @param us the delay in microseconds
+ * @return TK_OK after the delay
+ * @return TK_UNEXPECTED if there is no current thread
+ */
+TKStatus TKHrSleep(uint32_t us);
+
+/**
+ * Fire the timers due by a given cycle count, without arming the hardware.
+ * This is the part of TKRunHrTimers after the time is read, split out so it
+ * can be tested. Call with interrupts disabled.
+ * @param now the cycle count
+ * @return the number of timers fired
+ */
+uint32_t _TKExpireHrTimers(uint64_t now);
+
+/**
+ * Fire the timers that are due and arm the match register for the next one.
+ * Called from the timer interrupt.
+ */
+void TKRunHrTimers(void);
+
+#endif
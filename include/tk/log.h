@@ -0,0 +1,84 @@
+#ifndef __TK_LOG_H__
+#define __TK_LOG_H__
+
+#include "lpc/lpc2378.h"
+
+#include "tk/ddf.h"
+#include "tk/thread.h"
+
+/*
+ * Deferred logging. TKLog copies a message into a RAM ring and returns, and a
+ * drain thread later writes the ring out through the serial driver, so a
+ * thread that logs never waits on the UART or holds the serial driver lock.
+ * When the ring is full, messages are dropped whole and counted, and the drain
+ * thread reports how many were lost.
+ */
+
+/* The bytes the ring holds. A power of two. */
+#define TK_LOG_RING_SIZE (512)
+
+/* The priority of the drain thread. Normal threads may never leave the CPU
+ * idle, so the drain thread shares their time slices rather than waiting for
+ * idle time that may not come.
+ */
+#define TK_LOG_PRIORITY (TK_PRIORITY_NORMAL)
+
+/* The most strings TKLogStrings takes as one message. */
+#define TK_LOG_MAX_STRINGS (8)
+
+/* How often, in ticks, the drain thread sends out trace records. */
+#define TK_LOG_TRACE_INTERVAL (10)
+
+struct TKLogStats {
+    /* Messages and bytes accepted into the ring. */
+    uint32_t messages;
+    uint32_t bytes;
+    /* Messages and bytes dropped because the ring was full. */
+    uint32_t droppedMessages;
+    uint32_t droppedBytes;
+};
+
+/**
+ * Initialize the log ring. This must be called before TKLog.
+ */
+void TKInitLog(void);
+
+/**
+ * Queue a NULL-terminated string to be printed over UART. This copies the
+ * string and returns without waiting for the UART.
+ * @param s the string to log
+ */
+void TKLog(const char * s);
+
+/**
+ * Queue several NULL-terminated strings as one message. The message goes into
+ * the ring whole or, if it doesn't fit, is dropped whole.
+ * @param strings an array of strings to log, in order
+ * @param count the number of strings, at most TK_LOG_MAX_STRINGS; a longer
+ * message is dropped
+ */
+void TKLogStrings(const char * const * strings, uint32_t count);
+
+/**
+ * Read the log counters.
+ * @param stats filled in with the counters
+ */
+void TKLogGetStats(struct TKLogStats * stats);
+
+/**
+ * Write out everything queued in the ring so far, followed by a note if
+ * messages were dropped since the last one.
+ * @param print writes buffer segments out, e.g. TKPrintv
+ * @return the number of queued bytes written
+ */
+uint32_t _TKLogDrain(void (*print)(struct TKIoVec * vec, uint32_t count));
+uint32_t TKLogDrain(void);
+
+/**
+ * The drain thread entry point: drain the ring and the trace ring, then sleep
+ * until TKLog queues more or it is time to look for trace records again.
+ * @param p unused
+ */
+void TKLogThread(void * p);
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __TK_LOGSTORE_H__
+#define __TK_LOGSTORE_H__
+
+#include "lpc/lpc2378.h"
+
+#include "tk/flash.h"
+#include "tk/semaphore.h"
+#include "tk/status.h"
+
+/*
+ * An append-only record store on flash. Records are packed into a page buffer
+ * in RAM and programmed a page at a time. Sectors are filled in turn; when the
+ * last one is full, the store wraps around and erases the oldest, so every
+ * sector wears at the same rate. Each sector starts with a header holding a
+ * sequence number, which is all that needs reading to find the newest sector
+ * at boot.
+ */
+
+/* The largest flash page a store can use. */
+#define TK_LOG_MAX_PAGE_SIZE (256)
+
+struct TKLogStore {
+    const struct TKFlashOps * flash;
+    /* The sector being written, and its sequence number. */
+    uint32_t sector;
+    uint32_t sequence;
+    /* The oldest sector holding records. */
+    uint32_t oldest;
+    /* The offset within the sector that the page buffer will be written to. */
+    uint32_t offset;
+    /* The number of bytes in the page buffer. */
+    uint32_t fill;
+    uint8_t page[TK_LOG_MAX_PAGE_SIZE] __attribute__ ((aligned(4)));
+    struct TKSemaphore sem;
+};
+
+/* A position in a store, for reading records back. */
+struct TKLogCursor {
+    uint32_t sector;
+    uint32_t offset;
+    /* The number of sectors after this one left to read. */
+    uint32_t sectorsLeft;
+};
+
+/**
+ * Open a store on a flash region. The sector headers are scanned to find the
+ * newest sector, and only that sector's records are scanned to find the end
+ * of the log. A region holding no store is formatted. Pages holding a torn or
+ * corrupt record are skipped, losing the rest of their records.
+ *
+ * @param log the store
+ * @param flash the flash region
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_UNSUPPORTED if the flash geometry can't be used
+ * TK_FLASH_ERROR if the flash failed
+ */
+TKStatus TKLogOpen(struct TKLogStore * log, const struct TKFlashOps * flash);
+
+/**
+ * Append a record. It is buffered until its page fills, or TKLogFlush is
+ * called.
+ *
+ * @param log the store
+ * @param data the record
+ * @param size the record size; at most a sector, less 12 bytes
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_LOG_RECORD_TOO_BIG if the record can't fit in a sector
+ * TK_FLASH_ERROR if the flash failed
+ */
+TKStatus TKLogAppend(struct TKLogStore * log, const void * data, uint32_t size);
+
+/**
+ * Program any buffered records. The rest of their page is left blank, and
+ * later records start on the next page.
+ *
+ * @param log the store
+ * @return TKStatus
+ * TK_OK if the operation succeeded
+ * TK_FLASH_ERROR if the flash failed
+ */
+TKStatus TKLogFlush(struct TKLogStore * log);
+
+/**
+ * Point a cursor at the oldest record in a store.
+ * @param log the store
+ * @param cursor the cursor
+ */
+void TKLogRewind(struct TKLogStore * log, struct TKLogCursor * cursor);
+
+/**
+ * Read the record at a cursor and advance it. Only records that have been
+ * programmed are read; call TKLogFlush first to see everything.
+ *
+ * @param log the store
+ * @param cursor the cursor
+ * @param buffer the buffer to read into
+ * @param size the buffer size; longer records are truncated
+ * @param length set to the record's length
+ * @return TKStatus
+ * TK_OK if a record was read
+ * TK_LOG_END if there are no more records
+ * TK_FLASH_ERROR if the flash failed
+ */
+TKStatus TKLogRead(struct TKLogStore * log,
+                   struct TKLogCursor * cursor,
+                   void * buffer,
+                   uint32_t size,
+                   uint32_t * length);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef __TK_PROBE_H__
+#define __TK_PROBE_H__
+
+#include <stdbool.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/timing.h"
+
+/*
+ * Named timing probes, built in with -DTK_PROBES. A probe times the code
+ * between TK_PROBE_START and TK_PROBE_STOP and keeps the same statistics and
+ * histogram as the scheduling metrics. Without TK_PROBES the macros expand to
+ * nothing, so probes can be left in hot paths at no cost, e.g.
+ *
+ *   TK_PROBE_DEFINE(FooRead);
+ *
+ *   int FooRead(...) {
+ *       TK_PROBE_START(FooRead);
+ *       ...
+ *       TK_PROBE_STOP(FooRead);
+ *   }
+ *
+ * TK_PROBE_START declares a variable holding the start time, so START and STOP
+ * must be in the same function and each probe started at most once in it.
+ * Probes are static to the file that defines them.
+ *
+ * Probes are registered in the .tk_probes section, which the linker script
+ * gathers into flash between __tk_probes_start and __tk_probes_end, and
+ * TKDumpAllProbes prints every one of them.
+ */
+
+struct TKProbe {
+    const char * name;
+    struct TKInstrumentData * data;
+};
+
+#ifdef TK_PROBES
+
+#define TK_PROBE_DEFINE(name) \
+    static struct TKInstrumentData name##ProbeData; \
+    static const struct TKProbe name##Probe \
+    __attribute__ ((section(".tk_probes"), used, aligned(4))) = \
+        { #name, &name##ProbeData }
+#define TK_PROBE_START(name) uint32_t name##ProbeStart = TKProbeStart()
+#define TK_PROBE_STOP(name) TKProbeStop(&name##Probe, name##ProbeStart)
+
+#else
+
+/* Still a declaration, so the semicolon after it is allowed. */
+#define TK_PROBE_DEFINE(name) struct TKProbe
+#define TK_PROBE_START(name) do { } while (0)
+#define TK_PROBE_STOP(name) do { } while (0)
+
+#endif
+
+/**
+ * Initialize every registered probe.
+ */
+void TKInitProbes(void);
+
+/**
+ * Get the time a probe starts at. Use TK_PROBE_START rather than calling this
+ * directly.
+ * @return the low 32 bits of the cycle count
+ */
+uint32_t TKProbeStart(void);
+
+/**
+ * Record the time since a probe started. Use TK_PROBE_STOP rather than calling
+ * this directly. This can be called from interrupt handlers and from several
+ * threads at once.
+ * @param probe the probe
+ * @param start the value TKProbeStart returned
+ */
+void TKProbeStop(const struct TKProbe * probe, uint32_t start);
+
+/**
+ * Look up a registered probe.
+ * @param name the name given to TK_PROBE_DEFINE
+ * @return the probe, or NULL if there is no such probe
+ */
+const struct TKProbe * TKFindProbe(const char * name);
+
+/**
+ * Print one line of statistics per registered probe, in microseconds. This
+ * prints nothing if there are no probes.
+ * @param reset true to start every probe over, so the next dump only covers
+ * what happened after this one
+ */
+void TKDumpAllProbes(bool reset);
+
+#endif
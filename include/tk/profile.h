@@ -0,0 +1,114 @@
+#ifndef __TK_PROFILE_H__
+#define __TK_PROFILE_H__
+
+#include <stdbool.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/status.h"
+
+/*
+ * A sampling profiler, built in with -DTK_PROFILING. While it runs, Timer0's
+ * MR2 match interrupts at about the rate given to TKStartProfiler, and each
+ * interrupt records the PC and LR the interrupted thread was at, taken from
+ * the frame the context switch code saves. The gap between samples is
+ * randomized around the mean, so samples don't lock onto the tick or other
+ * periodic work. A sample costs about a microsecond, so 1kHz is under 0.2%
+ * of the CPU.
+ *
+ * Samples are counted in a small table by PC, LR and thread rather than
+ * kept one by one, so the profiler can run for as long as needed. Samples
+ * that don't fit are counted as dropped. TKDumpProfile streams the table
+ * over serial as text lines starting with "#TKP", which tools/tkprofile.py
+ * symbolizes against tinykernel.elf and turns into a flat profile or folded
+ * stacks for flame graphs.
+ *
+ * The LR gives the caller when the sample lands in a leaf function, or in a
+ * function that hasn't yet saved it; elsewhere it may be stale. Code that
+ * runs with interrupts disabled is sampled when it enables them again.
+ */
+
+#ifndef TK_PROFILE_ENTRIES
+#define TK_PROFILE_ENTRIES (64)
+#endif
+
+/* The fastest sampling rate TKStartProfiler accepts. */
+#define TK_PROFILE_MAX_HZ (10000)
+
+struct TKProfileEntry {
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t count;
+    /* The thread, named as in events (see TK_EVENT_OBJECT). */
+    uint16_t thread;
+};
+
+#ifdef TK_PROFILING
+
+#define TK_PROFILE_INTERRUPT(stackPointer, matches) \
+    TKProfileInterrupt(stackPointer, matches)
+
+/**
+ * Take a sample if one is due, and arm the match register for the next one.
+ * Use TK_PROFILE_INTERRUPT rather than calling this directly, so the call
+ * compiles away when profiling is off. Called from the timer interrupt.
+ * @param stackPointer the interrupted thread's saved frame
+ * @param matches the Timer0 match flags that raised the interrupt
+ */
+void TKProfileInterrupt(void * stackPointer, uint32_t matches);
+
+/**
+ * Start sampling, keeping any samples already recorded.
+ * @param hz the mean number of samples per second
+ * @return TK_OK if the profiler was started
+ * @return TK_UNSUPPORTED if hz is 0 or over TK_PROFILE_MAX_HZ
+ */
+TKStatus TKStartProfiler(uint32_t hz);
+
+/**
+ * Stop sampling. The samples are kept until they are dumped.
+ */
+void TKStopProfiler(void);
+
+/**
+ * Count a sample. This is the part of a sample after the frame is read,
+ * split out so it can be tested. Call with interrupts disabled.
+ * @param pc the interrupted PC
+ * @param lr the interrupted LR
+ * @param thread the interrupted thread's name in events
+ * @return true if the sample was counted, false if it was dropped
+ */
+bool _TKRecordProfileSample(uint32_t pc, uint32_t lr, uint16_t thread);
+
+/**
+ * Get the samples recorded so far. This is for tests; use TKDumpProfile to
+ * get them out of the board.
+ * @param entries filled in with up to count entries, in no particular order
+ * @param count the size of entries
+ * @param dropped set to the number of samples that didn't fit in the table
+ * @return the number of entries copied
+ */
+uint32_t TKGetProfile(struct TKProfileEntry * entries,
+                      uint32_t count,
+                      uint32_t * dropped);
+
+/**
+ * Print the samples recorded so far, along with the thread names and the
+ * sampling rate. Sampling is paused while the dump runs, so it doesn't sample
+ * its own serial writes.
+ * @param reset true to throw the samples away after printing them
+ */
+void TKDumpProfile(bool reset);
+
+/**
+ * Throw away all recorded samples.
+ */
+void TKResetProfile(void);
+
+#else
+
+#define TK_PROFILE_INTERRUPT(stackPointer, matches) do { } while (0)
+
+#endif
+
+#endif
@@ -20,7 +20,9 @@ struct TKSemaphore {
 TKStatus TKCreateSemaphore(struct TKSemaphore * sem, uint32_t count);
 
 /**
- * Up operation on a semaphore.
+ * Up operation on a semaphore. If threads are waiting, the semaphore is handed
+ * to the highest priority waiter (oldest first among equals), and the caller
+ * yields to it if it outranks the caller.
  *
  * @param sem a semaphore pointer
  */
@@ -37,4 +39,17 @@ TKStatus TKUpSemaphore(struct TKSemaphore * sem);
 TKStatus _TKDownSemaphore(struct TKSemaphore * sem, struct TKThread * thread);
 TKStatus TKDownSemaphore(struct TKSemaphore * sem);
 
+/**
+ * Down operation on a semaphore that gives up after a number of ticks. A
+ * timeout of 0 never blocks.
+ *
+ * @param sem a semaphore pointer
+ * @param timeout the timeout in ticks, or TK_WAIT_FOREVER
+ * @return TK_OK if the semaphore was taken, TK_TIMEOUT if it was not
+ */
+TKStatus _TKDownSemaphoreTimeout(struct TKSemaphore * sem,
+                                 struct TKThread * thread,
+                                 uint32_t timeout);
+TKStatus TKDownSemaphoreTimeout(struct TKSemaphore * sem, uint32_t timeout);
+
 #endif
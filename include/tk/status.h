@@ -17,6 +17,18 @@ typedef enum TKStatus {
     TK_NO_POWER,
     TK_ALREADY_POWERED_ON,
     TK_ALREADY_POWERED_OFF,
+    TK_BUFFERS_UNSUPPORTED,
+    TK_BUFFER_ALREADY_ACQUIRED,
+    TK_BUFFER_NOT_ACQUIRED,
+    TK_BUFFER_BAD_SIZE,
+    TK_TIMEOUT,
+    TK_IOCTL_SKIPPED,
+    TK_UNSUPPORTED,
+    TK_BLOCK_OUT_OF_RANGE,
+    TK_BLOCK_BAD_SIZE,
+    TK_FLASH_ERROR,
+    TK_LOG_END,
+    TK_LOG_RECORD_TOO_BIG,
     TK_UNEXPECTED
 } TKStatus;
 
@@ -1,6 +1,8 @@
 #ifndef __TK_THREAD_H__
 #define __TK_THREAD_H__
 
+#include <stdbool.h>
+
 #include "lpc/lpc2378.h"
 
 #include "tk/critical_section.h"
@@ -13,6 +15,14 @@
 #define TK_PRIORITY_HIGHEST (254)
 #define TK_STACK_SIZE (256)
 
+/* The number of threads that can exist at once. Each costs a TCB of about
+ * 1KB, which is most of the RAM the kernel uses.
+ */
+#define TK_MAX_THREADS (16)
+
+/* A timeout, in ticks, that never expires. */
+#define TK_WAIT_FOREVER (0xFFFFFFFF)
+
 typedef uint8_t TKThreadPriority;
 typedef uint32_t TKThreadStatus;
 typedef void TKThreadEntryType(void * p);
@@ -22,6 +32,13 @@ struct TKThreadQueue {
     struct TKThread * head;
 };
 
+/* Threads blocked with a timeout, linked through TKThread::timeoutNext. A
+ * thread on this list is also on the queue it is blocked on.
+ */
+struct TKTimeoutList {
+    struct TKThread * head;
+};
+
 struct TKThread {
     /* It is important that the stack pointer comes first because the context
      * switching code will use the global current thread pointer as a stack
@@ -37,6 +54,25 @@ struct TKThread {
     struct TKThreadQueue * queue;
     struct TKThread * prev;
     struct TKThread * next;
+
+    /* Timed waits. deadline is the tick at which the wait gives up, and
+     * timedOut records whether it did.
+     */
+    TKTickCount deadline;
+    bool timedOut;
+    struct TKThread * timeoutNext;
+
+    /* Timeout of the blocking operation in progress, see TKSetTimeout. */
+    TKTickCount timeoutStart;
+    uint32_t timeout;
+
+#ifdef TK_EVENT_TRACING
+    /* When the thread was last made runnable, if it hasn't run since, for the
+     * wakeup latency trigger.
+     */
+    uint32_t wokenAt;
+    bool woken;
+#endif
 };
 
 /**
@@ -79,6 +115,53 @@ struct TKThread * TKPopThread(struct TKThreadQueue * queue);
  */
 int TKRemoveThread(struct TKThread * thread);
 
+/**
+ * Add a thread to a timeout list. The thread will be woken with timedOut set
+ * once the tick count reaches its deadline, unless it is removed first.
+ *
+ * @param list a timeout list pointer
+ * @param thread a thread pointer
+ */
+void TKAddTimeout(struct TKTimeoutList * list, struct TKThread * thread);
+
+/**
+ * Remove a thread from a timeout list. Does nothing if it is not on the list.
+ *
+ * @param list a timeout list pointer
+ * @param thread a thread pointer
+ */
+void TKRemoveTimeout(struct TKTimeoutList * list, struct TKThread * thread);
+
+/**
+ * Wake every thread on a timeout list whose deadline has passed. Each one is
+ * removed from the queue it was blocked on and added to the run queue.
+ *
+ * @param list a timeout list pointer
+ * @param runQueue the run queue
+ * @param tickCount the current tick count
+ */
+void _TKExpireTimeouts(struct TKTimeoutList * list,
+                       struct TKThreadQueue * runQueue,
+                       TKTickCount tickCount);
+
+/**
+ * Set the timeout of the blocking operation the calling thread is about to
+ * perform. Code that blocks on behalf of the caller, such as a driver op, can
+ * then honor it with TKTimeoutRemaining.
+ *
+ * @param timeout the timeout in ticks, or TK_WAIT_FOREVER
+ */
+void TKSetTimeout(uint32_t timeout);
+
+/**
+ * Get the time left before the calling thread's current blocking operation
+ * should give up.
+ *
+ * @return the remaining ticks, 0 if the timeout has passed, or
+ *         TK_WAIT_FOREVER if there is no timeout
+ */
+uint32_t TKTimeoutRemaining(void);
+
 /**
  * Enter the scheduler to pick a task and switch to it. This routine is called
  * from the timer tick ISR.
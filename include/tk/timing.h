@@ -1,6 +1,8 @@
 #ifndef __TIMING_H__
 #define __TIMING_H__
 
+#include <stdbool.h>
+
 #include "lpc/lpc2378.h"
 
 /* Note: At 2 Hz, this value overflows after 90 days. Since this is for a class
@@ -13,14 +15,39 @@
  */
 typedef volatile uint32_t TKTickCount;
 
+/* Timer0 match interrupt flags. MR0 is the tick, MR1 fires high resolution
+ * timers between ticks, and MR2 takes profiler samples.
+ */
+#define TK_TIMER_TICK_MATCH BIT(0)
+#define TK_TIMER_HRTIMER_MATCH BIT(1)
+#define TK_TIMER_PROFILE_MATCH BIT(2)
+
+/* The number of log2 buckets in an instrumentation histogram. Bucket 0 counts
+ * times of 0, and bucket n counts times from 2^(n-1) to 2^n - 1 cycles. The
+ * last bucket also takes everything longer.
+ */
+#ifndef TK_INSTRUMENT_BUCKETS
+#define TK_INSTRUMENT_BUCKETS (32)
+#endif
+
+/* Instrumentation data has a single writer, TKStopInstrumenting, which must
+ * not be preempted by readers; in the kernel it runs in the tick interrupt.
+ * Readers take consistent copies with TKSnapshotInstrumentData, which retries
+ * while sequence is odd or changes under it, so they never disable interrupts.
+ */
 struct TKInstrumentData {
     const char * name;
-    uint32_t start;
+    uint64_t start;
     uint32_t last;
     uint32_t count;
     uint64_t sum;
     uint32_t min;
     uint32_t max;
+    uint32_t buckets[TK_INSTRUMENT_BUCKETS];
+    /* Odd while the writer is updating. */
+    volatile uint32_t sequence;
+    /* The sequence a reader asked to reset at; see TKSnapshotInstrumentData. */
+    volatile uint32_t resetSequence;
 };
 
 /**
@@ -39,8 +66,40 @@ void TKStartInstrumenting(struct TKInstrumentData * data);
 /**
  * Stop instrumenting.
  * @param data the data for keeping track of instrumentation.
+ * @return the time since TKStartInstrumenting, in cycles
+ */
+uint32_t TKStopInstrumenting(struct TKInstrumentData * data);
+
+/**
+ * Record one measurement. This is the part of TKStopInstrumenting after the
+ * timer is read, split out so it can be tested.
+ * @param data the data for keeping track of instrumentation.
+ * @param delta the measurement, in cycles
+ */
+void _TKRecordInstrumentSample(struct TKInstrumentData * data, uint32_t delta);
+
+/**
+ * Take a consistent copy of instrumentation data without disabling interrupts,
+ * optionally starting it over, so that consecutive snapshots each cover their
+ * own interval and no measurement is counted twice or lost.
+ * @param data the data for keeping track of instrumentation.
+ * @param snapshot filled in with the copy
+ * @param reset true to clear data as of the copy
  */
-void TKStopInstrumenting(struct TKInstrumentData * data);
+void TKSnapshotInstrumentData(struct TKInstrumentData * data,
+                              struct TKInstrumentData * snapshot,
+                              bool reset);
+
+/**
+ * Estimate a percentile from a snapshot's histogram. The result is the upper
+ * bound of the bucket holding the percentile, capped at the maximum, so it errs
+ * on the long side by at most a factor of 2.
+ * @param snapshot a snapshot from TKSnapshotInstrumentData
+ * @param perMille the percentile in tenths of a percent, e.g. 999 for p99.9
+ * @return the time in cycles, or 0 if nothing was recorded
+ */
+uint32_t TKInstrumentPercentile(const struct TKInstrumentData * snapshot,
+                                uint32_t perMille);
 
 /**
  * Print instrumentation data recorded so far.
@@ -48,6 +107,56 @@ void TKStopInstrumenting(struct TKInstrumentData * data);
  */
 void TKPrintInstrumentationData(struct TKInstrumentData * data);
 
+/**
+ * Start Timer1 as a free-running cycle counter at the CPU clock. This must be
+ * called before anything uses the cycle count; main calls it right after
+ * initializing the hardware, so the tests can use it too.
+ */
+void TKInitCycleCounter(void);
+
+/**
+ * Get the number of cycles since TKInitCycleCounter. Unlike the tick timer,
+ * Timer1 is never reset, so differences are valid across ticks. Its 32 bits
+ * are extended to 64 in software, which needs this to be called at least once
+ * per wrap, about 89 seconds at 48MHz; the tick interrupt sees to that.
+ * @return the count
+ */
+uint64_t TKGetCycles(void);
+
+/**
+ * Get the rate of TKGetCycles.
+ * @return the rate in Hz
+ */
+uint32_t TKGetCyclesHz(void);
+
+/**
+ * Convert cycles to nanoseconds. This multiplies by a scale computed once in
+ * TKInitCycleCounter rather than dividing.
+ * @param cycles the cycles
+ * @return the time in nanoseconds
+ */
+uint64_t TKCyclesToNs(uint64_t cycles);
+
+/**
+ * Convert cycles to microseconds, like TKCyclesToNs.
+ * @param cycles the cycles
+ * @return the time in microseconds
+ */
+uint64_t TKCyclesToUs(uint64_t cycles);
+
+/**
+ * Convert microseconds to cycles, like TKCyclesToNs.
+ * @param us the time in microseconds
+ * @return the cycles
+ */
+uint64_t TKUsToCycles(uint32_t us);
+
+/**
+ * Get the time since TKInitCycleCounter.
+ * @return the time in nanoseconds
+ */
+uint64_t TKGetTimeNs(void);
+
 /*
  * Initialize the timer.
  *
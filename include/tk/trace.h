@@ -0,0 +1,93 @@
+#ifndef __TK_TRACE_H__
+#define __TK_TRACE_H__
+
+#include <stdbool.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/common.h"
+#include "tk/ddf.h"
+
+/*
+ * Binary tracing. TK_TRACE records a format string ID, a timestamp and its raw
+ * argument words into a RAM ring, without formatting anything on the target.
+ * The format strings are placed in the .tk_trace_formats section, which the
+ * linker script keeps out of flash; a string's address within it is its ID.
+ * The log drain thread sends the ring out over the serial port, interleaved
+ * with the text log and without the driver's newline translation, and
+ * tools/tktrace.py decodes it on the host using the format strings from the
+ * ELF.
+ *
+ * Each record is a header word, a timestamp word and then its arguments, all
+ * little-endian. The low byte of the header is TK_TRACE_MARKER plus the
+ * argument count, which never occurs in ASCII text, and the top three bytes
+ * are the format ID.
+ */
+
+/* The words the ring holds. A power of two. */
+#define TK_TRACE_RING_WORDS (128)
+
+/* The most arguments a trace record can have. */
+#define TK_TRACE_MAX_ARGS (4)
+
+#define TK_TRACE_MARKER (0xF0)
+
+/* The format ID of a record reporting dropped records. Its argument is the
+ * number dropped.
+ */
+#define TK_TRACE_DROPPED_ID (0xFFFFFFUL)
+
+/**
+ * Record a trace event. The arguments are stored as 32-bit words and
+ * formatted on the host, so they must be integers, not strings. This can be
+ * used from threads and interrupt handlers.
+ * @param format a string literal, printf style
+ * @param ... up to TK_TRACE_MAX_ARGS integer arguments
+ */
+#define TK_TRACE(format, ...)                                                  \
+    do {                                                                       \
+        static const char _tkTraceFormat[]                                     \
+            __attribute__ ((section(".tk_trace_formats"))) = format;           \
+        const uint32_t _tkTraceArgs[] = { 0, ##__VA_ARGS__ };                  \
+        (void) sizeof(char[1 - 2 * (ARRAYLEN(_tkTraceArgs) - 1 >               \
+                                    TK_TRACE_MAX_ARGS)]);                      \
+        TKTrace((uint32_t) _tkTraceFormat,                                     \
+                &_tkTraceArgs[1],                                              \
+                ARRAYLEN(_tkTraceArgs) - 1);                                   \
+    } while (0)
+
+/**
+ * Initialize the trace ring. This must be called before TK_TRACE.
+ */
+void TKInitTrace(void);
+
+/**
+ * Record a trace event. Use TK_TRACE rather than calling this directly.
+ * @param id the format ID
+ * @param args the arguments
+ * @param count the number of arguments, at most TK_TRACE_MAX_ARGS
+ */
+void TKTrace(uint32_t id, const uint32_t * args, uint32_t count);
+
+/**
+ * Get the number of records dropped because the ring was full.
+ * @return the count
+ */
+uint32_t TKTraceDropped(void);
+
+/**
+ * Check whether there are records waiting to be drained.
+ * @return true if there are
+ */
+bool TKTracePending(void);
+
+/**
+ * Write out every record in the ring so far, followed by a dropped record if
+ * records were dropped since the last one.
+ * @param print writes buffer segments out, e.g. TKPrintRawv
+ * @return the number of bytes of records written
+ */
+uint32_t _TKTraceDrain(void (*print)(struct TKIoVec * vec, uint32_t count));
+uint32_t TKTraceDrain(void);
+
+#endif
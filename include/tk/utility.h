@@ -1,8 +1,18 @@
 #ifndef __TK_UTILITY_H__
 #define __TK_UTILITY_H__
 
+#include <stdarg.h>
+
 #include "lpc/lpc2378.h"
 
+#include "tk/ddf.h"
+
+/* Big enough for any 64-bit decimal plus the NULL terminator. */
+#define TK_DECIMAL_BUFFER_SIZE (21)
+
+/* The longest message TKPrintf prints; the rest is cut off. */
+#define TK_PRINTF_BUFFER_SIZE (160)
+
 extern uint32_t TKDisableInterrupts(void);
 extern void TKEnableInterrupts(uint32_t cpsr);
 
@@ -25,12 +35,71 @@ void TKRawPrintHex(uint32_t x);
 void TKPrintDecimal(uint64_t x);
 void TKRawPrintDecimal(uint64_t x);
 
+/**
+ * Format a decimal (up to 64-bit) into a caller-supplied buffer.
+ * @param x the decimal
+ * @param buffer a buffer of at least TK_DECIMAL_BUFFER_SIZE bytes
+ * @return a pointer to the NULL-terminated decimal string within buffer
+ */
+char * TKFormatDecimal(uint64_t x, char * buffer);
+
+/**
+ * Format a string into a buffer, printf style. This supports %d, %i, %u, %x,
+ * %X, %c, %s and %%, a field width with the - and 0 flags, and the l and ll
+ * sizes; uint32_t is a long, so it takes %lu. Decimals are converted without
+ * division, since the core has no divider.
+ * @param buffer the buffer; the result is always NULL-terminated if size is
+ * nonzero
+ * @param size the size of buffer
+ * @param format the format string
+ * @return the length of the whole result, which is size or more if it was
+ * cut off
+ */
+int TKSnprintf(char * buffer, uint32_t size, const char * format, ...)
+    __attribute__ ((format(printf, 3, 4)));
+int TKVsnprintf(char * buffer,
+                uint32_t size,
+                const char * format,
+                va_list args);
+
+/**
+ * Format a message with TKSnprintf and print it over UART in a single driver
+ * write. Messages longer than TK_PRINTF_BUFFER_SIZE - 1 are cut off.
+ * @param format the format string
+ */
+void TKPrintf(const char * format, ...)
+    __attribute__ ((format(printf, 1, 2)));
+
 /**
  * Print a NULL-terminated string over UART.
  * @param p the string to print
  */
 void TKPrintString(const char * p);
 
+/**
+ * Print several NULL-terminated strings over UART as one message. The strings
+ * are gathered into a single vectored driver write, so the serial driver lock
+ * is taken once for the whole message rather than once per string.
+ * @param strings an array of strings to print, in order
+ * @param count the number of strings
+ */
+void TKPrintStrings(const char * const * strings, uint32_t count);
+
+/**
+ * Print buffer segments over UART as one message.
+ * @param vec an array of buffer segments; it is modified as data is written
+ * @param count the number of segments
+ */
+void TKPrintv(struct TKIoVec * vec, uint32_t count);
+
+/**
+ * Print buffer segments over UART byte for byte, without turning '\n' into
+ * "\n\r", for binary data.
+ * @param vec an array of buffer segments; it is modified as data is written
+ * @param count the number of segments
+ */
+void TKPrintRawv(struct TKIoVec * vec, uint32_t count);
+
 /**
  * Print a NULL-terminated string directly over UART without using the TK serial
  * driver. This should be used when TK is not yet initialized.
@@ -0,0 +1,62 @@
+#include "lpc/iap.h"
+#include "lpc/lpc2378.h"
+
+typedef void (*IAPEntry)(uint32_t command[], uint32_t result[]);
+
+static uint32_t IAPCall(uint32_t command[], uint32_t result[]) {
+    IAPEntry entry = (IAPEntry) IAP_LOCATION;
+
+    entry(command, result);
+    return result[0];
+}
+
+uint32_t IAPPrepareSectors(uint32_t start, uint32_t end) {
+    uint32_t command[5];
+    uint32_t result[5];
+
+    command[0] = IAP_PREPARE_SECTORS;
+    command[1] = start;
+    command[2] = end;
+    return IAPCall(command, result);
+}
+
+uint32_t IAPCopyRamToFlash(uint32_t dst, const void * src, uint32_t size,
+                           uint32_t cclkKHz) {
+    uint32_t command[5];
+    uint32_t result[5];
+
+    command[0] = IAP_COPY_RAM_TO_FLASH;
+    command[1] = dst;
+    command[2] = (uint32_t) src;
+    command[3] = size;
+    command[4] = cclkKHz;
+    return IAPCall(command, result);
+}
+
+uint32_t IAPEraseSectors(uint32_t start, uint32_t end, uint32_t cclkKHz) {
+    uint32_t command[5];
+    uint32_t result[5];
+
+    command[0] = IAP_ERASE_SECTORS;
+    command[1] = start;
+    command[2] = end;
+    command[3] = cclkKHz;
+    return IAPCall(command, result);
+}
+
+/*
+ * The LPC2378's 504KB of user flash is eight 4KB sectors, then fourteen 32KB
+ * sectors, then six more 4KB sectors, 0 through 27. The 8KB boot block sits
+ * above sector 27, at 0x7E000, and isn't a sector IAP will touch.
+ */
+uint32_t IAPSectorOf(uint32_t address) {
+    if (address < 0x8000) {
+        return address / 0x1000;
+    }
+    else if (address < 0x78000) {
+        return 8 + (address - 0x8000) / 0x8000;
+    }
+    else {
+        return 22 + (address - 0x78000) / 0x1000;
+    }
+}
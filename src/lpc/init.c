@@ -401,7 +401,7 @@ static void initPCLK(void)
     (
           SET_PCLK (PCLK_WDT,     PDIV_4)
         | SET_PCLK (PCLK_TIMER0,  PDIV_1)
-        | SET_PCLK (PCLK_TIMER1,  PDIV_4)
+        | SET_PCLK (PCLK_TIMER1,  PDIV_1)
         | SET_PCLK (PCLK_UART0,   PDIV_1)
         | SET_PCLK (PCLK_UART1,   PDIV_1)
         | SET_PCLK (PCLK_PWM1,    PDIV_4)
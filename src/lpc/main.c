@@ -6,9 +6,12 @@
 
 #include "tk/critical_section.h"
 #include "tk/data.h"
+#include "tk/events.h"
 #include "tk/init.h"
+#include "tk/profile.h"
 #include "tk/tests.h"
 #include "tk/thread.h"
+#include "tk/timing.h"
 #include "tk/utility.h"
 
 struct ThreadData data;
@@ -21,6 +24,7 @@ int main(void) {
     TKStatus status;
 
     initHardware();
+    TKInitCycleCounter();
     TKRawPrintString("Hardware initialized!\n");
 
     RunTests();
@@ -28,6 +32,20 @@ int main(void) {
     TKInit();
     TKPrintString("Tiny Kernel initialized!\n");
 
+#ifdef TK_EVENT_TRACING
+    /* Report what led up to an outlier before the last reset, then watch for
+     * the next one.
+     */
+    TKDumpFlightRecord();
+    TKSetFlightTrigger(TK_FLIGHT_SCHEDULE, 100);
+    TKSetFlightTrigger(TK_FLIGHT_IRQ_LATENCY, 200);
+    TKSetFlightTrigger(TK_FLIGHT_WAKE_LATENCY, 5000);
+#endif
+
+#ifdef TK_PROFILING
+    TKStartProfiler(1000);
+#endif
+
     memset(&data, 0, sizeof(data));
     TKCreateSemaphore(&data.sem, 1);
     status = TKCreateThread("producer",
@@ -62,6 +80,16 @@ int main(void) {
         TKPrintString("Error creating idle thread\n");
     }
 
+#ifdef TK_BENCHMARK
+    status = TKCreateThread("benchmark",
+                            TK_PRIORITY_NORMAL,
+                            benchmark,
+                            NULL);
+    if (status != TK_OK) {
+        TKPrintString("Error creating benchmark thread\n");
+    }
+#endif
+
     TKStart();
 
     return 0;
@@ -2,6 +2,10 @@
 
 #include "lpc/threads.h"
 
+#include "tk/benchmarks.h"
+#include "tk/events.h"
+#include "tk/probe.h"
+#include "tk/profile.h"
 #include "tk/semaphore.h"
 #include "tk/utility.h"
 
@@ -18,9 +22,7 @@ void producer(void * p) {
             continue;
         }
         data->inc++;
-        TKPrintString("Producer incremented, now at ");
-        TKPrintDecimal(data->inc);
-        TKPrintString("\n");
+        TKPrintf("Producer incremented, now at %u\n", data->inc);
         TKUpSemaphore(&data->sem);
     }
 }
@@ -38,9 +40,7 @@ void consumer(void * p) {
             continue;
         }
         data->inc--;
-        TKPrintString("Consumer decremented, now at ");
-        TKPrintDecimal(data->inc);
-        TKPrintString("\n");
+        TKPrintf("Consumer decremented, now at %u\n", data->inc);
         TKUpSemaphore(&data->sem);
     }
 }
@@ -54,10 +54,17 @@ void monitor(void * p) {
         TKDownSemaphore(&data->sem);
         TKPrintString("Monitor running, no errors\n");
         TKPrintSchedulingMetrics();
+#ifdef TK_EVENT_TRACING
+        TKDumpEvents();
+#endif
+#ifdef TK_PROBES
+        TKDumpAllProbes(true);
+#endif
+#ifdef TK_PROFILING
+        TKDumpProfile(true);
+#endif
         if (data->inc > 1) {
-            TKPrintString("Monitor caught error, inc is at ");
-            TKPrintDecimal(data->inc);
-            TKPrintString("\n");
+            TKPrintf("Monitor caught error, inc is at %u\n", data->inc);
             TKFatal(NULL);
         }
         TKUpSemaphore(&data->sem);
@@ -72,3 +79,12 @@ void idle(void * p) {
         TKPrintString("Idle thread waking up\n");
     }
 }
+
+#ifdef TK_BENCHMARK
+void benchmark(void * p) {
+    for (;;) {
+        TKRunBenchmarks();
+        TKThreadSleep(10);
+    }
+}
+#endif
@@ -0,0 +1,152 @@
+/* DDF benchmarks. Only the DDF API and the cycle count are used, so the suite
+ * can be built anywhere those exist. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/benchmarks.h"
+#include "tk/common.h"
+#include "tk/ddf.h"
+#include "tk/timing.h"
+#include "tk/utility.h"
+
+#include "tk/drivers/loopback.h"
+#include "tk/drivers/null.h"
+#include "tk/drivers/zero.h"
+
+#define BENCHMARK_CALLS (1000)
+
+enum BenchmarkOp {
+    BENCHMARK_READ,
+    BENCHMARK_WRITE,
+    BENCHMARK_IOCTL,
+    /* A write, then a read of what was written. */
+    BENCHMARK_LOOPBACK
+};
+
+struct Benchmark {
+    const char * name;
+    uint32_t major;
+    uint32_t minor;
+    enum BenchmarkOp op;
+};
+
+static const struct Benchmark Benchmarks[] = {
+    { "null write", TK_NULL_MAJOR, TK_NULL_MINOR, BENCHMARK_WRITE },
+    { "null read", TK_NULL_MAJOR, TK_NULL_MINOR, BENCHMARK_READ },
+    { "null ioctl", TK_NULL_MAJOR, TK_NULL_MINOR, BENCHMARK_IOCTL },
+    { "zero read", TK_ZERO_MAJOR, TK_ZERO_MINOR, BENCHMARK_READ },
+    { "loopback", TK_LOOPBACK_MAJOR, TK_LOOPBACK_MINOR, BENCHMARK_LOOPBACK }
+};
+
+static const uint32_t Sizes[] = { 1, 16, 64, 256 };
+
+static uint8_t Buffer[256];
+
+static TKStatus Run(const struct Benchmark * benchmark,
+                    uint32_t size,
+                    uint64_t * elapsed,
+                    uint64_t * bytes) {
+    TKDriverHandle handle;
+    TKStatus status;
+    uint64_t start;
+    int n;
+    int i;
+
+    handle = TKDriverOpen(benchmark->major, benchmark->minor);
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    *bytes = 0;
+    status = TK_OK;
+    start = TKGetCycles();
+    for (i = 0; i < BENCHMARK_CALLS && status == TK_OK; i++) {
+        switch (benchmark->op) {
+            case BENCHMARK_READ:
+                n = TKDriverRead(handle, &status, Buffer, size);
+                break;
+            case BENCHMARK_WRITE:
+                n = TKDriverWrite(handle, &status, Buffer, size);
+                break;
+            case BENCHMARK_IOCTL:
+                status = TKDriverIoctl(handle, TK_NULL_IOCTL_NOP,
+                                       NULL, 0, NULL, 0);
+                n = 0;
+                break;
+            case BENCHMARK_LOOPBACK:
+                n = TKDriverWrite(handle, &status, Buffer, size);
+                if (status == TK_OK) {
+                    n += TKDriverRead(handle, &status, Buffer, n);
+                }
+                break;
+            default:
+                status = TK_UNSUPPORTED;
+                n = 0;
+                break;
+        }
+        *bytes += n;
+    }
+    *elapsed = TKGetCycles() - start;
+
+    TKDriverClose(handle);
+    return status;
+}
+
+static void Report(const struct Benchmark * benchmark,
+                   uint32_t size,
+                   TKStatus status,
+                   uint64_t elapsed,
+                   uint64_t bytes) {
+    char sizeBuffer[TK_DECIMAL_BUFFER_SIZE];
+    char callsBuffer[TK_DECIMAL_BUFFER_SIZE];
+    char bytesBuffer[TK_DECIMAL_BUFFER_SIZE];
+    char statusBuffer[TK_DECIMAL_BUFFER_SIZE];
+    uint64_t hz;
+
+    if (status != TK_OK) {
+        const char * message[] = {
+            benchmark->name, " failed with status ",
+            TKFormatDecimal(status, statusBuffer), "\n"
+        };
+        TKPrintStrings(message, ARRAYLEN(message));
+        return;
+    }
+
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    hz = TKGetCyclesHz();
+
+    const char * message[] = {
+        benchmark->name, " ", TKFormatDecimal(size, sizeBuffer), " B: ",
+        TKFormatDecimal(BENCHMARK_CALLS * hz / elapsed, callsBuffer),
+        " calls/s, ",
+        TKFormatDecimal(bytes * hz / elapsed, bytesBuffer), " B/s\n"
+    };
+    TKPrintStrings(message, ARRAYLEN(message));
+}
+
+void TKRunBenchmarks(void) {
+    const struct Benchmark * benchmark;
+    TKStatus status;
+    uint64_t elapsed;
+    uint64_t bytes;
+    int i;
+    int j;
+
+    for (i = 0; i < ARRAYLEN(Benchmarks); i++) {
+        benchmark = &Benchmarks[i];
+        for (j = 0; j < ARRAYLEN(Sizes); j++) {
+            /* Ioctls have no buffer to size. */
+            if (benchmark->op == BENCHMARK_IOCTL && j > 0) {
+                break;
+            }
+            status = Run(benchmark, Sizes[j], &elapsed, &bytes);
+            Report(benchmark, benchmark->op == BENCHMARK_IOCTL ? 0 : Sizes[j],
+                   status, elapsed, bytes);
+        }
+    }
+}
@@ -0,0 +1,307 @@
+/* Block layer. A small write-back cache in front of the DDF block ops. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tk/block.h"
+#include "tk/common.h"
+#include "tk/ddf.h"
+#include "tk/semaphore.h"
+
+struct CacheSlot {
+    /* NULL if the slot is empty. */
+    TKDriverHandle handle;
+    uint32_t block;
+    bool dirty;
+    uint32_t lastUse;
+};
+
+static struct CacheSlot Slots[TK_BLOCK_CACHE_SLOTS];
+static uint8_t SlotData[TK_BLOCK_CACHE_SLOTS][TK_BLOCK_SIZE];
+static uint32_t UseCount;
+
+/* Guards the cache. It is held across driver requests, so block I/O to all
+ * devices is serialized; the cache is too small for that to cost much.
+ */
+static struct TKSemaphore CacheSem;
+
+void TKInitBlockCache(void) {
+    int i;
+
+    for (i = 0; i < ARRAYLEN(Slots); i++) {
+        Slots[i].handle = NULL;
+        Slots[i].block = 0;
+        Slots[i].dirty = false;
+        Slots[i].lastUse = 0;
+    }
+    UseCount = 0;
+    TKCreateSemaphore(&CacheSem, 1);
+}
+
+static int FindSlot(TKDriverHandle handle, uint32_t block) {
+    int i;
+
+    for (i = 0; i < ARRAYLEN(Slots); i++) {
+        if (Slots[i].handle == handle && Slots[i].block == block) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void Touch(int slot) {
+    UseCount++;
+    Slots[slot].lastUse = UseCount;
+}
+
+/* Whether slots a and b = a + 1 can be written back in one request. */
+static bool Mergeable(int a, int b) {
+    return Slots[a].dirty &&
+           Slots[b].dirty &&
+           Slots[a].handle == Slots[b].handle &&
+           Slots[b].block == Slots[a].block + 1;
+}
+
+/* Write back a dirty slot. Slot data is contiguous, so neighbouring slots
+ * holding the blocks next to it go out in the same request.
+ */
+static TKStatus WriteBack(int slot) {
+    int first;
+    int last;
+    int i;
+    TKStatus status;
+
+    first = slot;
+    while (first > 0 && Mergeable(first - 1, first)) {
+        first--;
+    }
+    last = slot;
+    while (last < ARRAYLEN(Slots) - 1 && Mergeable(last, last + 1)) {
+        last++;
+    }
+
+    status = TKDriverWriteBlocks(Slots[slot].handle,
+                                 Slots[first].block,
+                                 last - first + 1,
+                                 SlotData[first]);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    for (i = first; i <= last; i++) {
+        Slots[i].dirty = false;
+    }
+
+    return TK_OK;
+}
+
+/* Free up a slot for reuse, preferring an empty one and otherwise taking the
+ * least recently used.
+ */
+static TKStatus GetSlot(int * slot) {
+    int victim;
+    int i;
+    TKStatus status;
+
+    victim = 0;
+    for (i = 0; i < ARRAYLEN(Slots); i++) {
+        if (Slots[i].handle == NULL) {
+            victim = i;
+            break;
+        }
+        if (Slots[i].lastUse < Slots[victim].lastUse) {
+            victim = i;
+        }
+    }
+
+    if (Slots[victim].handle != NULL && Slots[victim].dirty) {
+        status = WriteBack(victim);
+        if (status != TK_OK) {
+            return status;
+        }
+    }
+
+    Slots[victim].handle = NULL;
+    *slot = victim;
+
+    return TK_OK;
+}
+
+/* The length of the run of uncached blocks starting at block, up to count. */
+static uint32_t UncachedRun(TKDriverHandle handle,
+                            uint32_t block,
+                            uint32_t count) {
+    uint32_t run;
+
+    run = 1;
+    while (run < count && FindSlot(handle, block + run) < 0) {
+        run++;
+    }
+
+    return run;
+}
+
+static TKStatus Validate(TKDriverHandle handle,
+                         uint32_t block,
+                         uint32_t count,
+                         const void * buffer) {
+    uint32_t blockSize;
+    uint32_t blockCount;
+    TKStatus status;
+
+    if (buffer == NULL) {
+        return TK_NULL;
+    }
+
+    status = TKDriverBlockGeometry(handle, &blockSize, &blockCount);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    if (blockSize != TK_BLOCK_SIZE) {
+        return TK_BLOCK_BAD_SIZE;
+    }
+
+    if (block >= blockCount || count > blockCount - block) {
+        return TK_BLOCK_OUT_OF_RANGE;
+    }
+
+    return TK_OK;
+}
+
+TKStatus TKBlockRead(TKDriverHandle handle,
+                     uint32_t block,
+                     uint32_t count,
+                     uint8_t * buffer) {
+    int slot;
+    uint32_t i;
+    uint32_t run;
+    TKStatus status;
+
+    status = Validate(handle, block, count, buffer);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    TKDownSemaphore(&CacheSem);
+    i = 0;
+    while (i < count) {
+        slot = FindSlot(handle, block + i);
+        if (slot >= 0) {
+            memcpy(&buffer[i * TK_BLOCK_SIZE], SlotData[slot], TK_BLOCK_SIZE);
+            Touch(slot);
+            i++;
+            continue;
+        }
+
+        run = UncachedRun(handle, block + i, count - i);
+        if (run > 1) {
+            status = TKDriverReadBlocks(handle,
+                                        block + i,
+                                        run,
+                                        &buffer[i * TK_BLOCK_SIZE]);
+            if (status != TK_OK) {
+                break;
+            }
+            i += run;
+            continue;
+        }
+
+        status = GetSlot(&slot);
+        if (status != TK_OK) {
+            break;
+        }
+        status = TKDriverReadBlocks(handle, block + i, 1, SlotData[slot]);
+        if (status != TK_OK) {
+            break;
+        }
+        Slots[slot].handle = handle;
+        Slots[slot].block = block + i;
+        Slots[slot].dirty = false;
+        Touch(slot);
+        memcpy(&buffer[i * TK_BLOCK_SIZE], SlotData[slot], TK_BLOCK_SIZE);
+        i++;
+    }
+    TKUpSemaphore(&CacheSem);
+
+    return status;
+}
+
+TKStatus TKBlockWrite(TKDriverHandle handle,
+                      uint32_t block,
+                      uint32_t count,
+                      const uint8_t * buffer) {
+    int slot;
+    uint32_t i;
+    uint32_t run;
+    TKStatus status;
+
+    status = Validate(handle, block, count, buffer);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    TKDownSemaphore(&CacheSem);
+    i = 0;
+    while (i < count) {
+        slot = FindSlot(handle, block + i);
+        if (slot < 0) {
+            run = UncachedRun(handle, block + i, count - i);
+            if (run > 1) {
+                status = TKDriverWriteBlocks(handle,
+                                             block + i,
+                                             run,
+                                             &buffer[i * TK_BLOCK_SIZE]);
+                if (status != TK_OK) {
+                    break;
+                }
+                i += run;
+                continue;
+            }
+
+            status = GetSlot(&slot);
+            if (status != TK_OK) {
+                break;
+            }
+            Slots[slot].handle = handle;
+            Slots[slot].block = block + i;
+        }
+
+        memcpy(SlotData[slot], &buffer[i * TK_BLOCK_SIZE], TK_BLOCK_SIZE);
+        Slots[slot].dirty = true;
+        Touch(slot);
+        i++;
+    }
+    TKUpSemaphore(&CacheSem);
+
+    return status;
+}
+
+TKStatus TKBlockFlush(TKDriverHandle handle) {
+    int i;
+    TKStatus status;
+
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    status = TK_OK;
+    TKDownSemaphore(&CacheSem);
+    for (i = 0; i < ARRAYLEN(Slots); i++) {
+        if (Slots[i].handle == handle && Slots[i].dirty) {
+            status = WriteBack(i);
+            if (status != TK_OK) {
+                break;
+            }
+        }
+    }
+    TKUpSemaphore(&CacheSem);
+
+    if (status != TK_OK) {
+        return status;
+    }
+
+    return TKDriverFlush(handle);
+}
@@ -70,6 +70,52 @@ TKStatus TKEnterCriticalSection(struct TKCriticalSection * cs) {
     return _TKEnterCriticalSection(cs, CurrentThread);
 }
 
+TKStatus _TKEnterCriticalSectionTimeout(struct TKCriticalSection * cs,
+                                        struct TKThread * thread,
+                                        uint32_t timeout) {
+	uint32_t result;
+	TKTickCount start;
+
+	if (cs == NULL) {
+		return TK_UNEXPECTED;
+	}
+
+	if (thread == NULL) {
+		return TK_UNEXPECTED;
+	}
+
+	if (cs->thread == thread) {
+		cs->count++;
+		return TK_OK;
+	}
+
+	/* Same as _TKEnterCriticalSection, but give up once the timeout has
+	 * passed. A timeout of 0 makes this a single attempt.
+	 */
+	start = TickCount;
+	while (1) {
+		result = TKTrySet(&cs->lock, 1);
+		if (result == 0) {
+			break;
+		}
+		if (timeout != TK_WAIT_FOREVER &&
+		    (uint32_t) (TickCount - start) >= timeout) {
+			return TK_TIMEOUT;
+		}
+		TKYieldThread();
+	}
+
+	cs->thread = thread;
+	cs->count = 1;
+
+	return TK_OK;
+}
+
+TKStatus TKEnterCriticalSectionTimeout(struct TKCriticalSection * cs,
+                                       uint32_t timeout) {
+    return _TKEnterCriticalSectionTimeout(cs, CurrentThread, timeout);
+}
+
 TKStatus _TKLeaveCriticalSection(struct TKCriticalSection * cs,
                                  struct TKThread * thread) {
 	uint32_t result;
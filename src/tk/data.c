@@ -6,7 +6,7 @@
 #include "tk/thread.h"
 #include "tk/utility.h"
 
-static struct TKThread threads[16];
+static struct TKThread threads[TK_MAX_THREADS];
 
 void TKInitKernelData(void) {
     size_t i;
@@ -14,6 +14,7 @@ void TKInitKernelData(void) {
     FreeQueue.head = NULL;
     RunQueue.head = NULL;
     SleepQueue.head = NULL;
+    TimeoutList.head = NULL;
     for (i = 0; i < ARRAYLEN(threads); i++) {
         TKAddThread(&FreeQueue, &threads[i]);
     }
@@ -23,3 +24,7 @@ void TKInitKernelData(void) {
 
     TKInitTimer(TickHz);
 }
+
+struct TKThread * TKGetThread(uint32_t index) {
+    return &threads[index];
+}
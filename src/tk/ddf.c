@@ -1,179 +1,1150 @@
 #include <stddef.h>
+#include <string.h>
 
 #include "tk/common.h"
+#include "tk/data.h"
 #include "tk/ddf.h"
+#include "tk/events.h"
+#include "tk/probe.h"
+#include "tk/timing.h"
+#include "tk/utility.h"
 
-#include "tk/drivers/serial.h"
-#include "tk/drivers/test.h"
+/* Bounds of the .tk_drivers section, from the linker script. */
+extern const struct TKDriver __tk_drivers_start[];
+extern const struct TKDriver __tk_drivers_end[];
 
-static struct TKDriverEntry DriverTable[2];
+static struct TKDriverEntry DriverTable[TK_MAX_DEVICES];
+static uint32_t DriverCount;
 
-void TKInitDrivers(void) {
-    
-    int i;
+/* Index into DriverTable plus one for each major and minor, or 0 if no driver
+ * has that number.
+ */
+static uint8_t DriverLookup[TK_MAX_MAJOR][TK_MAX_MINOR];
+
+/* Threads blocked in TKDriverPoll, and a count of TKDriverNotifyPoll calls so
+ * a poller can tell whether it missed one. Only touched with interrupts
+ * disabled.
+ */
+static struct TKThreadQueue PollWaiters;
+static uint32_t PollNotifications;
+
+/* Whole DDF calls, including waits for locks. */
+TK_PROBE_DEFINE(DdfRead);
+TK_PROBE_DEFINE(DdfWrite);
+TK_PROBE_DEFINE(DdfIoctl);
+/* Just the driver ops. */
+TK_PROBE_DEFINE(DriverRead);
+TK_PROBE_DEFINE(DriverWrite);
+TK_PROBE_DEFINE(DriverIoctl);
 
-    /* Why don't we statically initialize this at the top of the file? Because
-     * of the strange bug with compiler-initialized structs not getting
-     * initialized if they're global. I'd really like to solve this one when I
-     * get more time.
+/* The kinds of access an operation needs. */
+enum LockType {
+    LOCK_READ,
+    LOCK_WRITE,
+    LOCK_CONTROL
+};
+
+/* Ticks left of a timeout that started at the given tick. */
+static uint32_t Remaining(TKTickCount start, uint32_t timeout) {
+    uint32_t elapsed;
+
+    if (timeout == TK_WAIT_FOREVER) {
+        return TK_WAIT_FOREVER;
+    }
+
+    elapsed = TickCount - start;
+    return elapsed >= timeout ? 0 : timeout - elapsed;
+}
+
+/* Take whichever locks the driver's concurrency model requires for an
+ * operation, waiting at most timeout ticks in total. Control operations under
+ * TK_CONCURRENCY_PER_DIRECTION take the read lock before the write lock;
+ * Unlock releases in reverse order. On TK_TIMEOUT nothing is left held.
+ */
+static TKStatus Lock(struct TKDriverEntry * entry,
+                     enum LockType type,
+                     uint32_t timeout) {
+    TKTickCount start;
+    TKStatus status;
+
+    start = TickCount;
+    status = TK_OK;
+    switch (entry->driver->concurrency) {
+    case TK_CONCURRENCY_SERIALIZED:
+        status = TKDownSemaphoreTimeout(&entry->sem, timeout);
+        break;
+    case TK_CONCURRENCY_PER_DIRECTION:
+        if (type != LOCK_WRITE) {
+            status = TKDownSemaphoreTimeout(&entry->sem, timeout);
+            if (status != TK_OK) {
+                break;
+            }
+        }
+        if (type != LOCK_READ) {
+            status = TKDownSemaphoreTimeout(&entry->writeSem,
+                                            Remaining(start, timeout));
+            if (status != TK_OK && type != LOCK_WRITE) {
+                TKUpSemaphore(&entry->sem);
+            }
+        }
+        break;
+    case TK_CONCURRENCY_NONE:
+        break;
+    }
+
+    return status;
+}
+
+static void Unlock(struct TKDriverEntry * entry, enum LockType type) {
+    /* Every operation on the device ends here, so this is when it was last
+     * used, for autosuspend.
      */
-    DriverTable[0].driver = &TKTestDriver;
-    DriverTable[1].driver = &TKSerialDriver;
-    TKSerialDriver.ops.init = TKSerialDriverInit;
-    TKTestDriver.ops.init = TKTestDriverInit;
+    entry->lastUse = TickCount;
+
+    switch (entry->driver->concurrency) {
+    case TK_CONCURRENCY_SERIALIZED:
+        TKUpSemaphore(&entry->sem);
+        break;
+    case TK_CONCURRENCY_PER_DIRECTION:
+        if (type != LOCK_READ) {
+            TKUpSemaphore(&entry->writeSem);
+        }
+        if (type != LOCK_WRITE) {
+            TKUpSemaphore(&entry->sem);
+        }
+        break;
+    case TK_CONCURRENCY_NONE:
+        break;
+    }
+}
+
+static enum LockType LoanLockType(enum TKBufferDirection direction) {
+    return direction == TK_BUFFER_READ ? LOCK_READ : LOCK_WRITE;
+}
 
-    for (i = 0; i < ARRAYLEN(DriverTable); i++) {
-        DriverTable[i].driver->ops.init();
-        DriverTable[i].used = false;
-        TKCreateSemaphore(&DriverTable[i].sem, 1);
+/* What an operation counts as in its device's stats. This is in the same order
+ * as TKEventDriverOp, so it doubles as the detail of driver events.
+ */
+enum StatsOp {
+    STATS_READ,
+    STATS_WRITE,
+    STATS_IOCTL,
+    STATS_POWER
+};
+
+/* When an operation started, and when it got and gave up the driver lock, if
+ * it did.
+ */
+struct OpTimes {
+    uint64_t start;
+    uint64_t locked;
+    uint64_t done;
+    bool held;
+};
+
+/* The name of a device in events. */
+#define DEVICE_OBJECT(entry) ((entry)->driver->major << 8 | (entry)->minor)
+
+static void StartTimes(struct TKDriverEntry * entry,
+                       enum StatsOp op,
+                       struct OpTimes * times) {
+    TK_EVENT(TK_EVENT_DRIVER_ENTER, op, DEVICE_OBJECT(entry));
+    times->start = TKGetCycles();
+    times->held = false;
+}
+
+static void Locked(struct OpTimes * times) {
+    times->locked = TKGetCycles();
+    times->held = true;
+}
+
+/* Call before giving up the lock, so the service time doesn't include time
+ * spent in threads that the unlock wakes.
+ */
+static void Serviced(struct OpTimes * times) {
+    times->done = TKGetCycles();
+}
+
+static void AddTiming(struct TKDriverTiming * timing, uint64_t delta) {
+    timing->total += delta;
+    if (delta > 0xFFFFFFFF) {
+        delta = 0xFFFFFFFF;
+    }
+    if (delta > timing->max) {
+        timing->max = (uint32_t) delta;
     }
 }
 
-TKDriverHandle TKDriverOpen(uint32_t major, uint32_t minor) {
-    struct TKDriverEntry * entry;
+static void CountError(struct TKDriverStats * stats, TKStatus status) {
     int i;
 
-    for (i = 0; i < ARRAYLEN(DriverTable); i++) {
-        entry = &DriverTable[i];
-        if (entry->driver->major != major) {
-            continue;
+    stats->errors++;
+    for (i = 0; i < TK_DRIVER_STATS_ERROR_KINDS; i++) {
+        if (stats->errorCount[i] == 0) {
+            stats->errorStatus[i] = status;
         }
-        if (entry->driver->minor != minor) {
-            continue;
+        if (stats->errorStatus[i] == status) {
+            if (stats->errorCount[i] != 0xFFFF) {
+                stats->errorCount[i]++;
+            }
+            return;
         }
+    }
+}
+
+/* Count count operations of one kind in a device's stats, and how long they
+ * took. Interrupts are disabled for the update, since operations in different
+ * directions may finish at once and the stats ioctl copies the stats as a
+ * whole.
+ */
+static void Account(struct TKDriverEntry * entry,
+                    enum StatsOp op,
+                    uint32_t count,
+                    TKStatus status,
+                    int bytes,
+                    const struct OpTimes * times) {
+    struct TKDriverStats * stats;
+    uint32_t cpsr;
+
+    stats = &entry->stats;
+
+    cpsr = TKDisableInterrupts();
+    switch (op) {
+    case STATS_READ:
+        stats->reads += count;
+        if (bytes > 0) {
+            stats->bytesRead += bytes;
+        }
+        break;
+    case STATS_WRITE:
+        stats->writes += count;
+        if (bytes > 0) {
+            stats->bytesWritten += bytes;
+        }
+        break;
+    case STATS_IOCTL:
+        stats->ioctls += count;
+        break;
+    case STATS_POWER:
+        stats->powerOps += count;
         break;
     }
-    if (i == ARRAYLEN(DriverTable)) {
+    if (status != TK_OK) {
+        CountError(stats, status);
+    }
+    if (times->held) {
+        AddTiming(&stats->lockWait, times->locked - times->start);
+        AddTiming(&stats->service, times->done - times->locked);
+    }
+    TKEnableInterrupts(cpsr);
+
+    TK_EVENT(TK_EVENT_DRIVER_EXIT, op, DEVICE_OBJECT(entry));
+}
+
+/* Count the time a device spent suspended, as it leaves that state. */
+static void CountSuspended(struct TKDriverEntry * entry) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    entry->stats.suspendedTicks += TickCount - entry->suspendedAt;
+    TKEnableInterrupts(cpsr);
+}
+
+/* Power a suspended device back up and count the resume. Call with the
+ * control lock held.
+ */
+static TKStatus ResumeLocked(struct TKDriverEntry * entry) {
+    uint64_t start;
+    uint64_t now;
+    uint32_t cpsr;
+    TKStatus status;
+
+    start = TKGetCycles();
+    status = entry->driver->ops->powerUp(entry->context);
+    now = TKGetCycles();
+    if (status == TK_OK) {
+        entry->powerstate = TK_POWER_ON;
+        CountSuspended(entry);
+
+        cpsr = TKDisableInterrupts();
+        entry->stats.resumes++;
+        AddTiming(&entry->stats.resume, now - start);
+        TKEnableInterrupts(cpsr);
+    }
+
+    return status;
+}
+
+/* Power a suspended device back up, waiting at most timeout ticks for the
+ * lock.
+ */
+static TKStatus Resume(struct TKDriverEntry * entry, uint32_t timeout) {
+    TKStatus status;
+
+    status = Lock(entry, LOCK_CONTROL, timeout);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    if (entry->powerstate == TK_POWER_SUSPENDED) {
+        status = ResumeLocked(entry);
+    }
+
+    Unlock(entry, LOCK_CONTROL);
+    return status;
+}
+
+/* Lock for an operation that needs the device powered, resuming it first if
+ * it is suspended. The device can be suspended while we wait for the lock, so
+ * the state is checked once the lock is held. Autosuspend never waits for the
+ * lock, so it can't suspend the device again while we hold it.
+ */
+static TKStatus LockAwake(struct TKDriverEntry * entry,
+                          enum LockType type,
+                          uint32_t timeout) {
+    TKTickCount start;
+    TKStatus status;
+
+    start = TickCount;
+    for (;;) {
+        status = Lock(entry, type, Remaining(start, timeout));
+        if (status != TK_OK || entry->powerstate != TK_POWER_SUSPENDED) {
+            return status;
+        }
+
+        Unlock(entry, type);
+        status = Resume(entry, Remaining(start, timeout));
+        if (status != TK_OK) {
+            return status;
+        }
+    }
+}
+
+static bool CanAutosuspend(const struct TKDriver * driver) {
+    return driver->concurrency != TK_CONCURRENCY_NONE &&
+           driver->ops->powerUp != NULL &&
+           driver->ops->powerDown != NULL;
+}
+
+void TKInitDrivers(void) {
+    const struct TKDriver * driver;
+    struct TKDriverEntry * entry;
+    uint32_t minor;
+    uint32_t i;
+
+    memset(DriverLookup, 0, sizeof(DriverLookup));
+    DriverCount = 0;
+    PollWaiters.head = NULL;
+    PollNotifications = 0;
+
+    for (driver = __tk_drivers_start; driver < __tk_drivers_end; driver++) {
+        for (i = 0; i < driver->minorCount; i++) {
+            minor = driver->minor + i;
+            if (DriverCount == ARRAYLEN(DriverTable)) {
+                TKFatal("too many devices; raise TK_MAX_DEVICES");
+            }
+            if (driver->major >= TK_MAX_MAJOR || minor >= TK_MAX_MINOR) {
+                TKFatal("driver number out of range");
+            }
+            if (DriverLookup[driver->major][minor] != 0) {
+                TKFatal("two drivers have the same major and minor number");
+            }
+            if (driver->autosuspendDelay != 0 && !CanAutosuspend(driver)) {
+                TKFatal("autosuspend needs power ops and DDF locking");
+            }
+
+            entry = &DriverTable[DriverCount];
+            entry->driver = driver;
+            entry->context = NULL;
+            if (driver->contexts != NULL) {
+                entry->context = (uint8_t *) driver->contexts +
+                                 i * driver->contextSize;
+            }
+            entry->powerstate = TK_POWER_ON;
+            entry->used = false;
+            entry->minor = minor;
+            entry->loaned[TK_BUFFER_READ] = false;
+            entry->loaned[TK_BUFFER_WRITE] = false;
+            entry->loanOwner[TK_BUFFER_READ] = NULL;
+            entry->loanOwner[TK_BUFFER_WRITE] = NULL;
+            TKCreateSemaphore(&entry->sem, 1);
+            TKCreateSemaphore(&entry->writeSem, 1);
+            entry->autosuspendDelay = driver->autosuspendDelay;
+            entry->lastUse = TickCount;
+            entry->suspendedAt = 0;
+            memset(&entry->stats, 0, sizeof(entry->stats));
+
+            DriverCount++;
+            DriverLookup[driver->major][minor] = DriverCount;
+
+            if (driver->ops->init != NULL) {
+                driver->ops->init(entry->context);
+            }
+        }
+    }
+}
+
+const char * TKDriverName(uint32_t major, uint32_t minor) {
+    uint8_t index;
+
+    if (major >= TK_MAX_MAJOR || minor >= TK_MAX_MINOR) {
         return NULL;
     }
 
+    index = DriverLookup[major][minor];
+    if (index == 0) {
+        return NULL;
+    }
+
+    return DriverTable[index - 1].driver->name;
+}
+
+TKDriverHandle TKDriverOpen(uint32_t major, uint32_t minor) {
+    struct TKDriverEntry * entry;
+    uint8_t index;
+
+    if (major >= TK_MAX_MAJOR || minor >= TK_MAX_MINOR) {
+        return NULL;
+    }
+
+    index = DriverLookup[major][minor];
+    if (index == 0) {
+        return NULL;
+    }
+    entry = &DriverTable[index - 1];
+
     if (entry->used) {
         return NULL;
     }
 
-    entry->driver->ops.open();
+    entry->driver->ops->open(entry->context);
+    entry->lastUse = TickCount;
     entry->used = true;
 
     return entry;
 }
 
 TKStatus TKDriverClose(TKDriverHandle handle) {
-    int i;
-    struct TKDriverEntry * entry;
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    if (handle < &DriverTable[0] || handle >= &DriverTable[DriverCount]) {
+        /* Not one of our entries; bad handle. */
+        return TK_UNEXPECTED;
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->loaned[TK_BUFFER_READ] || handle->loaned[TK_BUFFER_WRITE]) {
+        return TK_BUSY;
+    }
+
+    Lock(handle, LOCK_CONTROL, TK_WAIT_FOREVER);
+    handle->driver->ops->close(handle->context);
+    Unlock(handle, LOCK_CONTROL);
+
+    handle->used = false;
+
+    return TK_OK;
+}
+
+int TKDriverRead(TKDriverHandle handle,
+                 TKStatus * status,
+                 uint8_t * buffer,
+                 uint32_t size) {
+    return TKDriverReadTimeout(handle, status, buffer, size, TK_WAIT_FOREVER);
+}
+
+static int Read(TKDriverHandle handle,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size,
+                uint32_t timeout,
+                struct OpTimes * times) {
+    TKTickCount start;
+    int ret;
+
+    if (buffer == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    if (!handle->used) {
+        *status = TK_CLOSED;
+        return -1;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        *status = TK_NO_POWER;
+        return -1;
+    }
+
+    if (handle->driver->ops->read == NULL) {
+        *status = TK_UNSUPPORTED;
+        return -1;
+    }
+
+    start = TickCount;
+    *status = LockAwake(handle, LOCK_READ, timeout);
+    if (*status != TK_OK) {
+        return -1;
+    }
+    Locked(times);
+    TKSetTimeout(Remaining(start, timeout));
+    TK_PROBE_START(DriverRead);
+    ret = handle->driver->ops->read(handle->context, status, buffer, size);
+    TK_PROBE_STOP(DriverRead);
+    TKSetTimeout(TK_WAIT_FOREVER);
+    Serviced(times);
+    Unlock(handle, LOCK_READ);
+
+    return ret;
+}
+
+int TKDriverReadTimeout(TKDriverHandle handle,
+                        TKStatus * status,
+                        uint8_t * buffer,
+                        uint32_t size,
+                        uint32_t timeout) {
+    struct OpTimes times;
+    int ret;
+
+    if (status == NULL) {
+        return -1;
+    }
+    if (handle == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    TK_PROBE_START(DdfRead);
+    StartTimes(handle, STATS_READ, &times);
+    ret = Read(handle, status, buffer, size, timeout, &times);
+    Account(handle, STATS_READ, 1, *status, ret, &times);
+    TK_PROBE_STOP(DdfRead);
+
+    return ret;
+}
+
+int TKDriverWrite(TKDriverHandle handle,
+                  TKStatus * status,
+                  const uint8_t * buffer,
+                  uint32_t size) {
+    return TKDriverWriteTimeout(handle, status, buffer, size, TK_WAIT_FOREVER);
+}
+
+static int Write(TKDriverHandle handle,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size,
+                 uint32_t timeout,
+                 struct OpTimes * times) {
+    TKTickCount start;
+    int ret;
+
+    if (buffer == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    if (!handle->used) {
+        *status = TK_CLOSED;
+        return -1;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        *status = TK_NO_POWER;
+        return -1;
+    }
+
+    if (handle->driver->ops->write == NULL) {
+        *status = TK_UNSUPPORTED;
+        return -1;
+    }
+
+    start = TickCount;
+    *status = LockAwake(handle, LOCK_WRITE, timeout);
+    if (*status != TK_OK) {
+        return -1;
+    }
+    Locked(times);
+    TKSetTimeout(Remaining(start, timeout));
+    TK_PROBE_START(DriverWrite);
+    ret = handle->driver->ops->write(handle->context, status, buffer, size);
+    TK_PROBE_STOP(DriverWrite);
+    TKSetTimeout(TK_WAIT_FOREVER);
+    Serviced(times);
+    Unlock(handle, LOCK_WRITE);
+
+    return ret;
+}
+
+int TKDriverWriteTimeout(TKDriverHandle handle,
+                         TKStatus * status,
+                         const uint8_t * buffer,
+                         uint32_t size,
+                         uint32_t timeout) {
+    struct OpTimes times;
+    int ret;
+
+    if (status == NULL) {
+        return -1;
+    }
+    if (handle == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    TK_PROBE_START(DdfWrite);
+    StartTimes(handle, STATS_WRITE, &times);
+    ret = Write(handle, status, buffer, size, timeout, &times);
+    Account(handle, STATS_WRITE, 1, *status, ret, &times);
+    TK_PROBE_STOP(DdfWrite);
+
+    return ret;
+}
+
+/* Validate the common parameters of a vectored operation. Returns TK_OK if the
+ * operation may proceed.
+ */
+static TKStatus ValidateVector(TKDriverHandle handle,
+                               const struct TKIoVec * vec,
+                               uint32_t count) {
+    uint32_t i;
+
+    if (handle == NULL || vec == NULL) {
+        return TK_NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (vec[i].buffer == NULL) {
+            return TK_NULL;
+        }
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
+    }
+
+    return TK_OK;
+}
+
+static int Readv(TKDriverHandle handle,
+                 TKStatus * status,
+                 const struct TKIoVec * vec,
+                 uint32_t count,
+                 struct OpTimes * times) {
+    uint32_t i;
+    int ret;
+    int total;
+
+    *status = ValidateVector(handle, vec, count);
+    if (*status != TK_OK) {
+        return -1;
+    }
+
+    if (handle->driver->ops->readv == NULL &&
+        handle->driver->ops->read == NULL) {
+        *status = TK_UNSUPPORTED;
+        return -1;
+    }
+
+    *status = LockAwake(handle, LOCK_READ, TK_WAIT_FOREVER);
+    if (*status != TK_OK) {
+        return -1;
+    }
+    Locked(times);
+    if (handle->driver->ops->readv != NULL) {
+        total = handle->driver->ops->readv(handle->context,
+                                           status,
+                                           vec,
+                                           count);
+    }
+    else {
+        /* The driver has no vectored read, so do it one segment at a time. We
+         * still hold the lock across all segments, so the transfer is not
+         * interleaved with other threads.
+         */
+        total = 0;
+        for (i = 0; i < count; i++) {
+            ret = handle->driver->ops->read(handle->context,
+                                            status,
+                                            vec[i].buffer,
+                                            vec[i].size);
+            if (ret < 0) {
+                total = -1;
+                break;
+            }
+            total += ret;
+            if (ret < vec[i].size) {
+                break;
+            }
+        }
+    }
+    Serviced(times);
+    Unlock(handle, LOCK_READ);
+
+    return total;
+}
+
+int TKDriverReadv(TKDriverHandle handle,
+                  TKStatus * status,
+                  const struct TKIoVec * vec,
+                  uint32_t count) {
+    struct OpTimes times;
+    int ret;
+
+    if (status == NULL) {
+        return -1;
+    }
+    if (handle == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    StartTimes(handle, STATS_READ, &times);
+    ret = Readv(handle, status, vec, count, &times);
+    Account(handle, STATS_READ, 1, *status, ret, &times);
+
+    return ret;
+}
+
+static int Writev(TKDriverHandle handle,
+                  TKStatus * status,
+                  const struct TKIoVec * vec,
+                  uint32_t count,
+                  bool raw,
+                  struct OpTimes * times) {
+    uint32_t i;
+    int ret;
+    int total;
+
+    *status = ValidateVector(handle, vec, count);
+    if (*status != TK_OK) {
+        return -1;
+    }
+
+    if (handle->driver->ops->writev == NULL &&
+        handle->driver->ops->write == NULL) {
+        *status = TK_UNSUPPORTED;
+        return -1;
+    }
+
+    *status = LockAwake(handle, LOCK_WRITE, TK_WAIT_FOREVER);
+    if (*status != TK_OK) {
+        return -1;
+    }
+    Locked(times);
+    if (raw && handle->driver->ops->writeRawv != NULL) {
+        total = handle->driver->ops->writeRawv(handle->context,
+                                               status,
+                                               vec,
+                                               count);
+    }
+    else if (handle->driver->ops->writev != NULL) {
+        total = handle->driver->ops->writev(handle->context,
+                                            status,
+                                            vec,
+                                            count);
+    }
+    else {
+        /* See the comment in TKDriverReadv. */
+        total = 0;
+        for (i = 0; i < count; i++) {
+            ret = handle->driver->ops->write(handle->context, status,
+                                            vec[i].buffer,
+                                            vec[i].size);
+            if (ret < 0) {
+                total = -1;
+                break;
+            }
+            total += ret;
+            if (ret < vec[i].size) {
+                break;
+            }
+        }
+    }
+    Serviced(times);
+    Unlock(handle, LOCK_WRITE);
+
+    return total;
+}
+
+int TKDriverWritev(TKDriverHandle handle,
+                   TKStatus * status,
+                   const struct TKIoVec * vec,
+                   uint32_t count) {
+    struct OpTimes times;
+    int ret;
+
+    if (status == NULL) {
+        return -1;
+    }
+    if (handle == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    StartTimes(handle, STATS_WRITE, &times);
+    ret = Writev(handle, status, vec, count, false, &times);
+    Account(handle, STATS_WRITE, 1, *status, ret, &times);
+
+    return ret;
+}
+
+int TKDriverWriteRawv(TKDriverHandle handle,
+                      TKStatus * status,
+                      const struct TKIoVec * vec,
+                      uint32_t count) {
+    struct OpTimes times;
+    int ret;
 
+    if (status == NULL) {
+        return -1;
+    }
     if (handle == NULL) {
+        *status = TK_NULL;
+        return -1;
+    }
+
+    StartTimes(handle, STATS_WRITE, &times);
+    ret = Writev(handle, status, vec, count, true, &times);
+    Account(handle, STATS_WRITE, 1, *status, ret, &times);
+
+    return ret;
+}
+
+/* Validate a block transfer. Returns TK_OK if it may proceed. */
+static TKStatus ValidateBlocks(TKDriverHandle handle,
+                               uint32_t block,
+                               uint32_t count,
+                               const void * buffer) {
+    uint32_t blockSize;
+    uint32_t blockCount;
+    TKStatus status;
+
+    if (handle == NULL || buffer == NULL) {
+        return TK_NULL;
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
+    }
+
+    if (handle->driver->ops->geometry == NULL ||
+        handle->driver->ops->readBlocks == NULL ||
+        handle->driver->ops->writeBlocks == NULL) {
+        return TK_UNSUPPORTED;
+    }
+
+    status = handle->driver->ops->geometry(handle->context,
+                                           &blockSize,
+                                           &blockCount);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    /* Written so that it can't overflow. */
+    if (block >= blockCount || count > blockCount - block) {
+        return TK_BLOCK_OUT_OF_RANGE;
+    }
+
+    return TK_OK;
+}
+
+TKStatus TKDriverBlockGeometry(TKDriverHandle handle,
+                               uint32_t * blockSize,
+                               uint32_t * blockCount) {
+    if (handle == NULL || blockSize == NULL || blockCount == NULL) {
+        return TK_NULL;
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->driver->ops->geometry == NULL) {
+        return TK_UNSUPPORTED;
+    }
+
+    return handle->driver->ops->geometry(handle->context,
+                                         blockSize,
+                                         blockCount);
+}
+
+TKStatus TKDriverReadBlocks(TKDriverHandle handle,
+                            uint32_t block,
+                            uint32_t count,
+                            uint8_t * buffer) {
+    TKStatus status;
+
+    status = ValidateBlocks(handle, block, count, buffer);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    status = LockAwake(handle, LOCK_READ, TK_WAIT_FOREVER);
+    if (status != TK_OK) {
+        return status;
+    }
+    status = handle->driver->ops->readBlocks(handle->context,
+                                             block,
+                                             count,
+                                             buffer);
+    Unlock(handle, LOCK_READ);
+
+    return status;
+}
+
+TKStatus TKDriverWriteBlocks(TKDriverHandle handle,
+                             uint32_t block,
+                             uint32_t count,
+                             const uint8_t * buffer) {
+    TKStatus status;
+
+    status = ValidateBlocks(handle, block, count, buffer);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    status = LockAwake(handle, LOCK_WRITE, TK_WAIT_FOREVER);
+    if (status != TK_OK) {
+        return status;
+    }
+    status = handle->driver->ops->writeBlocks(handle->context,
+                                              block,
+                                              count,
+                                              buffer);
+    Unlock(handle, LOCK_WRITE);
+
+    return status;
+}
+
+TKStatus TKDriverFlush(TKDriverHandle handle) {
+    TKStatus status;
+
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
+    }
+
+    /* Devices without a write cache of their own have nothing to flush. */
+    if (handle->driver->ops->flush == NULL) {
+        return TK_OK;
+    }
+
+    status = LockAwake(handle, LOCK_CONTROL, TK_WAIT_FOREVER);
+    if (status != TK_OK) {
+        return status;
+    }
+    status = handle->driver->ops->flush(handle->context);
+    Unlock(handle, LOCK_CONTROL);
+
+    return status;
+}
+
+/* The loan arrays are indexed by direction, so it must be checked first. */
+static bool ValidDirection(enum TKBufferDirection direction) {
+    return direction == TK_BUFFER_READ || direction == TK_BUFFER_WRITE;
+}
+
+TKStatus TKDriverAcquireBuffer(TKDriverHandle handle,
+                               enum TKBufferDirection direction,
+                               uint8_t ** buffer,
+                               uint32_t * size) {
+    uint8_t * loan;
+    TKStatus status;
+
+    if (handle == NULL || buffer == NULL || size == NULL) {
         return TK_NULL;
     }
 
+    if (!ValidDirection(direction)) {
+        return TK_UNSUPPORTED;
+    }
+
     if (!handle->used) {
         return TK_CLOSED;
     }
 
-    for (i = 0; i < ARRAYLEN(DriverTable); i++) {
-        entry = &DriverTable[i];
-        if (entry->driver == handle->driver) {
-            break;
-        }
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
     }
-    if (i == ARRAYLEN(DriverTable)) {
-        /* Driver not found in table; bad handle. */
-        return TK_UNEXPECTED;
+
+    if (handle->driver->ops->acquireBuffer == NULL ||
+        handle->driver->ops->commitBuffer == NULL) {
+        return TK_BUFFERS_UNSUPPORTED;
     }
 
-    TKDownSemaphore(&handle->sem);
-    handle->driver->ops.close();
-    TKUpSemaphore(&handle->sem);
+    /* Another thread's loan is simply waited out below, but taking the lock
+     * again from the thread that holds the loan would deadlock.
+     */
+    if (handle->loaned[direction] &&
+        handle->loanOwner[direction] == CurrentThread) {
+        return TK_BUFFER_ALREADY_ACQUIRED;
+    }
+
+    status = LockAwake(handle, LoanLockType(direction), TK_WAIT_FOREVER);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    /* Only possible when the DDF takes no lock for this driver. */
+    if (handle->loaned[direction]) {
+        Unlock(handle, LoanLockType(direction));
+        return TK_BUSY;
+    }
+
+    status = TK_OK;
+    loan = handle->driver->ops->acquireBuffer(handle->context,
+                                              &status,
+                                              direction,
+                                              size);
+    if (loan == NULL || status != TK_OK) {
+        Unlock(handle, LoanLockType(direction));
+        return status == TK_OK ? TK_UNEXPECTED : status;
+    }
 
-    entry->used = false;
+    handle->loaned[direction] = true;
+    handle->loanOwner[direction] = CurrentThread;
+    handle->loanSize[direction] = *size;
+    *buffer = loan;
 
     return TK_OK;
 }
 
-int TKDriverRead(TKDriverHandle handle,
-                 TKStatus * status,
-                 uint8_t * buffer,
-                 uint32_t size) {
-    int ret;
+TKStatus TKDriverCommitBuffer(TKDriverHandle handle,
+                              enum TKBufferDirection direction,
+                              uint32_t size) {
+    TKStatus status;
 
-    if (status == NULL) {
-        return -1;
+    if (handle == NULL) {
+        return TK_NULL;
     }
-    if (handle == NULL || buffer == NULL) {
-        *status = TK_NULL;
-        return -1;
+
+    if (!ValidDirection(direction)) {
+        return TK_UNSUPPORTED;
     }
 
     if (!handle->used) {
-        *status = TK_CLOSED;
-        return -1;
+        return TK_CLOSED;
     }
 
-    if (handle->driver->powerstate == TK_POWER_OFF) {
-        *status = TK_NO_POWER;
-        return -1;
+    if (!handle->loaned[direction] ||
+        handle->loanOwner[direction] != CurrentThread) {
+        return TK_BUFFER_NOT_ACQUIRED;
+    }
+
+    /* The loan stays outstanding, so the caller can retry with a valid size. */
+    if (size > handle->loanSize[direction]) {
+        return TK_BUFFER_BAD_SIZE;
     }
 
-    TKDownSemaphore(&handle->sem);
-    ret = handle->driver->ops.read(status, buffer, size);
-    TKUpSemaphore(&handle->sem);
+    status = handle->driver->ops->commitBuffer(handle->context,
+                                               direction,
+                                               size);
 
-    return ret;
+    handle->loaned[direction] = false;
+    handle->loanOwner[direction] = NULL;
+    Unlock(handle, LoanLockType(direction));
+
+    return status;
 }
 
-int TKDriverWrite(TKDriverHandle handle,
-                  TKStatus * status,
-                  const uint8_t * buffer,
-                  uint32_t size) {
-    int ret;
+/* DDF ioctls. Their op is unused; RunIoctl serves them. */
+static const struct TKIoctlInfo DdfIoctlStats = {
+    .type = TK_IOCTL_OUT,
+    .inSize = 0,
+    .outSize = sizeof(struct TKDriverStats),
+    .op = NULL
+};
 
-    if (status == NULL) {
-        return -1;
-    }
-    if (handle == NULL || buffer == NULL) {
-        *status = TK_NULL;
-        return -1;
-    }
+static const struct TKIoctlInfo DdfIoctlStatsReset = {
+    .type = TK_IOCTL_NONE,
+    .inSize = 0,
+    .outSize = 0,
+    .op = NULL
+};
 
-    if (!handle->used) {
-        *status = TK_CLOSED;
-        return -1;
+static const struct TKIoctlInfo * LookupIoctl(TKDriverHandle handle,
+                                              uint32_t code) {
+    if (code < TK_DDF_IOCTL_BASE) {
+        return handle->driver->ops->ioctlInfo(code);
     }
 
-    if (handle->driver->powerstate == TK_POWER_OFF) {
-        *status = TK_NO_POWER;
-        return -1;
+    switch (code) {
+    case TK_DDF_IOCTL_STATS:
+        return &DdfIoctlStats;
+    case TK_DDF_IOCTL_STATS_RESET:
+        return &DdfIoctlStatsReset;
+    default:
+        return NULL;
     }
-
-    TKDownSemaphore(&handle->sem);
-    ret = handle->driver->ops.write(status, buffer, size);
-    TKUpSemaphore(&handle->sem);
-
-    return ret;
 }
 
-TKStatus TKDriverIoctl(TKDriverHandle handle,
-                       uint32_t code,
-                       const void * inBuf,
-                       uint32_t inSize,
-                       void * outBuf,
-                       uint32_t outSize) {
-    struct TKIoctlInfo * ioctlInfo;
+/* Run an ioctl that has passed ValidateIoctl. */
+static TKStatus RunIoctl(TKDriverHandle handle,
+                         const struct TKIoctlInfo * ioctlInfo,
+                         uint32_t code,
+                         const void * inBuf,
+                         void * outBuf) {
+    uint32_t cpsr;
     TKStatus status;
 
-    if (handle == NULL) {
-        return TK_NULL;
+    if (code < TK_DDF_IOCTL_BASE) {
+        TK_PROBE_START(DriverIoctl);
+        status = ioctlInfo->op(handle->context, inBuf, outBuf);
+        TK_PROBE_STOP(DriverIoctl);
+        return status;
     }
 
-    if (!handle->used) {
-        return TK_CLOSED;
+    /* See Account. */
+    cpsr = TKDisableInterrupts();
+    switch (code) {
+    case TK_DDF_IOCTL_STATS:
+        memcpy(outBuf, &handle->stats, sizeof(handle->stats));
+        break;
+    case TK_DDF_IOCTL_STATS_RESET:
+        memset(&handle->stats, 0, sizeof(handle->stats));
+        break;
     }
+    TKEnableInterrupts(cpsr);
 
-    if (handle->driver->powerstate == TK_POWER_OFF) {
-        return TK_NO_POWER;
-    }
+    return TK_OK;
+}
+
+/* Check an ioctl's code and buffers against its TKIoctlInfo. On success, info
+ * receives the ioctl's TKIoctlInfo.
+ */
+static TKStatus ValidateIoctl(TKDriverHandle handle,
+                              uint32_t code,
+                              const void * inBuf,
+                              uint32_t inSize,
+                              void * outBuf,
+                              uint32_t outSize,
+                              const struct TKIoctlInfo ** info) {
+    const struct TKIoctlInfo * ioctlInfo;
 
     /* Validate ioctl code. */
-    ioctlInfo = handle->driver->ops.ioctlInfo(code);
+    ioctlInfo = LookupIoctl(handle, code);
     if (ioctlInfo == NULL) {
         return TK_IOCTL_BAD_CODE;
     }
@@ -214,70 +1185,441 @@ TKStatus TKDriverIoctl(TKDriverHandle handle,
         break;
     }
 
-    TKDownSemaphore(&handle->sem);
-    status = ioctlInfo->op(inBuf, outBuf);
-    TKUpSemaphore(&handle->sem);
+    *info = ioctlInfo;
+    return TK_OK;
+}
+
+TKStatus TKDriverIoctl(TKDriverHandle handle,
+                       uint32_t code,
+                       const void * inBuf,
+                       uint32_t inSize,
+                       void * outBuf,
+                       uint32_t outSize) {
+    return TKDriverIoctlTimeout(handle,
+                                code,
+                                inBuf,
+                                inSize,
+                                outBuf,
+                                outSize,
+                                TK_WAIT_FOREVER);
+}
+
+/* Serve a DDF ioctl issued on its own. It needs neither power nor the driver
+ * lock, so stats can be read from a device that is stuck or powered down.
+ */
+static TKStatus DdfIoctl(TKDriverHandle handle,
+                         uint32_t code,
+                         const void * inBuf,
+                         uint32_t inSize,
+                         void * outBuf,
+                         uint32_t outSize) {
+    const struct TKIoctlInfo * ioctlInfo;
+    TKStatus status;
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    status = ValidateIoctl(handle,
+                           code,
+                           inBuf,
+                           inSize,
+                           outBuf,
+                           outSize,
+                           &ioctlInfo);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    return RunIoctl(handle, ioctlInfo, code, inBuf, outBuf);
+}
+
+static TKStatus Ioctl(TKDriverHandle handle,
+                      uint32_t code,
+                      const void * inBuf,
+                      uint32_t inSize,
+                      void * outBuf,
+                      uint32_t outSize,
+                      uint32_t timeout,
+                      struct OpTimes * times) {
+    const struct TKIoctlInfo * ioctlInfo;
+    TKStatus status;
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
+    }
+
+    status = ValidateIoctl(handle,
+                           code,
+                           inBuf,
+                           inSize,
+                           outBuf,
+                           outSize,
+                           &ioctlInfo);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    status = LockAwake(handle, LOCK_CONTROL, timeout);
+    if (status != TK_OK) {
+        return status;
+    }
+    Locked(times);
+    status = RunIoctl(handle, ioctlInfo, code, inBuf, outBuf);
+    Serviced(times);
+    Unlock(handle, LOCK_CONTROL);
 
     return status;
 }
 
-TKStatus TKDriverPowerUp(TKDriverHandle handle) {
+TKStatus TKDriverIoctlTimeout(TKDriverHandle handle,
+                              uint32_t code,
+                              const void * inBuf,
+                              uint32_t inSize,
+                              void * outBuf,
+                              uint32_t outSize,
+                              uint32_t timeout) {
+    struct OpTimes times;
+    TKStatus status;
+
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    if (code >= TK_DDF_IOCTL_BASE) {
+        return DdfIoctl(handle, code, inBuf, inSize, outBuf, outSize);
+    }
+
+    TK_PROBE_START(DdfIoctl);
+    StartTimes(handle, STATS_IOCTL, &times);
+    status = Ioctl(handle,
+                   code,
+                   inBuf,
+                   inSize,
+                   outBuf,
+                   outSize,
+                   timeout,
+                   &times);
+    Account(handle, STATS_IOCTL, 1, status, 0, &times);
+    TK_PROBE_STOP(DdfIoctl);
+
+    return status;
+}
+
+static TKStatus IoctlBatch(TKDriverHandle handle,
+                           struct TKIoctlRequest requests[],
+                           uint32_t count,
+                           struct OpTimes * times) {
+    const struct TKIoctlInfo * ioctlInfo;
+    struct TKIoctlRequest * request;
+    TKStatus status;
+    uint32_t i;
+
+    if (requests == NULL) {
+        return TK_NULL;
+    }
+
+    if (!handle->used) {
+        return TK_CLOSED;
+    }
+
+    if (handle->powerstate == TK_POWER_OFF) {
+        return TK_NO_POWER;
+    }
+
+    /* Check everything before running anything. */
+    status = TK_OK;
+    for (i = 0; i < count; i++) {
+        request = &requests[i];
+        request->status = ValidateIoctl(handle,
+                                        request->code,
+                                        request->inBuf,
+                                        request->inSize,
+                                        request->outBuf,
+                                        request->outSize,
+                                        &ioctlInfo);
+        if (request->status != TK_OK && status == TK_OK) {
+            status = request->status;
+        }
+    }
+    if (status != TK_OK) {
+        for (i = 0; i < count; i++) {
+            if (requests[i].status == TK_OK) {
+                requests[i].status = TK_IOCTL_SKIPPED;
+            }
+        }
+        return status;
+    }
+
+    status = LockAwake(handle, LOCK_CONTROL, TK_WAIT_FOREVER);
+    if (status != TK_OK) {
+        for (i = 0; i < count; i++) {
+            requests[i].status = TK_IOCTL_SKIPPED;
+        }
+        return status;
+    }
+    Locked(times);
+    for (i = 0; i < count; i++) {
+        request = &requests[i];
+        if (status != TK_OK) {
+            request->status = TK_IOCTL_SKIPPED;
+            continue;
+        }
+
+        ioctlInfo = LookupIoctl(handle, request->code);
+        request->status = RunIoctl(handle,
+                                   ioctlInfo,
+                                   request->code,
+                                   request->inBuf,
+                                   request->outBuf);
+        status = request->status;
+    }
+    Serviced(times);
+    Unlock(handle, LOCK_CONTROL);
+
+    return status;
+}
+
+TKStatus TKDriverIoctlBatch(TKDriverHandle handle,
+                            struct TKIoctlRequest requests[],
+                            uint32_t count) {
+    struct OpTimes times;
     TKStatus status;
 
     if (handle == NULL) {
         return TK_NULL;
     }
 
+    StartTimes(handle, STATS_IOCTL, &times);
+    status = IoctlBatch(handle, requests, count, &times);
+    Account(handle, STATS_IOCTL, count, status, 0, &times);
+
+    return status;
+}
+
+/* The requested events of a handle that are ready now. */
+static uint32_t PollOne(TKDriverHandle handle, uint32_t events) {
+    /* Being polled counts as use, so autosuspend leaves the device alone. */
+    handle->lastUse = TickCount;
+
+    if (handle->driver->ops->poll == NULL) {
+        return events;
+    }
+
+    return handle->driver->ops->poll(handle->context, events) & events;
+}
+
+void TKDriverNotifyPoll(void) {
+    struct TKThread * thread;
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    PollNotifications++;
+    while ((thread = TKPopThread(&PollWaiters)) != NULL) {
+        TKRemoveTimeout(&TimeoutList, thread);
+        TKAddThread(&RunQueue, thread);
+        TK_EVENT_WAKE(thread);
+    }
+    TKEnableInterrupts(cpsr);
+}
+
+/* Block until a driver calls TKDriverNotifyPoll or the next tick, whichever
+ * comes first; the tick catches drivers that never notify. Returns at once if
+ * there was a notification since notifications was read.
+ */
+static void WaitForPoll(uint32_t notifications) {
+    struct TKThread * thread;
+    uint32_t cpsr;
+
+    thread = CurrentThread;
+    cpsr = TKDisableInterrupts();
+    if (PollNotifications != notifications) {
+        TKEnableInterrupts(cpsr);
+        return;
+    }
+    TKRemoveThread(thread);
+    TKAddThread(&PollWaiters, thread);
+    thread->timedOut = false;
+    thread->deadline = TickCount + 1;
+    TKAddTimeout(&TimeoutList, thread);
+    TKEnableInterrupts(cpsr);
+
+    _TKYieldThread(thread);
+}
+
+TKStatus TKDriverPoll(TKDriverHandle handles[],
+                      uint32_t events[],
+                      uint32_t count,
+                      uint32_t timeout) {
+    TKTickCount start;
+    TKStatus status;
+    uint32_t notifications;
+    uint32_t ready;
+    uint32_t i;
+    uint32_t j;
+
+    if (handles == NULL || events == NULL) {
+        return TK_NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (handles[i] == NULL) {
+            return TK_NULL;
+        }
+        if (!handles[i]->used) {
+            return TK_CLOSED;
+        }
+        if (handles[i]->powerstate == TK_POWER_OFF) {
+            return TK_NO_POWER;
+        }
+    }
+
+    /* A suspended device can't become ready, so wake it up to be polled. */
+    for (i = 0; i < count; i++) {
+        if (handles[i]->powerstate == TK_POWER_SUSPENDED) {
+            status = Resume(handles[i], TK_WAIT_FOREVER);
+            if (status != TK_OK) {
+                return status;
+            }
+        }
+    }
+
+    start = TickCount;
+    for (;;) {
+        notifications = PollNotifications;
+        for (i = 0; i < count; i++) {
+            ready = PollOne(handles[i], events[i]);
+            if (ready == 0) {
+                continue;
+            }
+
+            /* Nothing before i was ready, so report those as idle and poll
+             * the rest once more to fill in their results.
+             */
+            for (j = 0; j < i; j++) {
+                events[j] = 0;
+            }
+            events[i] = ready;
+            for (j = i + 1; j < count; j++) {
+                events[j] = PollOne(handles[j], events[j]);
+            }
+            return TK_OK;
+        }
+
+        /* Before the scheduler starts, nothing else can make a device
+         * ready.
+         */
+        if (Remaining(start, timeout) == 0 || CurrentThread == NULL) {
+            break;
+        }
+        WaitForPoll(notifications);
+    }
+
+    for (i = 0; i < count; i++) {
+        events[i] = 0;
+    }
+
+    return TK_TIMEOUT;
+}
+
+static TKStatus PowerUp(TKDriverHandle handle, struct OpTimes * times) {
+    TKStatus status;
+
     if (!handle->used) {
         return TK_CLOSED;
     }
 
-    if (handle->driver->powerstate == TK_POWER_ON) {
+    if (handle->powerstate == TK_POWER_ON) {
         return TK_ALREADY_POWERED_ON;
     }
 
-    if (handle->driver->ops.powerUp == NULL) {
+    if (handle->driver->ops->powerUp == NULL) {
         return TK_POWER_STATES_UNSUPPORTED;
     }
 
-    TKDownSemaphore(&handle->sem);
-    status = handle->driver->ops.powerUp();
-    TKUpSemaphore(&handle->sem);
-
-    if (status == TK_OK) {
-        handle->driver->powerstate = TK_POWER_ON;
+    /* The state changes under the lock, since LockAwake checks it there. */
+    Lock(handle, LOCK_CONTROL, TK_WAIT_FOREVER);
+    Locked(times);
+    if (handle->powerstate == TK_POWER_SUSPENDED) {
+        status = ResumeLocked(handle);
+    }
+    else {
+        status = handle->driver->ops->powerUp(handle->context);
+        if (status == TK_OK) {
+            handle->powerstate = TK_POWER_ON;
+        }
     }
+    Serviced(times);
+    Unlock(handle, LOCK_CONTROL);
 
     return status;
 }
 
-TKStatus TKDriverPowerDown(TKDriverHandle handle) {
+TKStatus TKDriverPowerUp(TKDriverHandle handle) {
+    struct OpTimes times;
     TKStatus status;
 
     if (handle == NULL) {
         return TK_NULL;
     }
 
+    StartTimes(handle, STATS_POWER, &times);
+    status = PowerUp(handle, &times);
+    Account(handle, STATS_POWER, 1, status, 0, &times);
+
+    return status;
+}
+
+static TKStatus PowerDown(TKDriverHandle handle, struct OpTimes * times) {
+    TKStatus status;
+
     if (!handle->used) {
         return TK_CLOSED;
     }
 
-    if (handle->driver->powerstate == TK_POWER_OFF) {
+    if (handle->powerstate == TK_POWER_OFF) {
         return TK_ALREADY_POWERED_OFF;
     }
 
-    if (handle->driver->ops.powerDown == NULL) {
+    if (handle->driver->ops->powerDown == NULL) {
         return TK_POWER_STATES_UNSUPPORTED;
     }
 
-    TKDownSemaphore(&handle->sem);
-    status = handle->driver->ops.powerDown();
-    TKUpSemaphore(&handle->sem);
-
+    /* See TKDriverPowerUp. A suspended device is already powered down. */
+    Lock(handle, LOCK_CONTROL, TK_WAIT_FOREVER);
+    Locked(times);
+    if (handle->powerstate == TK_POWER_SUSPENDED) {
+        CountSuspended(handle);
+        status = TK_OK;
+    }
+    else {
+        status = handle->driver->ops->powerDown(handle->context);
+    }
     if (status == TK_OK) {
-        handle->driver->powerstate = TK_POWER_OFF;
+        handle->powerstate = TK_POWER_OFF;
+    }
+    Serviced(times);
+    Unlock(handle, LOCK_CONTROL);
+
+    return status;
+}
+
+TKStatus TKDriverPowerDown(TKDriverHandle handle) {
+    struct OpTimes times;
+    TKStatus status;
+
+    if (handle == NULL) {
+        return TK_NULL;
     }
 
+    StartTimes(handle, STATS_POWER, &times);
+    status = PowerDown(handle, &times);
+    Account(handle, STATS_POWER, 1, status, 0, &times);
+
     return status;
 }
 
@@ -290,12 +1632,82 @@ TKStatus TKDriverPowerState(TKDriverHandle handle, TKPowerState * state) {
         return TK_CLOSED;
     }
 
-    if (handle->driver->ops.powerUp == NULL ||
-        handle->driver->ops.powerDown == NULL) {
+    if (handle->driver->ops->powerUp == NULL ||
+        handle->driver->ops->powerDown == NULL) {
         return TK_POWER_STATES_UNSUPPORTED;
     }
 
-    *state = handle->driver->powerstate;
+    *state = handle->powerstate;
+
+    return TK_OK;
+}
+
+void TKDriverAutosuspend(void) {
+    struct TKDriverEntry * entry;
+    uint32_t delay;
+    uint32_t cpsr;
+    TKStatus status;
+    uint32_t i;
+
+    for (i = 0; i < DriverCount; i++) {
+        entry = &DriverTable[i];
+        delay = entry->autosuspendDelay;
+        if (delay == 0 || !entry->used ||
+            entry->powerstate != TK_POWER_ON ||
+            TickCount - entry->lastUse < delay) {
+            continue;
+        }
+
+        /* A held lock means the device is busy. */
+        if (Lock(entry, LOCK_CONTROL, 0) != TK_OK) {
+            continue;
+        }
+
+        if (entry->powerstate == TK_POWER_ON &&
+            TickCount - entry->lastUse >= delay) {
+            status = entry->driver->ops->powerDown(entry->context);
+            if (status == TK_OK) {
+                entry->powerstate = TK_POWER_SUSPENDED;
+                entry->suspendedAt = TickCount;
+
+                cpsr = TKDisableInterrupts();
+                entry->stats.suspends++;
+                TKEnableInterrupts(cpsr);
+            }
+        }
+
+        Unlock(entry, LOCK_CONTROL);
+    }
+}
+
+void TKAutosuspendThread(void * p) {
+    for (;;) {
+        TKDriverAutosuspend();
+        TKThreadSleep(1);
+    }
+}
+
+bool TKDriverAutosuspendUsed(void) {
+    uint32_t i;
+
+    for (i = 0; i < DriverCount; i++) {
+        if (DriverTable[i].autosuspendDelay != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+TKStatus _TKDriverSetAutosuspendDelay(TKDriverHandle handle, uint32_t delay) {
+    if (handle == NULL) {
+        return TK_NULL;
+    }
+
+    if (delay != 0 && !CanAutosuspend(handle->driver)) {
+        return TK_POWER_STATES_UNSUPPORTED;
+    }
 
+    handle->autosuspendDelay = delay;
     return TK_OK;
 }
@@ -0,0 +1,118 @@
+/* Loopback driver. Bytes written come back out of reads, in order, through a
+ * small ring. Writes that don't fit and reads of more than is held come up
+ * short rather than block. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/ddf.h"
+#include "tk/status.h"
+
+#include "tk/drivers/loopback.h"
+
+static uint8_t Ring[TK_LOOPBACK_SIZE];
+static uint32_t Head;
+static uint32_t Count;
+
+static void Init(void * context) {
+    Head = 0;
+    Count = 0;
+}
+
+static void Open(void * context) {
+    return;
+}
+
+static void Close(void * context) {
+    return;
+}
+
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
+    uint32_t n;
+    uint32_t first;
+
+    n = size < Count ? size : Count;
+    first = TK_LOOPBACK_SIZE - Head;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(buffer, &Ring[Head], first);
+    memcpy(&buffer[first], Ring, n - first);
+    Head = (Head + n) % TK_LOOPBACK_SIZE;
+    Count -= n;
+    if (n > 0) {
+        TKDriverNotifyPoll();
+    }
+
+    *status = TK_OK;
+    return n;
+}
+
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
+    uint32_t n;
+    uint32_t tail;
+    uint32_t first;
+
+    n = TK_LOOPBACK_SIZE - Count;
+    if (n > size) {
+        n = size;
+    }
+    tail = (Head + Count) % TK_LOOPBACK_SIZE;
+    first = TK_LOOPBACK_SIZE - tail;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(&Ring[tail], buffer, first);
+    memcpy(Ring, &buffer[first], n - first);
+    Count += n;
+    if (n > 0) {
+        TKDriverNotifyPoll();
+    }
+
+    *status = TK_OK;
+    return n;
+}
+
+static uint32_t Poll(void * context, uint32_t events) {
+    uint32_t ready;
+
+    ready = 0;
+    if (Count > 0) {
+        ready |= TK_POLL_READ;
+    }
+    if (Count < TK_LOOPBACK_SIZE) {
+        ready |= TK_POLL_WRITE;
+    }
+    return ready;
+}
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    return NULL;
+}
+
+static const struct TKDriverOps Ops = {
+    .init = Init,
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .poll = Poll,
+    .ioctlInfo = IoctlInfo
+};
+
+TK_DRIVER_DEFINE(LoopbackDriver) = {
+    .name = "loopback",
+    .major = TK_LOOPBACK_MAJOR,
+    .minor = TK_LOOPBACK_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &Ops
+};
@@ -0,0 +1,86 @@
+/* Null driver. Writes are discarded and reads find nothing, so the cost of an
+ * operation is all DDF overhead. It supports power states, so the power path
+ * can be timed too. */
+
+#include <stddef.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/ddf.h"
+#include "tk/status.h"
+
+#include "tk/drivers/null.h"
+
+static void Open(void * context) {
+    return;
+}
+
+static void Close(void * context) {
+    return;
+}
+
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
+    *status = TK_OK;
+    return 0;
+}
+
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
+    *status = TK_OK;
+    return size;
+}
+
+static TKStatus PowerUp(void * context) {
+    return TK_OK;
+}
+
+static TKStatus PowerDown(void * context) {
+    return TK_OK;
+}
+
+/* Ioctl */
+static TKStatus IoctlNopOp(void * context,
+                           const void * inBuf,
+                           void * outBuf) {
+    return TK_OK;
+}
+
+static const struct TKIoctlInfo IoctlNop = {
+    .type = TK_IOCTL_NONE,
+    .inSize = 0,
+    .outSize = 0,
+    .op = IoctlNopOp
+};
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    switch (code) {
+        case TK_NULL_IOCTL_NOP:
+            return &IoctlNop;
+        default:
+            return NULL;
+    }
+}
+
+static const struct TKDriverOps Ops = {
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .ioctlInfo = IoctlInfo,
+    .powerUp = PowerUp,
+    .powerDown = PowerDown
+};
+
+TK_DRIVER_DEFINE(NullDriver) = {
+    .name = "null",
+    .major = TK_NULL_MAJOR,
+    .minor = TK_NULL_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &Ops
+};
@@ -0,0 +1,235 @@
+/* Pipe driver. A bounded byte ring between threads. Reads block only while
+ * the pipe is empty and return whatever is there, up to the buffer size.
+ * Writes block until all of the buffer is in the pipe; if the caller's timeout
+ * passes first, they return what they transferred. Reads and writes are
+ * locked separately, so a reader blocked on an empty pipe doesn't hold up the
+ * writer that will fill it. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/data.h"
+#include "tk/ddf.h"
+#include "tk/semaphore.h"
+#include "tk/status.h"
+#include "tk/thread.h"
+#include "tk/utility.h"
+
+#include "tk/drivers/pipe.h"
+
+struct Pipe {
+    uint8_t ring[TK_PIPE_SIZE];
+    /* Free-running; only the reader moves head and only the writer moves
+     * tail, so neither needs the other's lock.
+     */
+    uint32_t head;
+    uint32_t tail;
+    /* A blocked reader waits on readable, and a blocked writer on writable.
+     * The other side ups the semaphore if the flag is set.
+     */
+    bool readerWaiting;
+    bool writerWaiting;
+    struct TKSemaphore readable;
+    struct TKSemaphore writable;
+};
+
+static struct Pipe Pipes[TK_PIPE_COUNT];
+
+static void Init(void * context) {
+    struct Pipe * pipe = context;
+
+    pipe->head = 0;
+    pipe->tail = 0;
+    pipe->readerWaiting = false;
+    pipe->writerWaiting = false;
+    TKCreateSemaphore(&pipe->readable, 0);
+    TKCreateSemaphore(&pipe->writable, 0);
+}
+
+static void Open(void * context) {
+    return;
+}
+
+static void Close(void * context) {
+    return;
+}
+
+/* Whether a caller can block. Before the scheduler starts there is no thread
+ * to block, and no other thread to fill or drain the pipe, so a wait would
+ * never end.
+ */
+static bool CanBlock(void) {
+    return CurrentThread != NULL;
+}
+
+/* Wait until ready says the pipe can be used. Wakeups may be stale, so the
+ * condition is checked again after each one.
+ */
+static TKStatus Wait(struct Pipe * pipe,
+                     bool (*ready)(struct Pipe * pipe),
+                     bool * waiting,
+                     struct TKSemaphore * sem) {
+    uint32_t cpsr;
+    TKStatus status;
+
+    for (;;) {
+        /* Check and set the flag together, so the other side can't slip in
+         * between and miss us.
+         */
+        cpsr = TKDisableInterrupts();
+        if (ready(pipe)) {
+            TKEnableInterrupts(cpsr);
+            return TK_OK;
+        }
+        *waiting = true;
+        TKEnableInterrupts(cpsr);
+
+        if (!CanBlock()) {
+            return TK_TIMEOUT;
+        }
+        status = TKDownSemaphoreTimeout(sem, TKTimeoutRemaining());
+        if (status != TK_OK) {
+            return status;
+        }
+    }
+}
+
+static void Wake(bool * waiting, struct TKSemaphore * sem) {
+    uint32_t cpsr;
+    bool wake;
+
+    cpsr = TKDisableInterrupts();
+    wake = *waiting;
+    *waiting = false;
+    TKEnableInterrupts(cpsr);
+
+    if (wake) {
+        TKUpSemaphore(sem);
+    }
+}
+
+static bool HasData(struct Pipe * pipe) {
+    return pipe->tail != pipe->head;
+}
+
+static bool HasRoom(struct Pipe * pipe) {
+    return pipe->tail - pipe->head < TK_PIPE_SIZE;
+}
+
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
+    struct Pipe * pipe = context;
+    uint32_t offset;
+    uint32_t first;
+    uint32_t n;
+
+    if (size == 0) {
+        *status = TK_OK;
+        return 0;
+    }
+
+    *status = Wait(pipe, HasData, &pipe->readerWaiting, &pipe->readable);
+    if (*status != TK_OK) {
+        return 0;
+    }
+
+    n = pipe->tail - pipe->head;
+    if (n > size) {
+        n = size;
+    }
+    offset = pipe->head % TK_PIPE_SIZE;
+    first = TK_PIPE_SIZE - offset;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(buffer, &pipe->ring[offset], first);
+    memcpy(&buffer[first], pipe->ring, n - first);
+    pipe->head += n;
+
+    Wake(&pipe->writerWaiting, &pipe->writable);
+    TKDriverNotifyPoll();
+
+    return n;
+}
+
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
+    struct Pipe * pipe = context;
+    uint32_t offset;
+    uint32_t first;
+    uint32_t done;
+    uint32_t n;
+
+    for (done = 0; done < size; done += n) {
+        *status = Wait(pipe, HasRoom, &pipe->writerWaiting, &pipe->writable);
+        if (*status != TK_OK) {
+            return done;
+        }
+
+        n = TK_PIPE_SIZE - (pipe->tail - pipe->head);
+        if (n > size - done) {
+            n = size - done;
+        }
+        offset = pipe->tail % TK_PIPE_SIZE;
+        first = TK_PIPE_SIZE - offset;
+        if (first > n) {
+            first = n;
+        }
+        memcpy(&pipe->ring[offset], &buffer[done], first);
+        memcpy(pipe->ring, &buffer[done + first], n - first);
+        pipe->tail += n;
+
+        Wake(&pipe->readerWaiting, &pipe->readable);
+        TKDriverNotifyPoll();
+    }
+
+    *status = TK_OK;
+    return done;
+}
+
+static uint32_t Poll(void * context, uint32_t events) {
+    struct Pipe * pipe = context;
+    uint32_t ready;
+
+    ready = 0;
+    if (HasData(pipe)) {
+        ready |= TK_POLL_READ;
+    }
+    if (HasRoom(pipe)) {
+        ready |= TK_POLL_WRITE;
+    }
+
+    return ready;
+}
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    return NULL;
+}
+
+static const struct TKDriverOps Ops = {
+    .init = Init,
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .poll = Poll,
+    .ioctlInfo = IoctlInfo
+};
+
+TK_DRIVER_DEFINE(PipeDriver) = {
+    .name = "pipe",
+    .major = TK_PIPE_MAJOR,
+    .minor = TK_PIPE_MINOR,
+    .minorCount = TK_PIPE_COUNT,
+    .concurrency = TK_CONCURRENCY_PER_DIRECTION,
+    .ops = &Ops,
+    .contexts = Pipes,
+    .contextSize = sizeof(struct Pipe)
+};
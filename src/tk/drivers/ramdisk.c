@@ -0,0 +1,99 @@
+/* RAM disk driver. A block device backed by an array in RAM, for testing and
+ * benchmarking the block layer. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/block.h"
+#include "tk/ddf.h"
+#include "tk/status.h"
+
+#include "tk/drivers/ramdisk.h"
+
+static uint8_t Storage[TK_RAMDISK_BLOCKS][TK_BLOCK_SIZE];
+static struct TKRamdiskStats Stats;
+
+static void Init(void * context) {
+    memset(&Stats, 0, sizeof(Stats));
+}
+
+static void Open(void * context) {
+    return;
+}
+
+static void Close(void * context) {
+    return;
+}
+
+static TKStatus Geometry(void * context,
+                         uint32_t * blockSize,
+                         uint32_t * blockCount) {
+    *blockSize = TK_BLOCK_SIZE;
+    *blockCount = TK_RAMDISK_BLOCKS;
+    return TK_OK;
+}
+
+static TKStatus ReadBlocks(void * context,
+                           uint32_t block,
+                           uint32_t count,
+                           uint8_t * buffer) {
+    memcpy(buffer, Storage[block], count * TK_BLOCK_SIZE);
+    Stats.reads++;
+    Stats.blocksRead += count;
+    return TK_OK;
+}
+
+static TKStatus WriteBlocks(void * context,
+                            uint32_t block,
+                            uint32_t count,
+                            const uint8_t * buffer) {
+    memcpy(Storage[block], buffer, count * TK_BLOCK_SIZE);
+    Stats.writes++;
+    Stats.blocksWritten += count;
+    return TK_OK;
+}
+
+/* Ioctl */
+static TKStatus IoctlStatsOp(void * context,
+                             const void * inBuf,
+                             void * outBuf) {
+    memcpy(outBuf, &Stats, sizeof(Stats));
+    return TK_OK;
+}
+
+static const struct TKIoctlInfo IoctlStats = {
+    .type = TK_IOCTL_OUT,
+    .inSize = 0,
+    .outSize = sizeof(struct TKRamdiskStats),
+    .op = IoctlStatsOp
+};
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    switch (code) {
+        case TK_RAMDISK_IOCTL_STATS:
+            return &IoctlStats;
+        default:
+            return NULL;
+    }
+}
+
+static const struct TKDriverOps Ops = {
+    .init = Init,
+    .open = Open,
+    .close = Close,
+    .geometry = Geometry,
+    .readBlocks = ReadBlocks,
+    .writeBlocks = WriteBlocks,
+    .ioctlInfo = IoctlInfo
+};
+
+TK_DRIVER_DEFINE(RamdiskDriver) = {
+    .name = "ramdisk",
+    .major = TK_RAMDISK_MAJOR,
+    .minor = TK_RAMDISK_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &Ops
+};
@@ -1,5 +1,5 @@
-/* Serial driver. This driver communicates with the serial port, sets baud rate,
- * etc. */
+/* Serial driver. This driver communicates with the serial ports, sets baud
+ * rate, etc. Each UART is a minor of the driver. */
 
 #include <stddef.h>
 #include <string.h>
@@ -8,41 +8,177 @@
 #include "lpc/lpc2378.h"
 #include "lpc/uarts.h"
 
+#include "tk/data.h"
 #include "tk/ddf.h"
+#include "tk/semaphore.h"
 #include "tk/status.h"
 #include "tk/utility.h"
 
 #include "tk/drivers/serial.h"
 
-static void Open(void) {
-    return;
+/* Everything that differs between the UARTs. */
+struct SerialPort {
+    P_LPC23XX_UART regs;
+    uint32_t pconp;
+    /* Which PCLKSEL register holds the peripheral clock divider, and where. */
+    uint32_t pclkSelReg;
+    uint32_t pclkShift;
+    uint32_t txPinselReg;
+    uint32_t txPinmask;
+    uint32_t txPinsel;
+    uint32_t rxPinselReg;
+    uint32_t rxPinmask;
+    uint32_t rxPinsel;
+};
+
+static const struct SerialPort Ports[TK_SERIAL_PORT_COUNT] = {
+    {
+        .regs = P_UART0_REGS,
+        .pconp = PCUART0,
+        .pclkSelReg = 0,
+        .pclkShift = PCLK_UART0,
+        .txPinselReg = U0_TX_PINSEL_REG,
+        .txPinmask = U0_TX_PINMASK,
+        .txPinsel = U0_TX_PINSEL,
+        .rxPinselReg = U0_RX_PINSEL_REG,
+        .rxPinmask = U0_RX_PINMASK,
+        .rxPinsel = U0_RX_PINSEL
+    },
+    {
+        .regs = P_UART1_REGS,
+        .pconp = PCUART1,
+        .pclkSelReg = 0,
+        .pclkShift = PCLK_UART1,
+        .txPinselReg = U1_TX_PINSEL_REG,
+        .txPinmask = U1_TX_PINMASK,
+        .txPinsel = U1_TX_PINSEL,
+        .rxPinselReg = U1_RX_PINSEL_REG,
+        .rxPinmask = U1_RX_PINMASK,
+        .rxPinsel = U1_RX_PINSEL
+    },
+    {
+        .regs = P_UART2_REGS,
+        .pconp = PCUART2,
+        .pclkSelReg = 1,
+        .pclkShift = PCLK_UART2,
+        .txPinselReg = U2_TX_PINSEL_REG,
+        .txPinmask = U2_TX_PINMASK,
+        .txPinsel = U2_TX_PINSEL,
+        .rxPinselReg = U2_RX_PINSEL_REG,
+        .rxPinmask = U2_RX_PINMASK,
+        .rxPinsel = U2_RX_PINSEL
+    },
+    {
+        .regs = P_UART3_REGS,
+        .pconp = PCUART3,
+        .pclkSelReg = 1,
+        .pclkShift = PCLK_UART3,
+        .txPinselReg = U3_TX_PINSEL_REG,
+        .txPinmask = U3_TX_PINMASK,
+        .txPinsel = U3_TX_PINSEL,
+        .rxPinselReg = U3_RX_PINSEL_REG,
+        .rxPinmask = U3_RX_PINMASK,
+        .rxPinsel = U3_RX_PINSEL
+    }
+};
+
+/* A minor's context. It lives in RAM and points at the port in flash, since
+ * initialized globals in RAM can't be relied on (see RunTests).
+ */
+struct SerialContext {
+    const struct SerialPort * port;
+    /* Never upped: a reader waits on it for a tick between polls. */
+    struct TKSemaphore idle;
+};
+
+static struct SerialContext Contexts[TK_SERIAL_PORT_COUNT];
+
+static const struct SerialPort * PortOf(void * context) {
+    return ((struct SerialContext *) context)->port;
 }
 
-static void Close(void) {
+static void Init(void * context) {
+    struct SerialContext * serial;
+
+    serial = context;
+    serial->port = &Ports[serial - Contexts];
+    TKCreateSemaphore(&serial->idle, 0);
+}
+
+static void PutChar(const struct SerialPort * port, uint8_t c) {
+    while (!(port->regs->LSR & ULSR_THRE)) {
+        continue;
+    }
+    port->regs->THR = c;
+}
+
+static void Open(void * context) {
+    const struct SerialPort * port;
+
+    port = PortOf(context);
+
+    /* UART0 is already running as the console, but the others are off after
+     * reset. Doing this again for UART0 is harmless.
+     */
+    VOLATILE32(PCONP) |= port->pconp;
+    VOLATILE32(port->txPinselReg) =
+        (VOLATILE32(port->txPinselReg) & ~port->txPinmask) | port->txPinsel;
+    VOLATILE32(port->rxPinselReg) =
+        (VOLATILE32(port->rxPinselReg) & ~port->rxPinmask) | port->rxPinsel;
+}
+
+static void Close(void * context) {
     return;
 }
 
-static int Read(TKStatus * status, uint8_t * buffer, uint32_t size) {
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
+    struct SerialContext * serial;
+    const struct SerialPort * port;
     uint32_t i;
 
+    serial = context;
+    port = serial->port;
+
+    /* Don't spin with the driver locked: give up once the caller's timeout
+     * passes, and sleep for a tick between polls so threads of any priority
+     * can run while we wait. A yield would come straight back to a reader
+     * that outranks every other ready thread.
+     */
     for (i = 0; i < size; i++) {
-        buffer[i] = GETC();
+        while (!(port->regs->LSR & ULSR_RDR)) {
+            if (TKTimeoutRemaining() == 0) {
+                *status = TK_TIMEOUT;
+                return i;
+            }
+            if (CurrentThread != NULL) {
+                TKDownSemaphoreTimeout(&serial->idle, 1);
+            }
+        }
+        buffer[i] = port->regs->RBR;
     }
 
     *status = TK_OK;
     return size;
 }
 
-static int Write(TKStatus * status, const uint8_t * buffer, uint32_t size) {
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
+    const struct SerialPort * port;
     uint32_t i;
 
+    port = PortOf(context);
     for (i = 0; i < size; i++) {
         if (buffer[i] == '\n') {
-            PUTC('\n');
-            PUTC('\r');
+            PutChar(port, '\n');
+            PutChar(port, '\r');
         }
         else {
-            PUTC(buffer[i]);
+            PutChar(port, buffer[i]);
         }
     }
 
@@ -50,29 +186,67 @@ static int Write(TKStatus * status, const uint8_t * buffer, uint32_t size) {
     return size;
 }
 
-static TKStatus PowerUp(void) {
-    VOLATILE32(PCONP) |= PCUART0;
-    return TK_OK;
+static int WriteRawv(void * context,
+                     TKStatus * status,
+                     const struct TKIoVec * vec,
+                     uint32_t count) {
+    const struct SerialPort * port;
+    uint32_t total;
+    uint32_t i;
+    uint32_t j;
+
+    port = PortOf(context);
+    total = 0;
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < vec[i].size; j++) {
+            PutChar(port, vec[i].buffer[j]);
+        }
+        total += vec[i].size;
+    }
+
+    *status = TK_OK;
+    return total;
 }
 
-static TKStatus PowerDown(void) {
-    VOLATILE32(PCONP) &= ~PCUART0;
+static uint32_t Poll(void * context, uint32_t events) {
+    const struct SerialPort * port;
+    uint32_t lsr;
+    uint32_t ready;
+
+    port = PortOf(context);
+    lsr = port->regs->LSR;
+    ready = 0;
+    if (lsr & ULSR_RDR) {
+        ready |= TK_POLL_READ;
+    }
+    if (lsr & ULSR_THRE) {
+        ready |= TK_POLL_WRITE;
+    }
+
+    return ready;
+}
+
+static TKStatus PowerUp(void * context) {
+    const struct SerialPort * port;
+
+    port = PortOf(context);
+    VOLATILE32(PCONP) |= port->pconp;
     return TK_OK;
 }
 
-/* Ioctl */
-static struct TKIoctlInfo IoctlBaud;
+static TKStatus PowerDown(void * context) {
+    const struct SerialPort * port;
 
-static struct TKIoctlInfo * IoctlInfo(uint32_t code) {
-    switch (code) {
-        case TK_SERIAL_IOCTL_BAUD:
-            return &IoctlBaud;
-        default:
-            return NULL;
-    }
+    port = PortOf(context);
+    VOLATILE32(PCONP) &= ~port->pconp;
+    return TK_OK;
 }
 
-static TKStatus IoctlBaudOp(const void * inBuf, void * outBuf) {
+/* Ioctl */
+static TKStatus IoctlBaudOp(void * context,
+                            const void * inBuf,
+                            void * outBuf) {
+    const struct SerialPort * port;
     struct TKSerialBaudInfo * baud;
     uint32_t cclk;
     int8_t lcr;
@@ -81,14 +255,17 @@ static TKStatus IoctlBaudOp(const void * inBuf, void * outBuf) {
     uint32_t uartDivisorLatch;
     uint8_t udlRoundBit;
 
+    port = PortOf(context);
     baud = (struct TKSerialBaudInfo *) inBuf;
 
     /* Stop any transmissions */
-    P_UART0_REGS->TER = 0;
+    port->regs->TER = 0;
 
     /* Calculate and set baud rate */
 	cclk = SCBParams.PLL_Fcco/SCBParams.CCLK_Div;
-    pclkSel = GET_PCLK_SEL( P_SCB_REGS->PCLKSEL0, PCLK_UART0 );
+    pclkSel = GET_PCLK_SEL( port->pclkSelReg == 0 ? P_SCB_REGS->PCLKSEL0
+                                                   : P_SCB_REGS->PCLKSEL1,
+                            port->pclkShift );
     pclkDiv = ( pclkSel == 0 ? 4 : \
     		    pclkSel == 1 ? 1 : \
     		    pclkSel == 2 ? 2 : \
@@ -101,9 +278,9 @@ static TKStatus IoctlBaudOp(const void * inBuf, void * outBuf) {
     uartDivisorLatch = ( 2 * ( (cclk/pclkDiv) / ( (baud->rate) * 16) ) );
     udlRoundBit = ( (uartDivisorLatch & 0x1) == 0 ? 0 : 1 );
     uartDivisorLatch /= 2;
-    P_UART0_REGS->LCR = ULCR_DLAB_ENABLE;
-    P_UART0_REGS->DLL = (uint8_t) uartDivisorLatch + udlRoundBit;
-    P_UART0_REGS->DLM = (uint8_t)(uartDivisorLatch >> 8);
+    port->regs->LCR = ULCR_DLAB_ENABLE;
+    port->regs->DLL = (uint8_t) uartDivisorLatch + udlRoundBit;
+    port->regs->DLM = (uint8_t)(uartDivisorLatch >> 8);
 
     /* Set mode */
     lcr = 0;
@@ -121,31 +298,51 @@ static TKStatus IoctlBaudOp(const void * inBuf, void * outBuf) {
         break;
     }
     
-    P_UART0_REGS->LCR = lcr;
+    port->regs->LCR = lcr;
 
     /* Resume transmissions */
-    P_UART0_REGS->TER = UTER_TXEN;
+    port->regs->TER = UTER_TXEN;
 
     return TK_OK;
 }
 
-void TKSerialDriverInit(void) {
-    strcpy(TKSerialDriver.name, "serial");
-    TKSerialDriver.major = TK_SERIAL_MAJOR;
-    TKSerialDriver.minor = TK_SERIAL_MINOR;
-    TKSerialDriver.powerstate = TK_POWER_ON;
-
-    TKSerialDriver.ops.init = TKSerialDriverInit;
-    TKSerialDriver.ops.open = Open;
-    TKSerialDriver.ops.close = Close;
-    TKSerialDriver.ops.read = Read;
-    TKSerialDriver.ops.write = Write;
-    TKSerialDriver.ops.ioctlInfo = IoctlInfo;
-    TKSerialDriver.ops.powerUp = PowerUp;
-    TKSerialDriver.ops.powerDown = PowerDown;
-
-    IoctlBaud.type = TK_IOCTL_IN;
-    IoctlBaud.inSize = sizeof(struct TKSerialBaudInfo);
-    IoctlBaud.outSize = 0;
-    IoctlBaud.op = IoctlBaudOp;
+static const struct TKIoctlInfo IoctlBaud = {
+    .type = TK_IOCTL_IN,
+    .inSize = sizeof(struct TKSerialBaudInfo),
+    .outSize = 0,
+    .op = IoctlBaudOp
+};
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    switch (code) {
+        case TK_SERIAL_IOCTL_BAUD:
+            return &IoctlBaud;
+        default:
+            return NULL;
+    }
 }
+
+static const struct TKDriverOps Ops = {
+    .init = Init,
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .writeRawv = WriteRawv,
+    .poll = Poll,
+    .ioctlInfo = IoctlInfo,
+    .powerUp = PowerUp,
+    .powerDown = PowerDown
+};
+
+TK_DRIVER_DEFINE(SerialDriver) = {
+    .name = "serial",
+    .major = TK_SERIAL_MAJOR,
+    .minor = 0,
+    .minorCount = TK_SERIAL_PORT_COUNT,
+    /* Receive and transmit use separate registers, so allow full duplex. */
+    .concurrency = TK_CONCURRENCY_PER_DIRECTION,
+    .ops = &Ops,
+    .contexts = Contexts,
+    .contextSize = sizeof(Contexts[0])
+};
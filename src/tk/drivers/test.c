@@ -1,5 +1,6 @@
 /* Test driver. This driver does minimal operations to prove out the DDF. */
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -12,43 +13,194 @@
 
 static uint8_t buf[4];
 
-static void Open(void) {
+/* Whether buf holds data written since the last read, for Poll. */
+static bool readable;
+
+static void Open(void * context) {
     return;
 }
 
-static void Close(void) {
+static void Close(void * context) {
     return;
 }
 
-static int Read(TKStatus * status, uint8_t * buffer, uint32_t size) {
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
     memcpy(buffer, buf, size);
+    readable = false;
 
     *status = TK_OK;
     return size;
 }
 
-static int Write(TKStatus * status, const uint8_t * buffer, uint32_t size) {
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
     memcpy(buf, buffer, size);
+    readable = true;
 
     *status = TK_OK;
     return size;
 }
 
-static TKStatus PowerUp(void) {
+/* Vectored operations treat buf as one contiguous area, so a gathered write
+ * followed by a scattered read round-trips the data.
+ */
+static int Readv(void * context,
+                 TKStatus * status,
+                 const struct TKIoVec * vec,
+                 uint32_t count) {
+    uint32_t i;
+    uint32_t offset;
+    uint32_t size;
+
+    offset = 0;
+    for (i = 0; i < count && offset < sizeof(buf); i++) {
+        size = vec[i].size;
+        if (size > sizeof(buf) - offset) {
+            size = sizeof(buf) - offset;
+        }
+        memcpy(vec[i].buffer, &buf[offset], size);
+        offset += size;
+    }
+
+    *status = TK_OK;
+    return offset;
+}
+
+static int Writev(void * context,
+                  TKStatus * status,
+                  const struct TKIoVec * vec,
+                  uint32_t count) {
+    uint32_t i;
+    uint32_t offset;
+    uint32_t size;
+
+    offset = 0;
+    for (i = 0; i < count && offset < sizeof(buf); i++) {
+        size = vec[i].size;
+        if (size > sizeof(buf) - offset) {
+            size = sizeof(buf) - offset;
+        }
+        memcpy(&buf[offset], vec[i].buffer, size);
+        offset += size;
+    }
+
+    *status = TK_OK;
+    return offset;
+}
+
+/* Loans hand out buf itself; since the data is already in place, committing
+ * has nothing left to do.
+ */
+static uint8_t * AcquireBuffer(void * context,
+                               TKStatus * status,
+                               enum TKBufferDirection direction,
+                               uint32_t * size) {
+    *size = sizeof(buf);
+    *status = TK_OK;
+    return buf;
+}
+
+static TKStatus CommitBuffer(void * context,
+                             enum TKBufferDirection direction,
+                             uint32_t size) {
+    return TK_OK;
+}
+
+/* Writes never block; reads are ready once something has been written. */
+static uint32_t Poll(void * context, uint32_t events) {
+    return readable ? TK_POLL_READ | TK_POLL_WRITE : TK_POLL_WRITE;
+}
+
+static TKStatus PowerUp(void * context) {
     return TK_OK;
 }
 
-static TKStatus PowerDown(void) {
+static TKStatus PowerDown(void * context) {
     return TK_OK;
 }
 
 /* Ioctl */
-static struct TKIoctlInfo IoctlNone;
-static struct TKIoctlInfo IoctlIn;
-static struct TKIoctlInfo IoctlOut;
-static struct TKIoctlInfo IoctlInOut;
+static TKStatus IoctlNoneOp(void * context,
+                            const void * inBuf,
+                            void * outBuf) {
+    return TK_OK;
+}
+
+/* The in and out ioctls load and store the device buffer, so tests can see
+ * what ran and in what order.
+ */
+static TKStatus IoctlInOp(void * context,
+                          const void * inBuf,
+                          void * outBuf) {
+    memcpy(buf, inBuf, sizeof(buf));
+    return TK_OK;
+}
+
+static TKStatus IoctlOutOp(void * context,
+                           const void * inBuf,
+                           void * outBuf) {
+    memcpy(outBuf, buf, sizeof(buf));
+    return TK_OK;
+}
+
+static TKStatus IoctlInOutOp(void * context,
+                             const void * inBuf,
+                             void * outBuf) {
+    uint8_t old[sizeof(buf)];
+
+    memcpy(old, buf, sizeof(buf));
+    memcpy(buf, inBuf, sizeof(buf));
+    memcpy(outBuf, old, sizeof(buf));
+    return TK_OK;
+}
+
+static TKStatus IoctlFailOp(void * context,
+                            const void * inBuf,
+                            void * outBuf) {
+    return TK_UNEXPECTED;
+}
+
+static const struct TKIoctlInfo IoctlNone = {
+    .type = TK_IOCTL_NONE,
+    .inSize = 0,
+    .outSize = 0,
+    .op = IoctlNoneOp
+};
+
+static const struct TKIoctlInfo IoctlIn = {
+    .type = TK_IOCTL_IN,
+    .inSize = 4,
+    .outSize = 0,
+    .op = IoctlInOp
+};
+
+static const struct TKIoctlInfo IoctlOut = {
+    .type = TK_IOCTL_OUT,
+    .inSize = 0,
+    .outSize = 4,
+    .op = IoctlOutOp
+};
 
-static struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+static const struct TKIoctlInfo IoctlInOut = {
+    .type = TK_IOCTL_IN_OUT,
+    .inSize = 4,
+    .outSize = 4,
+    .op = IoctlInOutOp
+};
+
+static const struct TKIoctlInfo IoctlFail = {
+    .type = TK_IOCTL_NONE,
+    .inSize = 0,
+    .outSize = 0,
+    .op = IoctlFailOp
+};
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
     switch (code) {
         case TK_TEST_IOCTL_NONE:
             return &IoctlNone;
@@ -58,59 +210,77 @@ static struct TKIoctlInfo * IoctlInfo(uint32_t code) {
             return &IoctlOut;
         case TK_TEST_IOCTL_IN_OUT:
             return &IoctlInOut;
+        case TK_TEST_IOCTL_FAIL:
+            return &IoctlFail;
         default:
             return NULL;
     }
 }
 
-static TKStatus IoctlNoneOp(const void * inBuf, void * outBuf) {
-    return TK_OK;
+static void Init(void * context) {
+    readable = false;
 }
 
-static TKStatus IoctlInOp(const void * inBuf, void * outBuf) {
-    return TK_OK;
-}
+static const struct TKDriverOps Ops = {
+    .init = Init,
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .readv = Readv,
+    .writev = Writev,
+    .acquireBuffer = AcquireBuffer,
+    .commitBuffer = CommitBuffer,
+    .poll = Poll,
+    .ioctlInfo = IoctlInfo,
+    .powerUp = PowerUp,
+    .powerDown = PowerDown
+};
 
-static TKStatus IoctlOutOp(const void * inBuf, void * outBuf) {
-    return TK_OK;
-}
+/* The same device with none of the optional ops, for testing the DDF's
+ * fallbacks.
+ */
+static const struct TKDriverOps BasicOps = {
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .ioctlInfo = IoctlInfo
+};
 
-static TKStatus IoctlInOutOp(const void * inBuf, void * outBuf) {
-    return TK_OK;
-}
+/* All minors share the one buffer, so none of them needs a context. */
+TK_DRIVER_DEFINE(TestDriver) = {
+    .name = "test",
+    .major = TK_TEST_MAJOR,
+    .minor = TK_TEST_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &Ops
+};
 
-void TKTestDriverInit(void) {
-    strcpy(TKTestDriver.name, "test");
-    TKTestDriver.major = TK_TEST_MAJOR;
-    TKTestDriver.minor = TK_TEST_MINOR;
-    TKTestDriver.powerstate = TK_POWER_ON;
-
-    TKTestDriver.ops.init = TKTestDriverInit;
-    TKTestDriver.ops.open = Open;
-    TKTestDriver.ops.close = Close;
-    TKTestDriver.ops.read = Read;
-    TKTestDriver.ops.write = Write;
-    TKTestDriver.ops.ioctlInfo = IoctlInfo;
-    TKTestDriver.ops.powerUp = PowerUp;
-    TKTestDriver.ops.powerDown = PowerDown;
-
-    IoctlNone.type = TK_IOCTL_NONE;
-    IoctlNone.inSize = 0;
-    IoctlNone.outSize = 0;
-    IoctlNone.op = IoctlNoneOp;
-
-    IoctlIn.type = TK_IOCTL_IN;
-    IoctlIn.inSize = 4;
-    IoctlIn.outSize = 0;
-    IoctlIn.op = IoctlInOp;
-
-    IoctlOut.type = TK_IOCTL_OUT;
-    IoctlOut.inSize = 0;
-    IoctlOut.outSize = 4;
-    IoctlOut.op = IoctlOutOp;
-
-    IoctlInOut.type = TK_IOCTL_IN_OUT;
-    IoctlInOut.inSize = 4;
-    IoctlInOut.outSize = 4;
-    IoctlInOut.op = IoctlInOutOp;
-}
+TK_DRIVER_DEFINE(TestBasicDriver) = {
+    .name = "testbasic",
+    .major = TK_TEST_MAJOR,
+    .minor = TK_TEST_BASIC_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &BasicOps
+};
+
+TK_DRIVER_DEFINE(TestDuplexDriver) = {
+    .name = "testduplex",
+    .major = TK_TEST_MAJOR,
+    .minor = TK_TEST_DUPLEX_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_PER_DIRECTION,
+    .ops = &Ops
+};
+
+TK_DRIVER_DEFINE(TestUnlockedDriver) = {
+    .name = "testunlock",
+    .major = TK_TEST_MAJOR,
+    .minor = TK_TEST_UNLOCKED_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_NONE,
+    .ops = &Ops
+};
@@ -0,0 +1,59 @@
+/* Zero driver. Reads fill the buffer with zeroes and writes are discarded, so
+ * the cost of a read is DDF overhead plus one memset. */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/ddf.h"
+#include "tk/status.h"
+
+#include "tk/drivers/zero.h"
+
+static void Open(void * context) {
+    return;
+}
+
+static void Close(void * context) {
+    return;
+}
+
+static int Read(void * context,
+                TKStatus * status,
+                uint8_t * buffer,
+                uint32_t size) {
+    memset(buffer, 0, size);
+
+    *status = TK_OK;
+    return size;
+}
+
+static int Write(void * context,
+                 TKStatus * status,
+                 const uint8_t * buffer,
+                 uint32_t size) {
+    *status = TK_OK;
+    return size;
+}
+
+static const struct TKIoctlInfo * IoctlInfo(uint32_t code) {
+    return NULL;
+}
+
+static const struct TKDriverOps Ops = {
+    .open = Open,
+    .close = Close,
+    .read = Read,
+    .write = Write,
+    .ioctlInfo = IoctlInfo
+};
+
+TK_DRIVER_DEFINE(ZeroDriver) = {
+    .name = "zero",
+    .major = TK_ZERO_MAJOR,
+    .minor = TK_ZERO_MINOR,
+    .minorCount = 1,
+    .concurrency = TK_CONCURRENCY_SERIALIZED,
+    .ops = &Ops
+};
@@ -0,0 +1,268 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "tk/common.h"
+#include "tk/data.h"
+#include "tk/ddf.h"
+#include "tk/events.h"
+#include "tk/thread.h"
+#include "tk/timing.h"
+#include "tk/utility.h"
+
+#ifdef TK_EVENT_TRACING
+
+/* "TKFR" */
+#define FLIGHT_MAGIC (0x544B4652)
+
+static struct TKEvent Events[TK_EVENT_RING_SIZE];
+/* Free-running counts of events recorded, and of events dumped or lost. */
+static uint32_t Recorded;
+static uint32_t Taken;
+static bool Paused;
+
+/* Trigger limits in cycles, 0 if the trigger is disabled. */
+static uint32_t Limits[TK_FLIGHT_TRIGGERS];
+static struct TKFlightRecord FlightRecord TK_NOINIT;
+
+void TKRecordEvent(uint32_t type, uint32_t detail, uint32_t object) {
+    struct TKEvent * event;
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    if (!Paused) {
+        event = &Events[Recorded % TK_EVENT_RING_SIZE];
+        event->timestamp = (uint32_t) TKGetCycles();
+        event->type = type;
+        event->detail = detail;
+        event->object = object;
+        Recorded++;
+    }
+    TKEnableInterrupts(cpsr);
+}
+
+void TKRecordWake(struct TKThread * thread) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    TKRecordEvent(TK_EVENT_WAKE, 0, TK_EVENT_OBJECT(thread));
+    if (!thread->woken) {
+        thread->wokenAt = (uint32_t) TKGetCycles();
+        thread->woken = true;
+    }
+    TKEnableInterrupts(cpsr);
+}
+
+void TKRecordSwitch(struct TKThread * thread) {
+    uint32_t latency;
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    TKRecordEvent(TK_EVENT_SWITCH, 0, TK_EVENT_OBJECT(thread));
+    if (thread->woken) {
+        thread->woken = false;
+        latency = (uint32_t) TKGetCycles() - thread->wokenAt;
+        /* Less important threads are expected to wait behind the rest. */
+        if (thread->priority > TK_PRIORITY_NORMAL) {
+            TKCheckFlightTrigger(TK_FLIGHT_WAKE_LATENCY, latency);
+        }
+    }
+    TKEnableInterrupts(cpsr);
+}
+
+void TKSetFlightTrigger(uint32_t trigger, uint32_t us) {
+    if (trigger >= TK_FLIGHT_TRIGGERS) {
+        return;
+    }
+
+    Limits[trigger] = (uint64_t) us * TKGetCyclesHz() / 1000000;
+}
+
+void TKCheckFlightTrigger(uint32_t trigger, uint32_t value) {
+    if (Limits[trigger] != 0 && value > Limits[trigger]) {
+        TKFreezeEvents(trigger, value);
+    }
+}
+
+static uint32_t FlightCheck(const struct TKFlightRecord * record) {
+    const uint32_t * p;
+    uint32_t sum;
+
+    sum = 0;
+    for (p = (const uint32_t *) record; p < &record->check; p++) {
+        sum = (sum << 1 | sum >> 31) ^ *p;
+    }
+
+    return ~sum;
+}
+
+const struct TKFlightRecord * TKGetFlightRecord(void) {
+    if (FlightRecord.magic != FLIGHT_MAGIC ||
+        FlightRecord.count > TK_FLIGHT_RECORD_SIZE ||
+        FlightRecord.check != FlightCheck(&FlightRecord)) {
+        return NULL;
+    }
+
+    return &FlightRecord;
+}
+
+void TKFreezeEvents(uint32_t trigger, uint32_t value) {
+    uint32_t first;
+    uint32_t cpsr;
+    uint32_t n;
+    uint32_t i;
+
+    cpsr = TKDisableInterrupts();
+
+    /* Keep the first outlier until it has been dumped. */
+    if (TKGetFlightRecord() != NULL) {
+        TKEnableInterrupts(cpsr);
+        return;
+    }
+
+    n = Recorded < TK_FLIGHT_RECORD_SIZE ? Recorded : TK_FLIGHT_RECORD_SIZE;
+    first = Recorded - n;
+    for (i = 0; i < n; i++) {
+        FlightRecord.events[i] = Events[(first + i) % TK_EVENT_RING_SIZE];
+    }
+    FlightRecord.trigger = trigger;
+    FlightRecord.value = value;
+    FlightRecord.count = n;
+    FlightRecord.magic = FLIGHT_MAGIC;
+    FlightRecord.check = FlightCheck(&FlightRecord);
+
+    TKEnableInterrupts(cpsr);
+}
+
+void TKClearFlightRecord(void) {
+    FlightRecord.magic = 0;
+}
+
+uint32_t TKTakeEvents(struct TKEvent * events,
+                      uint32_t count,
+                      uint32_t * lost) {
+    uint32_t cpsr;
+    uint32_t n;
+    uint32_t i;
+
+    cpsr = TKDisableInterrupts();
+
+    /* The ring only keeps the newest events. */
+    *lost = 0;
+    if (Recorded - Taken > TK_EVENT_RING_SIZE) {
+        *lost = Recorded - Taken - TK_EVENT_RING_SIZE;
+        Taken += *lost;
+    }
+
+    n = Recorded - Taken;
+    if (n > count) {
+        n = count;
+    }
+    for (i = 0; i < n; i++) {
+        events[i] = Events[Taken % TK_EVENT_RING_SIZE];
+        Taken++;
+    }
+
+    TKEnableInterrupts(cpsr);
+
+    return n;
+}
+
+/* The cycle rate and the names events refer to. */
+static void PrintNames(void) {
+    struct TKThread * thread;
+    const char * name;
+    uint32_t major;
+    uint32_t minor;
+    uint32_t i;
+
+    TKPrintf("#TKE H %lx\n", TKGetCyclesHz());
+    for (i = 0; i < TK_MAX_THREADS; i++) {
+        thread = TKGetThread(i);
+        if (thread->queue != &FreeQueue) {
+            TKPrintf("#TKE T %x %s\n", TK_EVENT_OBJECT(thread), thread->name);
+        }
+    }
+    for (major = 0; major < TK_MAX_MAJOR; major++) {
+        for (minor = 0; minor < TK_MAX_MINOR; minor++) {
+            name = TKDriverName(major, minor);
+            if (name != NULL) {
+                TKPrintf("#TKE D %lx %s\n", major << 8 | minor, name);
+            }
+        }
+    }
+}
+
+static void PrintEvent(const struct TKEvent * event) {
+    TKPrintf("#TKE E %lx %x %x %x\n",
+             event->timestamp,
+             event->type,
+             event->detail,
+             event->object);
+}
+
+static void Pause(bool paused) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    Paused = paused;
+    TKEnableInterrupts(cpsr);
+}
+
+void TKDumpEvents(void) {
+    struct TKEvent events[8];
+    uint32_t lost;
+    uint32_t total;
+    uint32_t n;
+    uint32_t i;
+
+    Pause(true);
+    PrintNames();
+
+    /* Take a few at a time, so this needs little stack. */
+    total = 0;
+    do {
+        n = TKTakeEvents(events, ARRAYLEN(events), &lost);
+        if (lost > 0) {
+            TKPrintf("#TKE L %lx\n", lost);
+        }
+        for (i = 0; i < n; i++) {
+            PrintEvent(&events[i]);
+        }
+        total += n;
+    } while (n > 0);
+    TKPrintf("#TKE END %lx\n", total);
+
+    Pause(false);
+}
+
+void TKDumpFlightRecord(void) {
+    const struct TKFlightRecord * record;
+    uint32_t i;
+
+    record = TKGetFlightRecord();
+    if (record == NULL) {
+        return;
+    }
+
+    Pause(true);
+    TKPrintf("#TKE F %lx %lx\n", record->trigger, record->value);
+    PrintNames();
+    for (i = 0; i < record->count; i++) {
+        PrintEvent(&record->events[i]);
+    }
+    TKPrintf("#TKE END %lx\n", record->count);
+    TKClearFlightRecord();
+    Pause(false);
+}
+
+void TKResetEvents(void) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    Recorded = 0;
+    Taken = 0;
+    Paused = false;
+    TKEnableInterrupts(cpsr);
+}
+
+#endif
@@ -0,0 +1,139 @@
+/* Flash backends for TKFlashOps: the on-chip flash, and a RAM simulation. */
+
+#include <string.h>
+
+#include "lpc/iap.h"
+#include "lpc/init.h"
+#include "tk/flash.h"
+#include "tk/utility.h"
+
+#define IAP_FLASH_SIZE (TK_IAP_FLASH_SECTORS * TK_IAP_FLASH_SECTOR_SIZE)
+
+static TKStatus IapRead(uint32_t offset, void * buffer, uint32_t size) {
+    if (offset > IAP_FLASH_SIZE || size > IAP_FLASH_SIZE - offset) {
+        return TK_FLASH_ERROR;
+    }
+    memcpy(buffer, (const void *) (TK_IAP_FLASH_BASE + offset), size);
+    return TK_OK;
+}
+
+static TKStatus IapProgram(uint32_t offset, const void * page) {
+    uint32_t address;
+    uint32_t sector;
+    uint32_t cpsr;
+    uint32_t result;
+
+    if (offset % TK_IAP_FLASH_PAGE_SIZE != 0 || offset >= IAP_FLASH_SIZE) {
+        return TK_FLASH_ERROR;
+    }
+    address = TK_IAP_FLASH_BASE + offset;
+    sector = IAPSectorOf(address);
+
+    cpsr = TKDisableInterrupts();
+    result = IAPPrepareSectors(sector, sector);
+    if (result == IAP_CMD_SUCCESS) {
+        result = IAPCopyRamToFlash(address, page, TK_IAP_FLASH_PAGE_SIZE,
+                                   getFcclk() / 1000);
+    }
+    TKEnableInterrupts(cpsr);
+
+    return result == IAP_CMD_SUCCESS ? TK_OK : TK_FLASH_ERROR;
+}
+
+static TKStatus IapErase(uint32_t sector) {
+    uint32_t cpsr;
+    uint32_t result;
+
+    if (sector >= TK_IAP_FLASH_SECTORS) {
+        return TK_FLASH_ERROR;
+    }
+    sector = IAPSectorOf(TK_IAP_FLASH_BASE +
+                         sector * TK_IAP_FLASH_SECTOR_SIZE);
+
+    cpsr = TKDisableInterrupts();
+    result = IAPPrepareSectors(sector, sector);
+    if (result == IAP_CMD_SUCCESS) {
+        result = IAPEraseSectors(sector, sector, getFcclk() / 1000);
+    }
+    TKEnableInterrupts(cpsr);
+
+    return result == IAP_CMD_SUCCESS ? TK_OK : TK_FLASH_ERROR;
+}
+
+static const struct TKFlashOps IapFlashOps = {
+    .sectorSize = TK_IAP_FLASH_SECTOR_SIZE,
+    .sectorCount = TK_IAP_FLASH_SECTORS,
+    .pageSize = TK_IAP_FLASH_PAGE_SIZE,
+    .read = IapRead,
+    .program = IapProgram,
+    .erase = IapErase
+};
+
+const struct TKFlashOps * TKIapFlash(void) {
+    return &IapFlashOps;
+}
+
+static uint8_t SimData[TK_SIM_FLASH_SECTORS * TK_SIM_FLASH_SECTOR_SIZE];
+static uint32_t SimEraseCount[TK_SIM_FLASH_SECTORS];
+
+static TKStatus SimRead(uint32_t offset, void * buffer, uint32_t size) {
+    if (offset + size > sizeof(SimData)) {
+        return TK_FLASH_ERROR;
+    }
+    memcpy(buffer, &SimData[offset], size);
+    return TK_OK;
+}
+
+static TKStatus SimProgram(uint32_t offset, const void * page) {
+    const uint8_t * p = page;
+    int i;
+
+    if (offset % TK_SIM_FLASH_PAGE_SIZE != 0 || offset >= sizeof(SimData)) {
+        return TK_FLASH_ERROR;
+    }
+    /* Like real flash, programming can only clear bits. */
+    for (i = 0; i < TK_SIM_FLASH_PAGE_SIZE; i++) {
+        SimData[offset + i] &= p[i];
+    }
+    return TK_OK;
+}
+
+static TKStatus SimErase(uint32_t sector) {
+    if (sector >= TK_SIM_FLASH_SECTORS) {
+        return TK_FLASH_ERROR;
+    }
+    memset(&SimData[sector * TK_SIM_FLASH_SECTOR_SIZE], 0xFF,
+           TK_SIM_FLASH_SECTOR_SIZE);
+    SimEraseCount[sector]++;
+    return TK_OK;
+}
+
+static const struct TKFlashOps SimFlashOps = {
+    .sectorSize = TK_SIM_FLASH_SECTOR_SIZE,
+    .sectorCount = TK_SIM_FLASH_SECTORS,
+    .pageSize = TK_SIM_FLASH_PAGE_SIZE,
+    .read = SimRead,
+    .program = SimProgram,
+    .erase = SimErase
+};
+
+const struct TKFlashOps * TKSimFlash(void) {
+    return &SimFlashOps;
+}
+
+void TKSimFlashReset(void) {
+    int i;
+
+    memset(SimData, 0xFF, sizeof(SimData));
+    for (i = 0; i < TK_SIM_FLASH_SECTORS; i++) {
+        SimEraseCount[i] = 0;
+    }
+}
+
+uint8_t * TKSimFlashData(void) {
+    return SimData;
+}
+
+uint32_t TKSimFlashEraseCount(uint32_t sector) {
+    return SimEraseCount[sector];
+}
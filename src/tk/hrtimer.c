@@ -0,0 +1,214 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/data.h"
+#include "tk/events.h"
+#include "tk/hrtimer.h"
+#include "tk/thread.h"
+#include "tk/timing.h"
+#include "tk/utility.h"
+
+/* Match Control Register (MCR) bits */
+#define MCR_MR1_INTERRUPT_BIT BIT(3)
+
+/* Pending timers, soonest first. Only touched with interrupts disabled. */
+static struct TKHrTimer * Pending;
+
+/* Set while _TKExpireHrTimers runs callbacks. A timer started from a callback
+ * is only queued, and the loop that ran the callback fires or arms it, so a
+ * callback that keeps restarting its timer doesn't recurse.
+ */
+static bool Expiring;
+
+/* Threads blocked in TKHrSleep. */
+static struct TKThreadQueue Sleepers;
+
+void TKInitHrTimers(void) {
+    Pending = NULL;
+    Expiring = false;
+    Sleepers.head = NULL;
+}
+
+static void Insert(struct TKHrTimer * timer) {
+    struct TKHrTimer ** p;
+
+    /* Go past timers with the same deadline, so they fire in the order they
+     * were started.
+     */
+    p = &Pending;
+    while (*p != NULL && (*p)->deadline <= timer->deadline) {
+        p = &(*p)->next;
+    }
+    timer->next = *p;
+    *p = timer;
+}
+
+uint32_t _TKExpireHrTimers(uint64_t now) {
+    struct TKHrTimer * timer;
+    uint32_t fired;
+
+    fired = 0;
+    Expiring = true;
+    while (Pending != NULL && Pending->deadline <= now) {
+        timer = Pending;
+        Pending = timer->next;
+        timer->next = NULL;
+        timer->pending = false;
+
+        /* Last, since the callback may start the timer again. */
+        timer->callback(timer->data);
+        fired++;
+    }
+    Expiring = false;
+
+    return fired;
+}
+
+/* Fire what is due, and point MR1 at the soonest timer left if it is due
+ * before the next tick. Call with interrupts disabled.
+ */
+static void Arm(void) {
+    uint32_t count;
+    uint32_t match;
+    uint64_t now;
+    uint64_t remaining;
+
+    for (;;) {
+        _TKExpireHrTimers(TKGetCycles());
+        if (Pending == NULL) {
+            break;
+        }
+
+        /* Timer0 runs at the cycle rate, counting from 0 up to MR0 and
+         * resetting on the tick.
+         */
+        count = READREG32(T0TC);
+        now = TKGetCycles();
+        if (Pending->deadline <= now) {
+            continue;
+        }
+        remaining = Pending->deadline - now;
+        if (remaining > READREG32(T0MR0) - count) {
+            /* The tick before the deadline will arm it. */
+            break;
+        }
+
+        match = count + (uint32_t) remaining;
+        WRITEREG32(T0MR1, match);
+        WRITEREG16(T0MCR, READREG16(T0MCR) | MCR_MR1_INTERRUPT_BIT);
+
+        /* A match only fires on the exact count, so if the counter got past
+         * it while this was set up, go around and fire the timer here. If the
+         * counter reset for a tick instead, the tick arms the timer again.
+         */
+        if (READREG32(T0TC) < match) {
+            return;
+        }
+    }
+
+    WRITEREG16(T0MCR, READREG16(T0MCR) & ~MCR_MR1_INTERRUPT_BIT);
+}
+
+TKStatus TKStartHrTimerAt(struct TKHrTimer * timer,
+                          uint64_t deadline,
+                          TKHrTimerCallback callback,
+                          void * data) {
+    uint32_t cpsr;
+
+    if (timer == NULL || callback == NULL) {
+        return TK_NULL;
+    }
+
+    cpsr = TKDisableInterrupts();
+    if (timer->pending) {
+        TKEnableInterrupts(cpsr);
+        return TK_BUSY;
+    }
+
+    timer->deadline = deadline;
+    timer->callback = callback;
+    timer->data = data;
+    timer->pending = true;
+    Insert(timer);
+    if (Pending == timer && !Expiring) {
+        Arm();
+    }
+    TKEnableInterrupts(cpsr);
+
+    return TK_OK;
+}
+
+TKStatus TKStartHrTimer(struct TKHrTimer * timer,
+                        uint32_t us,
+                        TKHrTimerCallback callback,
+                        void * data) {
+    return TKStartHrTimerAt(timer,
+                            TKGetCycles() + TKUsToCycles(us),
+                            callback,
+                            data);
+}
+
+TKStatus TKCancelHrTimer(struct TKHrTimer * timer) {
+    struct TKHrTimer ** p;
+    uint32_t cpsr;
+
+    if (timer == NULL) {
+        return TK_NULL;
+    }
+
+    cpsr = TKDisableInterrupts();
+    for (p = &Pending; *p != NULL; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            timer->next = NULL;
+            timer->pending = false;
+            TKEnableInterrupts(cpsr);
+
+            /* If MR1 was armed for it, the match just finds nothing due. */
+            return TK_OK;
+        }
+    }
+    TKEnableInterrupts(cpsr);
+
+    return TK_UNEXPECTED;
+}
+
+static void WakeSleeper(void * data) {
+    struct TKThread * thread;
+
+    thread = (struct TKThread *) data;
+    TKRemoveThread(thread);
+    TKAddThread(&RunQueue, thread);
+    TK_EVENT_WAKE(thread);
+}
+
+TKStatus TKHrSleep(uint32_t us) {
+    struct TKHrTimer timer;
+    struct TKThread * thread;
+    uint32_t cpsr;
+
+    thread = CurrentThread;
+    if (thread == NULL) {
+        return TK_UNEXPECTED;
+    }
+
+    /* Off the run queue before the timer can fire. The timer stays on this
+     * stack, which is fine since the thread can't run again until it fires.
+     */
+    timer.pending = false;
+    cpsr = TKDisableInterrupts();
+    TKRemoveThread(thread);
+    TKAddThread(&Sleepers, thread);
+    TKStartHrTimer(&timer, us, WakeSleeper, thread);
+    TKEnableInterrupts(cpsr);
+
+    _TKYieldThread(thread);
+
+    return TK_OK;
+}
+
+void TKRunHrTimers(void) {
+    Arm();
+}
@@ -1,18 +1,43 @@
 #include <stddef.h>
 
+#include "tk/block.h"
 #include "tk/ddf.h"
+#include "tk/hrtimer.h"
 #include "tk/init.h"
+#include "tk/log.h"
+#include "tk/probe.h"
 #include "tk/timing.h"
+#include "tk/trace.h"
 #include "tk/thread.h"
 #include "tk/utility.h"
 
 extern void TKFirstContextSwitch(int * thread);
 
 void TKInit(void) {
+    TKInitProbes();
     TKInitKernelData();
     TKInitThreadData();
+    TKInitHrTimers();
     TKInitDrivers();
+    TKInitBlockCache();
     TKInitPrintData();
+    TKInitLog();
+    TKInitTrace();
+
+    /* Most builds have no driver that autosuspends, so don't spend a thread
+     * on it.
+     */
+    if (TKDriverAutosuspendUsed() &&
+        TKCreateThread("pm",
+                       TK_PRIORITY_NORMAL,
+                       TKAutosuspendThread,
+                       NULL) != TK_OK) {
+        TKFatal("could not create the autosuspend thread");
+    }
+
+    if (TKCreateThread("log", TK_LOG_PRIORITY, TKLogThread, NULL) != TK_OK) {
+        TKFatal("could not create the log drain thread");
+    }
 }
 
 void TKStart(void) {
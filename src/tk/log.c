@@ -0,0 +1,187 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tk/common.h"
+#include "tk/log.h"
+#include "tk/semaphore.h"
+#include "tk/trace.h"
+#include "tk/utility.h"
+
+static uint8_t Ring[TK_LOG_RING_SIZE];
+/* Free-running; producers move tail with interrupts disabled, and only the
+ * drain thread moves head.
+ */
+static volatile uint32_t Head;
+static volatile uint32_t Tail;
+static struct TKLogStats Stats;
+/* The dropped message count at the last drop note. */
+static uint32_t ReportedDrops;
+/* Set while the drain thread is waiting on Pending for more to print. */
+static bool DrainWaiting;
+static struct TKSemaphore Pending;
+
+void TKInitLog(void) {
+    Head = 0;
+    Tail = 0;
+    memset(&Stats, 0, sizeof(Stats));
+    ReportedDrops = 0;
+    DrainWaiting = false;
+    TKCreateSemaphore(&Pending, 0);
+}
+
+void TKLog(const char * s) {
+    TKLogStrings(&s, 1);
+}
+
+void TKLogStrings(const char * const * strings, uint32_t count) {
+    uint32_t sizes[TK_LOG_MAX_STRINGS];
+    uint32_t cpsr;
+    uint32_t total;
+    uint32_t offset;
+    uint32_t first;
+    uint32_t size;
+    uint32_t i;
+    bool wake;
+
+    if (strings == NULL) {
+        return;
+    }
+
+    /* Measure each string once, with interrupts enabled. The copy below uses
+     * the same sizes, so it fills exactly the space claimed even if a string
+     * changes in the meantime.
+     */
+    total = 0;
+    for (i = 0; i < count && i < TK_LOG_MAX_STRINGS; i++) {
+        sizes[i] = strings[i] != NULL ? strlen(strings[i]) : 0;
+        total += sizes[i];
+    }
+
+    /* ARMv4 has no atomic compare-and-swap, so claiming space and copying in
+     * is done with interrupts disabled. The copy is bounded by the ring size
+     * and is a memcpy, so this costs a few microseconds rather than the
+     * milliseconds the UART would take.
+     */
+    cpsr = TKDisableInterrupts();
+    if (count > TK_LOG_MAX_STRINGS ||
+        total > TK_LOG_RING_SIZE - (Tail - Head)) {
+        Stats.droppedMessages++;
+        Stats.droppedBytes += total;
+        count = 0;
+    }
+    else {
+        Stats.messages++;
+        Stats.bytes += total;
+    }
+
+    for (i = 0; i < count; i++) {
+        size = sizes[i];
+        if (size == 0) {
+            continue;
+        }
+
+        offset = Tail % TK_LOG_RING_SIZE;
+        first = TK_LOG_RING_SIZE - offset;
+        if (first > size) {
+            first = size;
+        }
+        memcpy(&Ring[offset], strings[i], first);
+        memcpy(Ring, &strings[i][first], size - first);
+        Tail += size;
+    }
+
+    /* A drop wakes the drain thread too, so it gets reported. */
+    wake = DrainWaiting;
+    DrainWaiting = false;
+    TKEnableInterrupts(cpsr);
+
+    /* Waking a thread of equal or lower priority doesn't switch to it, so
+     * logging from a normal priority thread doesn't wait on the drain.
+     */
+    if (wake) {
+        TKUpSemaphore(&Pending);
+    }
+}
+
+void TKLogGetStats(struct TKLogStats * stats) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    *stats = Stats;
+    TKEnableInterrupts(cpsr);
+}
+
+uint32_t _TKLogDrain(void (*print)(struct TKIoVec * vec, uint32_t count)) {
+    char decimal[TK_DECIMAL_BUFFER_SIZE];
+    struct TKIoVec vec[3];
+    uint32_t dropped;
+    uint32_t offset;
+    uint32_t first;
+    uint32_t n;
+
+    /* Producers only ever add to the ring past tail, so everything up to this
+     * snapshot stays put while it is printed.
+     */
+    n = Tail - Head;
+    if (n > 0) {
+        offset = Head % TK_LOG_RING_SIZE;
+        first = TK_LOG_RING_SIZE - offset;
+        if (first > n) {
+            first = n;
+        }
+        vec[0].buffer = &Ring[offset];
+        vec[0].size = first;
+        vec[1].buffer = Ring;
+        vec[1].size = n - first;
+        print(vec, vec[1].size > 0 ? 2 : 1);
+        Head += n;
+    }
+
+    dropped = Stats.droppedMessages;
+    if (dropped != ReportedDrops) {
+        vec[0].buffer = (uint8_t *) "[log: ";
+        vec[0].size = strlen("[log: ");
+        vec[1].buffer = (uint8_t *) TKFormatDecimal(dropped - ReportedDrops,
+                                                    decimal);
+        vec[1].size = strlen((char *) vec[1].buffer);
+        vec[2].buffer = (uint8_t *) " messages dropped]\n";
+        vec[2].size = strlen(" messages dropped]\n");
+        print(vec, ARRAYLEN(vec));
+        ReportedDrops = dropped;
+    }
+
+    return n;
+}
+
+uint32_t TKLogDrain(void) {
+    return _TKLogDrain(TKPrintv);
+}
+
+void TKLogThread(void * p) {
+    uint32_t cpsr;
+
+    for (;;) {
+        TKLogDrain();
+        TKTraceDrain();
+
+        /* Check and set the flag together, so a message logged in between
+         * still wakes us.
+         */
+        cpsr = TKDisableInterrupts();
+        if (Tail != Head || Stats.droppedMessages != ReportedDrops) {
+            TKEnableInterrupts(cpsr);
+            continue;
+        }
+        DrainWaiting = true;
+        TKEnableInterrupts(cpsr);
+
+        /* Tracing is too cheap to wake us, and may be done from interrupt
+         * handlers, so look for trace records every so often as well.
+         */
+        TKDownSemaphoreTimeout(&Pending, TK_LOG_TRACE_INTERVAL);
+        cpsr = TKDisableInterrupts();
+        DrainWaiting = false;
+        TKEnableInterrupts(cpsr);
+    }
+}
@@ -0,0 +1,349 @@
+/* Append-only record store on flash. See tk/logstore.h for the design. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "tk/flash.h"
+#include "tk/logstore.h"
+#include "tk/semaphore.h"
+
+/* "TKLG" */
+#define LOG_MAGIC (0x544B4C47)
+
+/* A record whose length reads as this is blank flash. */
+#define ERASED_LENGTH (0xFFFF)
+
+#define PAD4(x) (((x) + 3) & ~3)
+
+struct SectorHeader {
+    uint32_t magic;
+    uint32_t sequence;
+};
+
+/* Records are word-aligned, so this never straddles a page. */
+struct RecordHeader {
+    uint16_t length;
+    uint16_t check;
+};
+
+static uint32_t RoundUp(uint32_t x, uint32_t unit) {
+    return (x + unit - 1) / unit * unit;
+}
+
+/* A Fletcher-16 sum, seeded with the length so torn headers are caught. */
+static void ChecksumInit(uint32_t sums[2], uint16_t length) {
+    sums[0] = (length & 0xFF) % 255;
+    sums[1] = ((length >> 8) + sums[0]) % 255;
+}
+
+static void ChecksumAdd(uint32_t sums[2], const uint8_t * p, uint32_t size) {
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        sums[0] = (sums[0] + p[i]) % 255;
+        sums[1] = (sums[1] + sums[0]) % 255;
+    }
+}
+
+static uint16_t ChecksumValue(uint32_t sums[2]) {
+    return (uint16_t) ((sums[1] << 8) | sums[0]);
+}
+
+/*
+ * Read the record at *offset in a sector and move *offset past it. Page tails
+ * left blank by a flush are skipped, and so are pages holding a bad record,
+ * which are most likely torn by a reset mid-write. At the end of the sector's
+ * records, TK_LOG_END is returned and *offset is left at the first blank page,
+ * or the end of the sector.
+ */
+static TKStatus ReadRecord(struct TKLogStore * log,
+                           uint32_t sector,
+                           uint32_t * offset,
+                           uint8_t * buffer,
+                           uint32_t size,
+                           uint32_t * length) {
+    const struct TKFlashOps * flash = log->flash;
+    uint32_t base = sector * flash->sectorSize;
+    struct RecordHeader header;
+    uint8_t chunk[16];
+    uint32_t sums[2];
+    uint32_t done;
+    uint32_t n;
+    uint32_t off;
+    TKStatus status;
+
+    for (off = *offset; ; off = RoundUp(off + 1, flash->pageSize)) {
+        if (off + sizeof(header) > flash->sectorSize) {
+            *offset = flash->sectorSize;
+            return TK_LOG_END;
+        }
+        status = flash->read(base + off, &header, sizeof(header));
+        if (status != TK_OK) {
+            return status;
+        }
+        if (header.length == ERASED_LENGTH) {
+            if (off % flash->pageSize == 0) {
+                *offset = off;
+                return TK_LOG_END;
+            }
+            continue;
+        }
+        if (off + sizeof(header) + header.length > flash->sectorSize) {
+            continue;
+        }
+
+        ChecksumInit(sums, header.length);
+        for (done = 0; done < header.length; done += n) {
+            n = header.length - done;
+            if (n > sizeof(chunk)) {
+                n = sizeof(chunk);
+            }
+            status = flash->read(base + off + sizeof(header) + done, chunk, n);
+            if (status != TK_OK) {
+                return status;
+            }
+            ChecksumAdd(sums, chunk, n);
+            if (done < size) {
+                memcpy(&buffer[done], chunk,
+                       done + n <= size ? n : size - done);
+            }
+        }
+        if (ChecksumValue(sums) == header.check) {
+            break;
+        }
+    }
+
+    *length = header.length;
+    *offset = off + sizeof(header) + PAD4(header.length);
+    return TK_OK;
+}
+
+/* Program the page buffer, padding it with blank flash. */
+static TKStatus FlushPage(struct TKLogStore * log) {
+    const struct TKFlashOps * flash = log->flash;
+    TKStatus status;
+
+    memset(&log->page[log->fill], 0xFF, flash->pageSize - log->fill);
+    status = flash->program(log->sector * flash->sectorSize + log->offset,
+                            log->page);
+    log->offset += flash->pageSize;
+    log->fill = 0;
+    return status;
+}
+
+/* Erase a sector and start writing to it. Its header goes out with its first
+ * page, so a sector erased just before a reset is simply ignored at boot.
+ */
+static TKStatus StartSector(struct TKLogStore * log,
+                            uint32_t sector,
+                            uint32_t sequence) {
+    struct SectorHeader header;
+    TKStatus status;
+
+    status = log->flash->erase(sector);
+    if (status != TK_OK) {
+        return status;
+    }
+
+    log->sector = sector;
+    log->sequence = sequence;
+    log->offset = 0;
+    header.magic = LOG_MAGIC;
+    header.sequence = sequence;
+    memcpy(log->page, &header, sizeof(header));
+    log->fill = sizeof(header);
+    return TK_OK;
+}
+
+/* Move on to the next sector, reclaiming the oldest if the store is full. */
+static TKStatus NextSector(struct TKLogStore * log) {
+    uint32_t next;
+    TKStatus status;
+
+    if (log->fill > 0) {
+        status = FlushPage(log);
+        if (status != TK_OK) {
+            return status;
+        }
+    }
+
+    next = (log->sector + 1) % log->flash->sectorCount;
+    if (next == log->oldest) {
+        log->oldest = (log->oldest + 1) % log->flash->sectorCount;
+    }
+    return StartSector(log, next, log->sequence + 1);
+}
+
+/* Add bytes to the page buffer, programming each page as it fills. */
+static TKStatus Put(struct TKLogStore * log, const uint8_t * p, uint32_t size) {
+    uint32_t n;
+    TKStatus status;
+
+    while (size > 0) {
+        n = log->flash->pageSize - log->fill;
+        if (n > size) {
+            n = size;
+        }
+        if (p != NULL) {
+            memcpy(&log->page[log->fill], p, n);
+            p += n;
+        }
+        else {
+            memset(&log->page[log->fill], 0, n);
+        }
+        log->fill += n;
+        size -= n;
+
+        if (log->fill == log->flash->pageSize) {
+            status = FlushPage(log);
+            if (status != TK_OK) {
+                return status;
+            }
+        }
+    }
+
+    return TK_OK;
+}
+
+TKStatus TKLogOpen(struct TKLogStore * log, const struct TKFlashOps * flash) {
+    struct SectorHeader header;
+    bool found;
+    uint32_t newestSequence = 0;
+    uint32_t oldestSequence = 0;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t s;
+    TKStatus status;
+
+    if (flash->pageSize > TK_LOG_MAX_PAGE_SIZE ||
+        flash->pageSize < sizeof(struct SectorHeader) ||
+        flash->pageSize % 4 != 0 ||
+        flash->sectorSize % flash->pageSize != 0 ||
+        flash->sectorCount < 2) {
+        return TK_UNSUPPORTED;
+    }
+
+    log->flash = flash;
+    log->fill = 0;
+    TKCreateSemaphore(&log->sem, 1);
+
+    found = false;
+    for (s = 0; s < flash->sectorCount; s++) {
+        status = flash->read(s * flash->sectorSize, &header, sizeof(header));
+        if (status != TK_OK) {
+            return status;
+        }
+        if (header.magic != LOG_MAGIC) {
+            continue;
+        }
+        if (!found || header.sequence > newestSequence) {
+            log->sector = s;
+            newestSequence = header.sequence;
+        }
+        if (!found || header.sequence < oldestSequence) {
+            log->oldest = s;
+            oldestSequence = header.sequence;
+        }
+        found = true;
+    }
+
+    if (!found) {
+        log->oldest = 0;
+        return StartSector(log, 0, 1);
+    }
+
+    /* Only the newest sector can be partly written. */
+    log->sequence = newestSequence;
+    offset = sizeof(header);
+    do {
+        status = ReadRecord(log, log->sector, &offset, NULL, 0, &length);
+    } while (status == TK_OK);
+    if (status != TK_LOG_END) {
+        return status;
+    }
+
+    log->offset = offset;
+    return TK_OK;
+}
+
+TKStatus TKLogAppend(struct TKLogStore * log, const void * data, uint32_t size) {
+    const struct TKFlashOps * flash = log->flash;
+    struct RecordHeader header;
+    uint32_t sums[2];
+    TKStatus status;
+
+    if (size > flash->sectorSize - sizeof(struct SectorHeader) -
+               sizeof(header)) {
+        return TK_LOG_RECORD_TOO_BIG;
+    }
+
+    header.length = size;
+    ChecksumInit(sums, header.length);
+    ChecksumAdd(sums, data, size);
+    header.check = ChecksumValue(sums);
+
+    TKDownSemaphore(&log->sem);
+    status = TK_OK;
+    if (log->offset + log->fill + sizeof(header) + PAD4(size) >
+        flash->sectorSize) {
+        status = NextSector(log);
+    }
+    if (status == TK_OK) {
+        status = Put(log, (const uint8_t *) &header, sizeof(header));
+    }
+    if (status == TK_OK) {
+        status = Put(log, data, size);
+    }
+    if (status == TK_OK) {
+        status = Put(log, NULL, PAD4(size) - size);
+    }
+    TKUpSemaphore(&log->sem);
+
+    return status;
+}
+
+TKStatus TKLogFlush(struct TKLogStore * log) {
+    TKStatus status = TK_OK;
+
+    TKDownSemaphore(&log->sem);
+    if (log->fill > 0) {
+        status = FlushPage(log);
+    }
+    TKUpSemaphore(&log->sem);
+
+    return status;
+}
+
+void TKLogRewind(struct TKLogStore * log, struct TKLogCursor * cursor) {
+    uint32_t count = log->flash->sectorCount;
+
+    TKDownSemaphore(&log->sem);
+    cursor->sector = log->oldest;
+    cursor->offset = sizeof(struct SectorHeader);
+    cursor->sectorsLeft = (log->sector + count - log->oldest) % count;
+    TKUpSemaphore(&log->sem);
+}
+
+TKStatus TKLogRead(struct TKLogStore * log,
+                   struct TKLogCursor * cursor,
+                   void * buffer,
+                   uint32_t size,
+                   uint32_t * length) {
+    TKStatus status;
+
+    TKDownSemaphore(&log->sem);
+    for (;;) {
+        status = ReadRecord(log, cursor->sector, &cursor->offset, buffer, size,
+                            length);
+        if (status != TK_LOG_END || cursor->sectorsLeft == 0) {
+            break;
+        }
+        cursor->sector = (cursor->sector + 1) % log->flash->sectorCount;
+        cursor->offset = sizeof(struct SectorHeader);
+        cursor->sectorsLeft--;
+    }
+    TKUpSemaphore(&log->sem);
+
+    return status;
+}
@@ -0,0 +1,80 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "tk/probe.h"
+#include "tk/utility.h"
+
+/* Bounds of the .tk_probes section, from the linker script. */
+extern const struct TKProbe __tk_probes_start[];
+extern const struct TKProbe __tk_probes_end[];
+
+static uint32_t ToUs(uint32_t cycles) {
+    return (uint32_t) TKCyclesToUs(cycles);
+}
+
+void TKInitProbes(void) {
+    const struct TKProbe * probe;
+
+    for (probe = __tk_probes_start; probe < __tk_probes_end; probe++) {
+        TKInitInstrumentData(probe->name, probe->data);
+    }
+}
+
+uint32_t TKProbeStart(void) {
+    return (uint32_t) TKGetCycles();
+}
+
+void TKProbeStop(const struct TKProbe * probe, uint32_t start) {
+    uint32_t cpsr;
+    uint32_t delta;
+
+    delta = (uint32_t) TKGetCycles() - start;
+
+    /* The instrumentation data needs a single writer that readers can't
+     * preempt. Probes may be hit by several threads, so make each update
+     * atomic instead; readers still never disable interrupts.
+     */
+    cpsr = TKDisableInterrupts();
+    _TKRecordInstrumentSample(probe->data, delta);
+    TKEnableInterrupts(cpsr);
+}
+
+const struct TKProbe * TKFindProbe(const char * name) {
+    const struct TKProbe * probe;
+
+    for (probe = __tk_probes_start; probe < __tk_probes_end; probe++) {
+        if (strcmp(probe->name, name) == 0) {
+            return probe;
+        }
+    }
+
+    return NULL;
+}
+
+void TKDumpAllProbes(bool reset) {
+    const struct TKProbe * probe;
+    struct TKInstrumentData snapshot;
+
+    probe = __tk_probes_start;
+    if (probe == __tk_probes_end) {
+        return;
+    }
+
+    TKPrintf("%-16s %8s %6s %6s %6s %6s %6s (us)\n",
+             "probe", "count", "min", "p50", "p99", "p99.9", "max");
+    for (; probe < __tk_probes_end; probe++) {
+        TKSnapshotInstrumentData(probe->data, &snapshot, reset);
+        if (snapshot.count == 0) {
+            TKPrintf("%-16s %8lu\n", probe->name, snapshot.count);
+            continue;
+        }
+        TKPrintf("%-16s %8lu %6lu %6lu %6lu %6lu %6lu\n",
+                 probe->name,
+                 snapshot.count,
+                 ToUs(snapshot.min),
+                 ToUs(TKInstrumentPercentile(&snapshot, 500)),
+                 ToUs(TKInstrumentPercentile(&snapshot, 990)),
+                 ToUs(TKInstrumentPercentile(&snapshot, 999)),
+                 ToUs(snapshot.max));
+    }
+}
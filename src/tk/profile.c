@@ -0,0 +1,259 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "lpc/lpc2378.h"
+
+#include "tk/data.h"
+#include "tk/events.h"
+#include "tk/profile.h"
+#include "tk/thread.h"
+#include "tk/timing.h"
+#include "tk/utility.h"
+
+#ifdef TK_PROFILING
+
+/* Match Control Register (MCR) bits */
+#define MCR_MR2_INTERRUPT_BIT BIT(6)
+
+/* Where LR and PC are in the frame the context switch code saves, which holds
+ * CPSR, r0-r12, LR and PC from the bottom up (see TKInitStack).
+ */
+#define FRAME_LR (14)
+#define FRAME_PC (15)
+
+/* How many slots a sample tries before it is dropped, which bounds the time
+ * it takes.
+ */
+#define MAX_PROBES (8)
+
+static struct TKProfileEntry Entries[TK_PROFILE_ENTRIES];
+static uint32_t Dropped;
+static bool Paused;
+
+/* The sampling rate, and the mean gap between samples in cycles; both 0
+ * while the profiler is stopped.
+ */
+static uint32_t Hz;
+static uint32_t Interval;
+static uint32_t Seed;
+
+/* Set when the next sample is due after the current tick period, with the
+ * counts it is due after the start of the next one.
+ */
+static bool Waiting;
+static uint32_t Carry;
+
+bool _TKRecordProfileSample(uint32_t pc, uint32_t lr, uint16_t thread) {
+    struct TKProfileEntry * entry;
+    uint32_t slot;
+    uint32_t i;
+
+    slot = (pc ^ (lr << 7 | lr >> 25) ^ thread) * 2654435761UL >> 16;
+    for (i = 0; i < MAX_PROBES; i++) {
+        entry = &Entries[(slot + i) % TK_PROFILE_ENTRIES];
+        if (entry->count == 0) {
+            entry->pc = pc;
+            entry->lr = lr;
+            entry->thread = thread;
+        }
+        else if (entry->pc != pc ||
+                 entry->lr != lr ||
+                 entry->thread != thread) {
+            continue;
+        }
+        entry->count++;
+        return true;
+    }
+
+    Dropped++;
+    return false;
+}
+
+static void Sample(const uint32_t * frame) {
+    if (!Paused) {
+        _TKRecordProfileSample(frame[FRAME_PC],
+                               frame[FRAME_LR],
+                               TK_EVENT_OBJECT(CurrentThread));
+    }
+}
+
+/* A gap spread evenly over half to one and a half intervals, so samples
+ * don't lock onto anything periodic.
+ */
+static uint32_t NextDelay(void) {
+    /* xorshift32 */
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+
+    return Interval / 2 + (uint32_t) ((uint64_t) Seed * Interval >> 32);
+}
+
+/* Point MR2 a delay past a Timer0 count, or if that is after the tick, note
+ * how far into the next tick period it is. Call with interrupts disabled.
+ * Returns false if the counter got past the match while it was set up.
+ */
+static bool Schedule(uint32_t count, uint32_t delay) {
+    uint32_t left;
+    uint32_t match;
+
+    /* Timer0 runs at the cycle rate, counting from 0 up to MR0 and resetting
+     * on the tick.
+     */
+    left = READREG32(T0MR0) - count;
+    if (delay > left) {
+        WRITEREG16(T0MCR, READREG16(T0MCR) & ~MCR_MR2_INTERRUPT_BIT);
+        Carry = delay - left - 1;
+        Waiting = true;
+        return true;
+    }
+
+    match = count + delay;
+    WRITEREG32(T0MR2, match);
+    WRITEREG16(T0MCR, READREG16(T0MCR) | MCR_MR2_INTERRUPT_BIT);
+    Waiting = false;
+
+    /* A match only fires on the exact count. If the counter reset for a tick
+     * instead, the sample is just taken a little late in the next period.
+     */
+    return READREG32(T0TC) < match;
+}
+
+static void SampleAndSchedule(const uint32_t * frame) {
+    do {
+        Sample(frame);
+    } while (!Schedule(READREG32(T0TC), NextDelay()));
+}
+
+void TKProfileInterrupt(void * stackPointer, uint32_t matches) {
+    uint32_t period;
+
+    if (Interval == 0) {
+        return;
+    }
+
+    /* The tick first: if MR2 matched too, it was armed, so this does
+     * nothing.
+     */
+    if ((matches & TK_TIMER_TICK_MATCH) && Waiting) {
+        period = READREG32(T0MR0) + 1;
+        if (Carry >= period) {
+            Carry -= period;
+        }
+        else if (!Schedule(0, Carry)) {
+            SampleAndSchedule(stackPointer);
+        }
+    }
+
+    if (matches & TK_TIMER_PROFILE_MATCH) {
+        SampleAndSchedule(stackPointer);
+    }
+}
+
+TKStatus TKStartProfiler(uint32_t hz) {
+    uint32_t cpsr;
+
+    if (hz == 0 || hz > TK_PROFILE_MAX_HZ) {
+        return TK_UNSUPPORTED;
+    }
+
+    cpsr = TKDisableInterrupts();
+    Hz = hz;
+    Interval = TKGetCyclesHz() / hz;
+    if (Seed == 0) {
+        Seed = (uint32_t) TKGetCycles() | 1;
+    }
+    while (!Schedule(READREG32(T0TC), NextDelay())) {
+    }
+    TKEnableInterrupts(cpsr);
+
+    return TK_OK;
+}
+
+void TKStopProfiler(void) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    WRITEREG16(T0MCR, READREG16(T0MCR) & ~MCR_MR2_INTERRUPT_BIT);
+    Hz = 0;
+    Interval = 0;
+    Waiting = false;
+    TKEnableInterrupts(cpsr);
+}
+
+static void Pause(bool paused) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    Paused = paused;
+    TKEnableInterrupts(cpsr);
+}
+
+uint32_t TKGetProfile(struct TKProfileEntry * entries,
+                      uint32_t count,
+                      uint32_t * dropped) {
+    uint32_t n;
+    uint32_t i;
+
+    Pause(true);
+    n = 0;
+    for (i = 0; i < TK_PROFILE_ENTRIES && n < count; i++) {
+        if (Entries[i].count > 0) {
+            entries[n++] = Entries[i];
+        }
+    }
+    *dropped = Dropped;
+    Pause(false);
+
+    return n;
+}
+
+void TKDumpProfile(bool reset) {
+    const struct TKProfileEntry * entry;
+    struct TKThread * thread;
+    uint32_t samples;
+    uint32_t i;
+
+    Pause(true);
+    TKPrintf("#TKP H %lx\n", Hz);
+    for (i = 0; i < TK_MAX_THREADS; i++) {
+        thread = TKGetThread(i);
+        if (thread->queue != &FreeQueue) {
+            TKPrintf("#TKP T %x %s\n", TK_EVENT_OBJECT(thread), thread->name);
+        }
+    }
+
+    samples = 0;
+    for (i = 0; i < TK_PROFILE_ENTRIES; i++) {
+        entry = &Entries[i];
+        if (entry->count > 0) {
+            TKPrintf("#TKP S %lx %lx %x %lx\n",
+                     entry->pc,
+                     entry->lr,
+                     entry->thread,
+                     entry->count);
+            samples += entry->count;
+        }
+    }
+    if (Dropped > 0) {
+        TKPrintf("#TKP L %lx\n", Dropped);
+    }
+    TKPrintf("#TKP END %lx\n", samples);
+
+    if (reset) {
+        TKResetProfile();
+    }
+    Pause(false);
+}
+
+void TKResetProfile(void) {
+    uint32_t cpsr;
+
+    cpsr = TKDisableInterrupts();
+    memset(Entries, 0, sizeof(Entries));
+    Dropped = 0;
+    TKEnableInterrupts(cpsr);
+}
+
+#endif
@@ -1,10 +1,15 @@
 #include <stddef.h>
 
 #include "tk/data.h"
+#include "tk/events.h"
+#include "tk/probe.h"
 #include "tk/semaphore.h"
 #include "tk/thread.h"
 #include "tk/utility.h"
 
+TK_PROBE_DEFINE(SemaphoreUp);
+TK_PROBE_DEFINE(SemaphoreDown);
+
 TKStatus TKCreateSemaphore(struct TKSemaphore * sem, uint32_t count) {
     if (sem == NULL) {
         return TK_UNEXPECTED;
@@ -28,27 +33,58 @@ TKStatus _TKUpSemaphore(struct TKSemaphore * sem,
     }
 
     TKEnterCriticalSection(&sem->cs);
-    if (sem->count == 0 && sem->waitQueue.head != NULL) {
-        waiter = TKPopThread(&sem->waitQueue);
-        cpsr = TKDisableInterrupts();
+
+    /* Look for a waiter with interrupts off, since the tick can time one out
+     * and take it off the wait queue at any point before that.
+     */
+    cpsr = TKDisableInterrupts();
+    waiter = NULL;
+    if (sem->count == 0) {
+        /* Hand the semaphore to the highest priority waiter rather than the
+         * oldest one. Waiters of equal priority are still woken in FIFO order,
+         * since TKPickThread takes the first best match from the head and
+         * TKRemoveThread keeps the order of the rest.
+         */
+        waiter = TKPickThread(&sem->waitQueue);
+    }
+    if (waiter != NULL) {
+        TKRemoveThread(waiter);
+        TKRemoveTimeout(&TimeoutList, waiter);
         TKAddThread(runQueue, waiter);
         TKLeaveCriticalSection(&sem->cs);
         TKEnableInterrupts(cpsr);
+        TK_EVENT(TK_EVENT_SEM_UP, 1, TK_EVENT_OBJECT(sem));
+        TK_EVENT_WAKE(waiter);
+
+        /* Let a more important waiter run now instead of at the next tick. */
+        if (thread != NULL && waiter->priority > thread->priority) {
+            _TKYieldThread(thread);
+        }
         return TK_OK;
     }
     else {
         sem->count++;
     }
     TKLeaveCriticalSection(&sem->cs);
+    TKEnableInterrupts(cpsr);
+    TK_EVENT(TK_EVENT_SEM_UP, 0, TK_EVENT_OBJECT(sem));
 
     return TK_OK;
 }
 
 TKStatus TKUpSemaphore(struct TKSemaphore * sem) {
-    return _TKUpSemaphore(sem, &RunQueue, CurrentThread);
+    TKStatus status;
+
+    TK_PROBE_START(SemaphoreUp);
+    status = _TKUpSemaphore(sem, &RunQueue, CurrentThread);
+    TK_PROBE_STOP(SemaphoreUp);
+
+    return status;
 }
 
-TKStatus _TKDownSemaphore(struct TKSemaphore * sem, struct TKThread * thread) {
+TKStatus _TKDownSemaphoreTimeout(struct TKSemaphore * sem,
+                                 struct TKThread * thread,
+                                 uint32_t timeout) {
     uint32_t cpsr;
 
     if (sem == NULL) {
@@ -57,22 +93,53 @@ TKStatus _TKDownSemaphore(struct TKSemaphore * sem, struct TKThread * thread) {
 
     TKEnterCriticalSection(&sem->cs);
     if (sem->count == 0) {
+        if (timeout == 0) {
+            TKLeaveCriticalSection(&sem->cs);
+            return TK_TIMEOUT;
+        }
+
         cpsr = TKDisableInterrupts();
         TKRemoveThread(thread);
         TKLeaveCriticalSection(&sem->cs);
         TKAddThread(&sem->waitQueue, thread);
+        thread->timedOut = false;
+        if (timeout != TK_WAIT_FOREVER) {
+            thread->deadline = TickCount + timeout;
+            TKAddTimeout(&TimeoutList, thread);
+        }
         TKEnableInterrupts(cpsr);
+        TK_EVENT(TK_EVENT_SEM_DOWN, 1, TK_EVENT_OBJECT(sem));
         _TKYieldThread(thread);
-        return TK_OK;
+
+        /* Either an up handed us the semaphore, or the scheduler pulled us
+         * off the wait queue when the deadline passed.
+         */
+        return thread->timedOut ? TK_TIMEOUT : TK_OK;
     }
     else {
         sem->count--;
     }
     TKLeaveCriticalSection(&sem->cs);
+    TK_EVENT(TK_EVENT_SEM_DOWN, 0, TK_EVENT_OBJECT(sem));
 
     return TK_OK;
 }
 
+TKStatus TKDownSemaphoreTimeout(struct TKSemaphore * sem, uint32_t timeout) {
+    TKStatus status;
+
+    /* Includes any time spent waiting. */
+    TK_PROBE_START(SemaphoreDown);
+    status = _TKDownSemaphoreTimeout(sem, CurrentThread, timeout);
+    TK_PROBE_STOP(SemaphoreDown);
+
+    return status;
+}
+
+TKStatus _TKDownSemaphore(struct TKSemaphore * sem, struct TKThread * thread) {
+    return _TKDownSemaphoreTimeout(sem, thread, TK_WAIT_FOREVER);
+}
+
 TKStatus TKDownSemaphore(struct TKSemaphore * sem) {
-    return _TKDownSemaphore(sem, CurrentThread);
+    return TKDownSemaphoreTimeout(sem, TK_WAIT_FOREVER);
 }
@@ -1,10 +1,9 @@
 .set INT_DISABLED, 0xc0 /* Disable both FIQ and IRQ. */
 .set MODE_SVC, 0x13 /* Supervisor mode */
-.set TIMER_INTERRUPT_CLEAR, 0x3f /* Clear interrupts */
 .set T0IR, 0xe0004000 /* Timer 0 interrupt register */
 
 .extern T0IR
-.extern TKInstrumentedSwitchThread
+.extern TKTimerInterrupt
 .extern TKSwitchThread
 
 .global TKDisableInterrupts
@@ -108,17 +107,18 @@ TKContextSwitchISR:
     /* Push the task's CPSR, which is in R0, to the task's stack. */
     stmfd sp!, {r0}
 
-    /* Clear the timer interrupt. */
+    /* Read which timer matches raised the interrupt and clear just those,
+     * so a match that comes in meanwhile isn't lost.
+     */
     ldr r0, =T0IR
-    mov r1, #TIMER_INTERRUPT_CLEAR
+    ldr r1, [r0]
     str r1, [r0]
 
-    /* Call the scheduler, which will pick a new CurrentThread. */
+    /* Handle the matches: the tick, high resolution timers or both. This
+     * calls the scheduler, which will pick a new CurrentThread.
+     */
     mov r0, sp
-    bl TKInstrumentedSwitchThread
-
-    /* Increment the tick. */
-    bl TKIncrementTick
+    bl TKTimerInterrupt
 
     /* Set SP to the new task's SP by reading the value stored in *CurrentThread. */
     ldr r0, =CurrentThread
@@ -1,16 +1,40 @@
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "tk/block.h"
 #include "tk/common.h"
+#include "tk/critical_section.h"
+#include "tk/data.h"
 #include "tk/ddf.h"
+#include "tk/events.h"
+#include "tk/flash.h"
+#include "tk/hrtimer.h"
+#include "tk/log.h"
+#include "tk/logstore.h"
+#include "tk/probe.h"
+#include "tk/profile.h"
+#include "tk/semaphore.h"
 #include "tk/tests.h"
 #include "tk/thread.h"
+#include "tk/timing.h"
+#include "tk/trace.h"
 #include "tk/utility.h"
 
+#include "tk/drivers/loopback.h"
+#include "tk/drivers/null.h"
+#include "tk/drivers/pipe.h"
+#include "tk/drivers/ramdisk.h"
+#include "tk/drivers/serial.h"
 #include "tk/drivers/test.h"
+#include "tk/drivers/zero.h"
 
 #define MAX_TEST_THREADS (3)
 
+/* Ticks the test device may sit idle before it is suspended. */
+#define AUTOSUSPEND_DELAY (10)
+
 #define ASSERT(x) do { if (!(x)) { return -1; } } while (0)
 
 struct ThreadInfo {
@@ -19,11 +43,44 @@ struct ThreadInfo {
     struct TKThreadQueue * queue;
 };
 
-static struct TKThread threads[MAX_TEST_THREADS];
+/* The tests run before TKInit, while the kernel's TCBs are unused, so they
+ * borrow the first few rather than spend RAM on their own.
+ */
+static struct TKThread * threads;
 static struct TKThreadQueue freeQueue;
 static struct TKThreadQueue sleepQueue;
 static struct TKThreadQueue runQueue;
 
+/* Too big for the stack the tests run on. No test uses more than one of
+ * these, so they share the space.
+ */
+static union {
+    uint8_t blockBuf[2][TK_BLOCK_SIZE];
+    struct TKLogStore logStore;
+    struct {
+        struct TKInstrumentData data;
+        struct TKInstrumentData snapshot;
+    } instrument;
+    /* What the log drain test's print function was given. */
+    char logCapture[32];
+} scratch;
+
+/* The data of the high resolution timers that fired, in order. */
+static uint32_t hrTimerFired[4];
+static uint32_t hrTimerFiredCount;
+/* How many timer callbacks are running, and the most there have been. */
+static uint32_t hrTimerDepth;
+static uint32_t hrTimerMaxDepth;
+
+static uint32_t logCaptured;
+
+/* The serial device trace records are sent through raw, what it reported
+ * sending, and its status.
+ */
+static TKDriverHandle rawSerial;
+static int rawSent;
+static TKStatus rawStatus;
+
 /**
  * Sets up the thread queue with some number of threads.
  *
@@ -264,6 +321,118 @@ static int CreateThreadValidateNormalCase(void) {
     return 0;
 }
 
+static int SemaphoreWakesHighestPriority(void) {
+    struct TKSemaphore sem;
+    struct ThreadInfo info[] = {
+                                { &threads[0], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                                { &threads[1], TK_PRIORITY_HIGHEST, &sem.waitQueue },
+                                { &threads[2], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                               };
+    TKCreateSemaphore(&sem, 0);
+    InitializeThreadQueues(info, ARRAYLEN(info));
+
+    _TKUpSemaphore(&sem, &runQueue, NULL);
+    ASSERT(threads[1].queue == &runQueue);
+    ASSERT(threads[0].queue == &sem.waitQueue);
+    ASSERT(threads[2].queue == &sem.waitQueue);
+
+    /* Equal priorities are woken in the order they started waiting. */
+    _TKUpSemaphore(&sem, &runQueue, NULL);
+    ASSERT(threads[0].queue == &runQueue);
+    ASSERT(threads[2].queue == &sem.waitQueue);
+
+    _TKUpSemaphore(&sem, &runQueue, NULL);
+    ASSERT(threads[2].queue == &runQueue);
+    ASSERT(sem.waitQueue.head == NULL);
+    ASSERT(sem.count == 0);
+
+    return 0;
+}
+
+static int SemaphoreWakesEqualPriorityInOrder(void) {
+    struct TKSemaphore sem;
+    struct ThreadInfo info[] = {
+                                { &threads[0], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                                { &threads[1], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                                { &threads[2], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                               };
+    int i;
+
+    TKCreateSemaphore(&sem, 0);
+    InitializeThreadQueues(info, ARRAYLEN(info));
+
+    for (i = 0; i < ARRAYLEN(info); i++) {
+        _TKUpSemaphore(&sem, &runQueue, NULL);
+        ASSERT(threads[i].queue == &runQueue);
+        if (i + 1 < ARRAYLEN(info)) {
+            ASSERT(sem.waitQueue.head == &threads[i + 1]);
+        }
+    }
+    ASSERT(sem.waitQueue.head == NULL);
+
+    return 0;
+}
+
+static int SemaphoreTimeouts(void) {
+    struct TKSemaphore sem;
+    struct TKTimeoutList timeouts;
+    struct ThreadInfo info[] = {
+                                { &threads[0], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                                { &threads[1], TK_PRIORITY_NORMAL, &sem.waitQueue },
+                               };
+    TKCreateSemaphore(&sem, 0);
+    InitializeThreadQueues(info, ARRAYLEN(info));
+
+    timeouts.head = NULL;
+    threads[0].deadline = 10;
+    TKAddTimeout(&timeouts, &threads[0]);
+    threads[1].deadline = 20;
+    TKAddTimeout(&timeouts, &threads[1]);
+
+    _TKExpireTimeouts(&timeouts, &runQueue, 9);
+    ASSERT(threads[0].queue == &sem.waitQueue);
+    ASSERT(threads[1].queue == &sem.waitQueue);
+
+    _TKExpireTimeouts(&timeouts, &runQueue, 10);
+    ASSERT(threads[0].queue == &runQueue);
+    ASSERT(threads[0].timedOut);
+    ASSERT(threads[1].queue == &sem.waitQueue);
+    ASSERT(!threads[1].timedOut);
+    ASSERT(timeouts.head == &threads[1]);
+
+    /* Waking a waiter takes it off the kernel's timeout list. */
+    TKAddTimeout(&TimeoutList, &threads[1]);
+    TKRemoveTimeout(&timeouts, &threads[1]);
+    _TKUpSemaphore(&sem, &runQueue, NULL);
+    ASSERT(threads[1].queue == &runQueue);
+    ASSERT(TimeoutList.head == NULL);
+    ASSERT(!threads[1].timedOut);
+
+    /* A timeout of 0 never blocks. */
+    ASSERT(_TKDownSemaphoreTimeout(&sem, &threads[2], 0) == TK_TIMEOUT);
+    ASSERT(threads[2].queue == &freeQueue);
+
+    return 0;
+}
+
+static int CriticalSectionTimeout(void) {
+    struct TKCriticalSection cs;
+
+    TKCreateCriticalSection(&cs);
+    ASSERT(_TKEnterCriticalSection(&cs, &threads[0]) == TK_OK);
+    ASSERT(_TKEnterCriticalSectionTimeout(&cs, &threads[1], 0) == TK_TIMEOUT);
+
+    /* The owner can still re-enter. */
+    ASSERT(_TKEnterCriticalSectionTimeout(&cs, &threads[0], 0) == TK_OK);
+    ASSERT(_TKLeaveCriticalSection(&cs, &threads[0]) == TK_OK);
+    ASSERT(_TKLeaveCriticalSection(&cs, &threads[0]) == TK_OK);
+
+    ASSERT(_TKEnterCriticalSectionTimeout(&cs, &threads[1], 0) == TK_OK);
+    ASSERT(_TKLeaveCriticalSection(&cs, &threads[1]) == TK_OK);
+
+    return 0;
+}
+
 int DriverNullOp(void) {
     uint8_t buf[1];
     int ret;
@@ -433,6 +602,68 @@ int DriverDoubleOpen(void) {
     return 0;
 }
 
+int DriverOpenLookup(void) {
+    TKDriverHandle handle;
+    TKDriverHandle basic;
+    struct TKDriverEntry bogus;
+
+    TKInitDrivers();
+
+    ASSERT(TKDriverOpen(TK_MAX_MAJOR, TK_TEST_MINOR) == NULL);
+    ASSERT(TKDriverOpen(TK_TEST_MAJOR, TK_MAX_MINOR) == NULL);
+    ASSERT(TKDriverOpen(TK_SERIAL_MAJOR, TK_SERIAL_PORT_COUNT) == NULL);
+
+    /* Each minor is a device of its own. */
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+    basic = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
+    ASSERT(handle != NULL);
+    ASSERT(basic != NULL);
+    ASSERT(handle != basic);
+    ASSERT(basic->driver->minor == TK_TEST_BASIC_MINOR);
+
+    /* Handles that didn't come from TKDriverOpen are rejected. */
+    bogus = *handle;
+    ASSERT(TKDriverClose(&bogus) == TK_UNEXPECTED);
+
+    return 0;
+}
+
+int DriverContextPerMinor(void) {
+    TKDriverHandle pipes[2];
+    TKStatus status;
+    uint8_t c;
+    int n;
+    int i;
+
+    TKInitDrivers();
+    pipes[0] = TKDriverOpen(TK_PIPE_MAJOR, TK_PIPE_MINOR);
+    pipes[1] = TKDriverOpen(TK_PIPE_MAJOR, TK_PIPE_MINOR + 1);
+    ASSERT(pipes[0] != NULL && pipes[1] != NULL);
+
+    /* Each minor gets its own slot of the driver's context array. */
+    for (i = 0; i < 2; i++) {
+        ASSERT(pipes[i]->context == (uint8_t *) pipes[i]->driver->contexts +
+                                    i * pipes[i]->driver->contextSize);
+    }
+
+    /* And the ops get that slot: a byte written to one pipe only shows up
+     * in that pipe.
+     */
+
+    c = 'x';
+    n = TKDriverWrite(pipes[1], &status, &c, 1);
+    ASSERT(status == TK_OK && n == 1);
+    n = TKDriverRead(pipes[0], &status, &c, 1);
+    ASSERT(status == TK_TIMEOUT && n == 0);
+    c = 0;
+    n = TKDriverRead(pipes[1], &status, &c, 1);
+    ASSERT(status == TK_OK && n == 1 && c == 'x');
+
+    ASSERT(TKDriverClose(pipes[0]) == TK_OK);
+    ASSERT(TKDriverClose(pipes[1]) == TK_OK);
+    return 0;
+}
+
 int DriverIoctlBadCode(void) {
     uint8_t buf[1];
     TKDriverHandle handle;
@@ -563,11 +794,8 @@ int DriverPowerStatesNotSupported(void) {
     TKStatus status;
 
     TKInitDrivers();
-    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
-
-    /* Turn off power state support by setting the handlers to NULL. */
-    handle->driver->ops.powerUp = NULL;
-    handle->driver->ops.powerDown = NULL;
+    /* This minor has no power handlers. */
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
 
     status = TKDriverPowerDown(handle);
     ASSERT(status == TK_POWER_STATES_UNSUPPORTED);
@@ -611,6 +839,337 @@ int DriverReadWriteVerify(void) {
     return 0;
 }
 
+int DriverWritevReadvVerify(void) {
+    uint8_t in[4];
+    uint8_t out[4];
+    int i;
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+    struct TKIoVec vec[2];
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    for (i = 0; i < ARRAYLEN(in); i++) {
+        in[i] = i;
+    }
+    vec[0].buffer = &in[0];
+    vec[0].size = 1;
+    vec[1].buffer = &in[1];
+    vec[1].size = 3;
+    ret = TKDriverWritev(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == sizeof(in));
+    ASSERT(status == TK_OK);
+
+    memset(out, 0, sizeof(out));
+    vec[0].buffer = &out[0];
+    vec[0].size = 3;
+    vec[1].buffer = &out[3];
+    vec[1].size = 1;
+    ret = TKDriverReadv(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == sizeof(out));
+    ASSERT(status == TK_OK);
+
+    for (i = 0; i < ARRAYLEN(out); i++) {
+        ASSERT(out[i] == i);
+    }
+
+    return 0;
+}
+
+int DriverVectorFallback(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+    struct TKIoVec vec[2];
+
+    TKInitDrivers();
+    /* This minor has no vectored ops, so the DDF splits the transfer. */
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
+
+    vec[0].buffer = &buf[0];
+    vec[0].size = 2;
+    vec[1].buffer = &buf[2];
+    vec[1].size = 2;
+
+    ret = TKDriverWritev(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+
+    ret = TKDriverReadv(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+
+    return 0;
+}
+
+int DriverVectorNullSegment(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+    struct TKIoVec vec[2];
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    vec[0].buffer = buf;
+    vec[0].size = sizeof(buf);
+    vec[1].buffer = NULL;
+    vec[1].size = sizeof(buf);
+
+    ret = TKDriverWritev(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == -1);
+    ASSERT(status == TK_NULL);
+
+    ret = TKDriverReadv(handle, &status, vec, ARRAYLEN(vec));
+    ASSERT(ret == -1);
+    ASSERT(status == TK_NULL);
+
+    ret = TKDriverWritev(handle, &status, NULL, 0);
+    ASSERT(ret == -1);
+    ASSERT(status == TK_NULL);
+
+    return 0;
+}
+
+int DriverBufferLoanVerify(void) {
+    uint8_t buf[4];
+    uint8_t * loan;
+    int i;
+    int ret;
+    uint32_t size;
+    TKDriverHandle handle;
+    TKStatus status;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_WRITE, &loan, &size);
+    ASSERT(status == TK_OK);
+    ASSERT(size == sizeof(buf));
+    for (i = 0; i < size; i++) {
+        loan[i] = i;
+    }
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE, size);
+    ASSERT(status == TK_OK);
+
+    memset(buf, 0, sizeof(buf));
+    ret = TKDriverRead(handle, &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+    for (i = 0; i < ARRAYLEN(buf); i++) {
+        ASSERT(buf[i] == i);
+    }
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_READ, &loan, &size);
+    ASSERT(status == TK_OK);
+    for (i = 0; i < size; i++) {
+        ASSERT(loan[i] == i);
+    }
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_READ, size);
+    ASSERT(status == TK_OK);
+
+    return 0;
+}
+
+int DriverBufferLoanErrors(void) {
+    uint8_t * loan;
+    uint32_t size;
+    TKDriverHandle handle;
+    TKStatus status;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_WRITE, NULL, &size);
+    ASSERT(status == TK_NULL);
+
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE, 0);
+    ASSERT(status == TK_BUFFER_NOT_ACQUIRED);
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_WRITE + 1, &loan, &size);
+    ASSERT(status == TK_UNSUPPORTED);
+
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE + 1, 0);
+    ASSERT(status == TK_UNSUPPORTED);
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_WRITE, &loan, &size);
+    ASSERT(status == TK_OK);
+
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_WRITE, &loan, &size);
+    ASSERT(status == TK_BUFFER_ALREADY_ACQUIRED);
+
+    status = TKDriverClose(handle);
+    ASSERT(status == TK_BUSY);
+
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE, size + 1);
+    ASSERT(status == TK_BUFFER_BAD_SIZE);
+
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE, size);
+    ASSERT(status == TK_OK);
+
+    status = TKDriverCommitBuffer(handle, TK_BUFFER_WRITE, size);
+    ASSERT(status == TK_BUFFER_NOT_ACQUIRED);
+
+    /* This minor has no loan handlers. */
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
+    status = TKDriverAcquireBuffer(handle, TK_BUFFER_READ, &loan, &size);
+    ASSERT(status == TK_BUFFERS_UNSUPPORTED);
+
+    return 0;
+}
+
+int DriverPerDirectionLocks(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_DUPLEX_MINOR);
+
+    /* Pretend a writer is in progress; a read must not wait for it. */
+    TKDownSemaphore(&handle->writeSem);
+    ret = TKDriverRead(handle, &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+    TKUpSemaphore(&handle->writeSem);
+
+    /* Likewise, a pending read must not hold up a write. */
+    TKDownSemaphore(&handle->sem);
+    ret = TKDriverWrite(handle, &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+    TKUpSemaphore(&handle->sem);
+
+    /* Control operations take and release both locks. */
+    status = TKDriverIoctl(handle, TK_TEST_IOCTL_NONE, NULL, 0, NULL, 0);
+    ASSERT(status == TK_OK);
+    ASSERT(handle->sem.count == 1);
+    ASSERT(handle->writeSem.count == 1);
+
+    return 0;
+}
+
+int DriverLockTimeout(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    /* Another thread holds the driver, so nothing gets in. */
+    TKDownSemaphore(&handle->sem);
+    ret = TKDriverReadTimeout(handle, &status, buf, sizeof(buf), 0);
+    ASSERT(ret == -1);
+    ASSERT(status == TK_TIMEOUT);
+    ret = TKDriverWriteTimeout(handle, &status, buf, sizeof(buf), 0);
+    ASSERT(ret == -1);
+    ASSERT(status == TK_TIMEOUT);
+    status = TKDriverIoctlTimeout(handle, TK_TEST_IOCTL_NONE, NULL, 0, NULL, 0, 0);
+    ASSERT(status == TK_TIMEOUT);
+    TKUpSemaphore(&handle->sem);
+
+    ret = TKDriverReadTimeout(handle, &status, buf, sizeof(buf), 0);
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+
+    /* A control operation that times out on the write lock gives the read
+     * lock back.
+     */
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_DUPLEX_MINOR);
+    TKDownSemaphore(&handle->writeSem);
+    status = TKDriverIoctlTimeout(handle, TK_TEST_IOCTL_NONE, NULL, 0, NULL, 0, 0);
+    ASSERT(status == TK_TIMEOUT);
+    ASSERT(handle->sem.count == 1);
+    TKUpSemaphore(&handle->writeSem);
+
+    return 0;
+}
+
+int DriverPollVerify(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handles[1];
+    uint32_t events[1];
+    TKStatus status;
+
+    TKInitDrivers();
+    handles[0] = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    status = TKDriverPoll(NULL, events, 1, 0);
+    ASSERT(status == TK_NULL);
+
+    /* Nothing written yet, so only writes are ready. */
+    events[0] = TK_POLL_READ | TK_POLL_WRITE;
+    status = TKDriverPoll(handles, events, 1, 0);
+    ASSERT(status == TK_OK);
+    ASSERT(events[0] == TK_POLL_WRITE);
+
+    events[0] = TK_POLL_READ;
+    status = TKDriverPoll(handles, events, 1, 0);
+    ASSERT(status == TK_TIMEOUT);
+    ASSERT(events[0] == 0);
+
+    ret = TKDriverWrite(handles[0], &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    events[0] = TK_POLL_READ;
+    status = TKDriverPoll(handles, events, 1, 0);
+    ASSERT(status == TK_OK);
+    ASSERT(events[0] == TK_POLL_READ);
+
+    /* Drivers without a poll op are always ready. */
+    TKDriverClose(handles[0]);
+    handles[0] = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
+    ret = TKDriverRead(handles[0], &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    events[0] = TK_POLL_READ;
+    status = TKDriverPoll(handles, events, 1, 0);
+    ASSERT(status == TK_OK);
+    ASSERT(events[0] == TK_POLL_READ);
+
+    TKDriverClose(handles[0]);
+    status = TKDriverPoll(handles, events, 1, 0);
+    ASSERT(status == TK_CLOSED);
+
+    return 0;
+}
+
+int DriverNoLocking(void) {
+    uint8_t buf[4];
+    int ret;
+    TKDriverHandle handle;
+    TKStatus status;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_UNLOCKED_MINOR);
+
+    /* With both locks held elsewhere, nothing may block. */
+    TKDownSemaphore(&handle->sem);
+    TKDownSemaphore(&handle->writeSem);
+
+    ret = TKDriverWrite(handle, &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+
+    ret = TKDriverRead(handle, &status, buf, sizeof(buf));
+    ASSERT(ret == sizeof(buf));
+    ASSERT(status == TK_OK);
+
+    status = TKDriverIoctl(handle, TK_TEST_IOCTL_NONE, NULL, 0, NULL, 0);
+    ASSERT(status == TK_OK);
+
+    TKUpSemaphore(&handle->writeSem);
+    TKUpSemaphore(&handle->sem);
+
+    return 0;
+}
+
 int DriverCloseVerify(void) {
     TKDriverHandle handle;
     TKStatus status;
@@ -730,6 +1289,1075 @@ int DriverIoctlInOutBuf(void) {
     return 0;
 }
 
+int DriverIoctlBatchVerify(void) {
+    uint8_t first[4] = { 1, 2, 3, 4 };
+    uint8_t second[4] = { 5, 6, 7, 8 };
+    uint8_t out[2][4];
+    TKDriverHandle handle;
+    TKStatus status;
+    struct TKIoctlRequest requests[4];
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    /* The requests run in order: each out sees the in before it. */
+    memset(requests, 0, sizeof(requests));
+    requests[0].code = TK_TEST_IOCTL_IN;
+    requests[0].inBuf = first;
+    requests[0].inSize = sizeof(first);
+    requests[1].code = TK_TEST_IOCTL_OUT;
+    requests[1].outBuf = out[0];
+    requests[1].outSize = sizeof(out[0]);
+    requests[2].code = TK_TEST_IOCTL_IN;
+    requests[2].inBuf = second;
+    requests[2].inSize = sizeof(second);
+    requests[3].code = TK_TEST_IOCTL_OUT;
+    requests[3].outBuf = out[1];
+    requests[3].outSize = sizeof(out[1]);
+
+    status = TKDriverIoctlBatch(handle, requests, ARRAYLEN(requests));
+    ASSERT(status == TK_OK);
+    ASSERT(requests[3].status == TK_OK);
+    ASSERT(memcmp(out[0], first, sizeof(first)) == 0);
+    ASSERT(memcmp(out[1], second, sizeof(second)) == 0);
+    ASSERT(handle->sem.count == 1);
+
+    /* One bad request and nothing runs. */
+    requests[2].inSize = 1;
+    memset(out, 0, sizeof(out));
+    status = TKDriverIoctlBatch(handle, requests, ARRAYLEN(requests));
+    ASSERT(status == TK_IOCTL_IN_BUF_BAD_SIZE);
+    ASSERT(requests[0].status == TK_IOCTL_SKIPPED);
+    ASSERT(requests[2].status == TK_IOCTL_IN_BUF_BAD_SIZE);
+    ASSERT(out[0][0] == 0);
+
+    /* A request that fails stops the rest. */
+    requests[2].code = TK_TEST_IOCTL_FAIL;
+    status = TKDriverIoctlBatch(handle, requests, ARRAYLEN(requests));
+    ASSERT(status == TK_UNEXPECTED);
+    ASSERT(requests[1].status == TK_OK);
+    ASSERT(requests[2].status == TK_UNEXPECTED);
+    ASSERT(requests[3].status == TK_IOCTL_SKIPPED);
+    ASSERT(memcmp(out[0], first, sizeof(first)) == 0);
+    ASSERT(out[1][0] == 0);
+    ASSERT(handle->sem.count == 1);
+
+    return 0;
+}
+
+static TKStatus GetRamdiskStats(TKDriverHandle handle,
+                                struct TKRamdiskStats * stats) {
+    return TKDriverIoctl(handle,
+                         TK_RAMDISK_IOCTL_STATS,
+                         NULL,
+                         0,
+                         stats,
+                         sizeof(*stats));
+}
+
+int DriverStatsVerify(void) {
+    TKDriverHandle handle;
+    struct TKDriverStats stats;
+    TKStatus status;
+    uint8_t buffer[4];
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+
+    memset(buffer, 0, sizeof(buffer));
+    ASSERT(TKDriverWrite(handle, &status, buffer, sizeof(buffer)) == 4);
+    ASSERT(TKDriverRead(handle, &status, buffer, sizeof(buffer)) == 4);
+    ASSERT(TKDriverRead(handle, &status, NULL, sizeof(buffer)) == -1);
+    ASSERT(TKDriverIoctl(handle, TK_TEST_IOCTL_NONE, NULL, 0, NULL, 0) ==
+           TK_OK);
+    ASSERT(TKDriverIoctl(handle, 100, NULL, 0, NULL, 0) ==
+           TK_IOCTL_BAD_CODE);
+    ASSERT(TKDriverIoctl(handle, 101, NULL, 0, NULL, 0) ==
+           TK_IOCTL_BAD_CODE);
+    ASSERT(TKDriverPowerDown(handle) == TK_OK);
+
+    /* Stats can be read even with the power down, and reading them is not
+     * counted.
+     */
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats) - 1) ==
+           TK_IOCTL_OUT_BUF_BAD_SIZE);
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats)) == TK_OK);
+    ASSERT(stats.reads == 2);
+    ASSERT(stats.writes == 1);
+    ASSERT(stats.ioctls == 3);
+    ASSERT(stats.powerOps == 1);
+    ASSERT(stats.bytesRead == 4);
+    ASSERT(stats.bytesWritten == 4);
+    ASSERT(stats.errors == 3);
+    ASSERT(stats.errorStatus[0] == TK_NULL && stats.errorCount[0] == 1);
+    ASSERT(stats.errorStatus[1] == TK_IOCTL_BAD_CODE &&
+           stats.errorCount[1] == 2);
+    ASSERT(stats.errorCount[2] == 0);
+
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS_RESET, NULL, 0,
+                         NULL, 0) == TK_OK);
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats)) == TK_OK);
+    ASSERT(stats.reads == 0 && stats.errors == 0);
+
+    ASSERT(TKDriverPowerUp(handle) == TK_OK);
+    ASSERT(TKDriverClose(handle) == TK_OK);
+    return 0;
+}
+
+int DriverAutosuspendVerify(void) {
+    TKDriverHandle handle;
+    TKDriverHandle basic;
+    struct TKDriverStats stats;
+    TKPowerState state;
+    TKTickCount saved;
+    TKStatus status;
+    uint8_t buffer[4];
+
+    saved = TickCount;
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+    basic = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_BASIC_MINOR);
+    memset(buffer, 0, sizeof(buffer));
+
+    /* Only devices the DDF can power and lock can autosuspend. */
+    ASSERT(!TKDriverAutosuspendUsed());
+    ASSERT(_TKDriverSetAutosuspendDelay(basic, AUTOSUSPEND_DELAY) ==
+           TK_POWER_STATES_UNSUPPORTED);
+    ASSERT(_TKDriverSetAutosuspendDelay(handle, AUTOSUSPEND_DELAY) == TK_OK);
+    ASSERT(TKDriverAutosuspendUsed());
+
+    /* Not idle for long enough yet. */
+    TickCount += AUTOSUSPEND_DELAY - 1;
+    TKDriverAutosuspend();
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_ON);
+
+    TickCount += 1;
+    TKDriverAutosuspend();
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_SUSPENDED);
+
+    /* The next operation resumes the device. */
+    TickCount += 5;
+    ASSERT(TKDriverWrite(handle, &status, buffer, sizeof(buffer)) == 4);
+    ASSERT(status == TK_OK);
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_ON);
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats)) == TK_OK);
+    ASSERT(stats.suspends == 1);
+    ASSERT(stats.resumes == 1);
+    ASSERT(stats.suspendedTicks == 5);
+
+    /* Use restarts the idle time. */
+    TickCount += AUTOSUSPEND_DELAY - 1;
+    TKDriverAutosuspend();
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_ON);
+
+    /* An explicit power down sticks, even on a suspended device, and ends
+     * the suspension.
+     */
+    TickCount += 1;
+    TKDriverAutosuspend();
+    TickCount += 3;
+    ASSERT(TKDriverPowerDown(handle) == TK_OK);
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_OFF);
+    ASSERT(TKDriverWrite(handle, &status, buffer, sizeof(buffer)) == -1);
+    ASSERT(status == TK_NO_POWER);
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats)) == TK_OK);
+    ASSERT(stats.suspends == 2);
+    ASSERT(stats.resumes == 1);
+    ASSERT(stats.suspendedTicks == 8);
+    ASSERT(TKDriverPowerUp(handle) == TK_OK);
+
+    /* An explicit power up of a suspended device is a resume. */
+    TickCount += AUTOSUSPEND_DELAY;
+    TKDriverAutosuspend();
+    TickCount += 2;
+    ASSERT(TKDriverPowerUp(handle) == TK_OK);
+    ASSERT(TKDriverPowerState(handle, &state) == TK_OK);
+    ASSERT(state == TK_POWER_ON);
+    ASSERT(TKDriverIoctl(handle, TK_DDF_IOCTL_STATS, NULL, 0,
+                         &stats, sizeof(stats)) == TK_OK);
+    ASSERT(stats.suspends == 3);
+    ASSERT(stats.resumes == 2);
+    ASSERT(stats.suspendedTicks == 10);
+
+    TickCount = saved;
+    ASSERT(TKDriverClose(handle) == TK_OK);
+    ASSERT(TKDriverClose(basic) == TK_OK);
+    return 0;
+}
+
+int DriverNullZeroVerify(void) {
+    TKDriverHandle handle;
+    TKStatus status;
+    uint8_t buffer[4];
+    int n;
+
+    TKInitDrivers();
+
+    handle = TKDriverOpen(TK_NULL_MAJOR, TK_NULL_MINOR);
+    ASSERT(handle != NULL);
+    memset(buffer, 0xAA, sizeof(buffer));
+    n = TKDriverWrite(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == sizeof(buffer));
+    n = TKDriverRead(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == 0);
+    ASSERT(buffer[0] == 0xAA);
+    ASSERT(TKDriverIoctl(handle, TK_NULL_IOCTL_NOP, NULL, 0, NULL, 0) ==
+           TK_OK);
+    ASSERT(TKDriverPowerDown(handle) == TK_OK);
+    ASSERT(TKDriverPowerUp(handle) == TK_OK);
+    ASSERT(TKDriverClose(handle) == TK_OK);
+
+    handle = TKDriverOpen(TK_ZERO_MAJOR, TK_ZERO_MINOR);
+    ASSERT(handle != NULL);
+    n = TKDriverRead(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == sizeof(buffer));
+    ASSERT(buffer[0] == 0 && buffer[3] == 0);
+    ASSERT(TKDriverClose(handle) == TK_OK);
+
+    return 0;
+}
+
+int DriverLoopbackVerify(void) {
+    TKDriverHandle handle;
+    TKStatus status;
+    uint8_t buffer[TK_LOOPBACK_SIZE];
+    uint32_t events;
+    int n;
+    int i;
+
+    TKInitDrivers();
+    handle = TKDriverOpen(TK_LOOPBACK_MAJOR, TK_LOOPBACK_MINOR);
+    ASSERT(handle != NULL);
+
+    events = TK_POLL_READ | TK_POLL_WRITE;
+    ASSERT(TKDriverPoll(&handle, &events, 1, 0) == TK_OK);
+    ASSERT(events == TK_POLL_WRITE);
+
+    /* Fill the ring, wrapping around it, and check writes come up short. */
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i;
+    }
+    n = TKDriverWrite(handle, &status, buffer, 10);
+    ASSERT(status == TK_OK && n == 10);
+    n = TKDriverRead(handle, &status, buffer, 10);
+    ASSERT(status == TK_OK && n == 10);
+    ASSERT(buffer[0] == 0 && buffer[9] == 9);
+    n = TKDriverWrite(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == sizeof(buffer));
+    n = TKDriverWrite(handle, &status, buffer, 1);
+    ASSERT(status == TK_OK && n == 0);
+
+    events = TK_POLL_READ | TK_POLL_WRITE;
+    ASSERT(TKDriverPoll(&handle, &events, 1, 0) == TK_OK);
+    ASSERT(events == TK_POLL_READ);
+
+    memset(buffer, 0, sizeof(buffer));
+    n = TKDriverRead(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == sizeof(buffer));
+    for (i = 0; i < sizeof(buffer); i++) {
+        ASSERT(buffer[i] == i);
+    }
+    n = TKDriverRead(handle, &status, buffer, 1);
+    ASSERT(status == TK_OK && n == 0);
+
+    ASSERT(TKDriverClose(handle) == TK_OK);
+    return 0;
+}
+
+int DriverPipeVerify(void) {
+    TKDriverHandle pipes[2];
+    TKStatus status;
+    uint8_t buffer[TK_PIPE_SIZE];
+    uint32_t events[2];
+    int n;
+    int i;
+
+    TKInitDrivers();
+    pipes[0] = TKDriverOpen(TK_PIPE_MAJOR, TK_PIPE_MINOR);
+    pipes[1] = TKDriverOpen(TK_PIPE_MAJOR, TK_PIPE_MINOR + 1);
+    ASSERT(pipes[0] != NULL && pipes[1] != NULL);
+
+    /* With no other thread to fill or drain the pipe, blocking gives up. */
+    n = TKDriverRead(pipes[0], &status, buffer, 1);
+    ASSERT(status == TK_TIMEOUT && n == 0);
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i;
+    }
+    n = TKDriverWrite(pipes[0], &status, buffer, 100);
+    ASSERT(status == TK_OK && n == 100);
+    n = TKDriverWrite(pipes[0], &status, &buffer[100], 100);
+    ASSERT(status == TK_TIMEOUT && n == TK_PIPE_SIZE - 100);
+    n = TKDriverWrite(pipes[0], &status, buffer, 1);
+    ASSERT(status == TK_TIMEOUT && n == 0);
+
+    events[0] = TK_POLL_READ | TK_POLL_WRITE;
+    events[1] = TK_POLL_READ | TK_POLL_WRITE;
+    ASSERT(TKDriverPoll(pipes, events, 2, 0) == TK_OK);
+    ASSERT(events[0] == TK_POLL_READ);
+    ASSERT(events[1] == TK_POLL_WRITE);
+
+    /* Reads come back in order, across the end of the ring. */
+    n = TKDriverRead(pipes[0], &status, buffer, 50);
+    ASSERT(status == TK_OK && n == 50);
+    ASSERT(buffer[0] == 0 && buffer[49] == 49);
+    for (i = 0; i < 50; i++) {
+        buffer[i] = TK_PIPE_SIZE + i;
+    }
+    n = TKDriverWrite(pipes[0], &status, buffer, 50);
+    ASSERT(status == TK_OK && n == 50);
+    n = TKDriverRead(pipes[0], &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK && n == TK_PIPE_SIZE);
+    for (i = 0; i < TK_PIPE_SIZE; i++) {
+        ASSERT(buffer[i] == (uint8_t) (50 + i));
+    }
+
+    /* A read returns what is there rather than waiting to fill the buffer. */
+    n = TKDriverWrite(pipes[0], &status, buffer, 10);
+    ASSERT(status == TK_OK && n == 10);
+    n = TKDriverRead(pipes[0], &status, buffer, 20);
+    ASSERT(status == TK_OK && n == 10);
+    ASSERT(buffer[0] == 50 && buffer[9] == 59);
+
+    ASSERT(TKDriverClose(pipes[0]) == TK_OK);
+    ASSERT(TKDriverClose(pipes[1]) == TK_OK);
+    return 0;
+}
+
+int BlockCacheVerify(void) {
+    uint8_t (* blockBuf)[TK_BLOCK_SIZE];
+    TKDriverHandle handle;
+    TKDriverHandle test;
+    struct TKRamdiskStats stats;
+    TKStatus status;
+
+    blockBuf = scratch.blockBuf;
+    TKInitDrivers();
+    TKInitBlockCache();
+    handle = TKDriverOpen(TK_RAMDISK_MAJOR, TK_RAMDISK_MINOR);
+    ASSERT(handle != NULL);
+
+    /* Writes stay in the cache until flushed. */
+    memset(blockBuf[0], 0xA5, TK_BLOCK_SIZE);
+    status = TKBlockWrite(handle, 1, 1, blockBuf[0]);
+    ASSERT(status == TK_OK);
+    status = TKBlockRead(handle, 1, 1, blockBuf[1]);
+    ASSERT(status == TK_OK);
+    ASSERT(memcmp(blockBuf[0], blockBuf[1], TK_BLOCK_SIZE) == 0);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.reads == 0);
+    ASSERT(stats.writes == 0);
+
+    status = TKBlockFlush(handle);
+    ASSERT(status == TK_OK);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.writes == 1);
+
+    /* With the cache dropped, the data comes back from the disk. */
+    TKInitBlockCache();
+    memset(blockBuf[1], 0, TK_BLOCK_SIZE);
+    status = TKBlockRead(handle, 1, 1, blockBuf[1]);
+    ASSERT(status == TK_OK);
+    ASSERT(memcmp(blockBuf[0], blockBuf[1], TK_BLOCK_SIZE) == 0);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.reads == 1);
+
+    status = TKBlockRead(handle, TK_RAMDISK_BLOCKS - 1, 2, blockBuf[0]);
+    ASSERT(status == TK_BLOCK_OUT_OF_RANGE);
+
+    test = TKDriverOpen(TK_TEST_MAJOR, TK_TEST_MINOR);
+    status = TKBlockRead(test, 0, 1, blockBuf[0]);
+    ASSERT(status == TK_UNSUPPORTED);
+
+    return 0;
+}
+
+int BlockMergeVerify(void) {
+    uint8_t (* blockBuf)[TK_BLOCK_SIZE];
+    TKDriverHandle handle;
+    struct TKRamdiskStats stats;
+    TKStatus status;
+
+    blockBuf = scratch.blockBuf;
+    TKInitDrivers();
+    TKInitBlockCache();
+    handle = TKDriverOpen(TK_RAMDISK_MAJOR, TK_RAMDISK_MINOR);
+
+    /* Runs of uncached blocks go to the disk as one request. */
+    status = TKBlockWrite(handle, 0, 2, blockBuf[0]);
+    ASSERT(status == TK_OK);
+    status = TKBlockRead(handle, 0, 2, blockBuf[0]);
+    ASSERT(status == TK_OK);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.writes == 1);
+    ASSERT(stats.blocksWritten == 2);
+    ASSERT(stats.reads == 1);
+    ASSERT(stats.blocksRead == 2);
+
+    /* Sequential single-block writes are written back together. */
+    ASSERT(TKBlockWrite(handle, 0, 1, blockBuf[0]) == TK_OK);
+    ASSERT(TKBlockWrite(handle, 1, 1, blockBuf[1]) == TK_OK);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.writes == 1);
+
+    ASSERT(TKBlockWrite(handle, 2, 1, blockBuf[0]) == TK_OK);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.writes == 2);
+    ASSERT(stats.blocksWritten == 4);
+
+    ASSERT(TKBlockFlush(handle) == TK_OK);
+    ASSERT(GetRamdiskStats(handle, &stats) == TK_OK);
+    ASSERT(stats.writes == 3);
+    ASSERT(stats.blocksWritten == 5);
+
+    return 0;
+}
+
+int LogStoreRecover(void) {
+    struct TKLogStore * store;
+    uint8_t record[8];
+    struct TKLogCursor cursor;
+    uint32_t length;
+    uint8_t i;
+
+    store = &scratch.logStore;
+    TKSimFlashReset();
+    ASSERT(TKLogOpen(store, TKSimFlash()) == TK_OK);
+    for (i = 0; i < 3; i++) {
+        memset(record, i, sizeof(record));
+        ASSERT(TKLogAppend(store, record, i + 1) == TK_OK);
+    }
+    ASSERT(TKLogFlush(store) == TK_OK);
+
+    /* Reopen, as after a reset, and carry on appending. */
+    ASSERT(TKLogOpen(store, TKSimFlash()) == TK_OK);
+    memset(record, 3, sizeof(record));
+    ASSERT(TKLogAppend(store, record, 4) == TK_OK);
+    ASSERT(TKLogFlush(store) == TK_OK);
+
+    TKLogRewind(store, &cursor);
+    for (i = 0; i < 4; i++) {
+        ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                         &length) == TK_OK);
+        ASSERT(length == i + 1);
+        ASSERT(record[0] == i && record[length - 1] == i);
+    }
+    ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                     &length) == TK_LOG_END);
+
+    /* Tear the second page. Its record is lost, but later ones are not. */
+    TKSimFlashData()[TK_SIM_FLASH_PAGE_SIZE + 4] ^= 0x01;
+    ASSERT(TKLogOpen(store, TKSimFlash()) == TK_OK);
+    memset(record, 9, sizeof(record));
+    ASSERT(TKLogAppend(store, record, 1) == TK_OK);
+    ASSERT(TKLogFlush(store) == TK_OK);
+
+    TKLogRewind(store, &cursor);
+    for (i = 0; i < 3; i++) {
+        ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                         &length) == TK_OK);
+        ASSERT(record[0] == i);
+    }
+    ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                     &length) == TK_OK);
+    ASSERT(length == 1 && record[0] == 9);
+    ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                     &length) == TK_LOG_END);
+
+    return 0;
+}
+
+int LogStoreWrap(void) {
+    struct TKLogStore * store;
+    uint8_t record[24];
+    struct TKLogCursor cursor;
+    uint32_t length;
+    uint32_t s;
+    uint8_t i;
+    int pass;
+
+    store = &scratch.logStore;
+    TKSimFlashReset();
+    ASSERT(TKLogOpen(store, TKSimFlash()) == TK_OK);
+    ASSERT(TKLogAppend(store, record, TK_SIM_FLASH_SECTOR_SIZE) ==
+           TK_LOG_RECORD_TOO_BIG);
+
+    /* Four records fit in a sector, so this wraps around and reclaims the
+     * first sector, leaving records 4 through 19.
+     */
+    for (i = 0; i < 20; i++) {
+        memset(record, i, sizeof(record));
+        ASSERT(TKLogAppend(store, record, sizeof(record)) == TK_OK);
+    }
+    ASSERT(TKLogFlush(store) == TK_OK);
+
+    for (s = 0; s < TK_SIM_FLASH_SECTORS; s++) {
+        ASSERT(TKSimFlashEraseCount(s) == (s == 0 ? 2 : 1));
+    }
+
+    /* The same records are found after a reopen. */
+    for (pass = 0; pass < 2; pass++) {
+        TKLogRewind(store, &cursor);
+        for (i = 4; i < 20; i++) {
+            ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                             &length) == TK_OK);
+            ASSERT(length == sizeof(record));
+            ASSERT(record[0] == i && record[sizeof(record) - 1] == i);
+        }
+        ASSERT(TKLogRead(store, &cursor, record, sizeof(record),
+                         &length) == TK_LOG_END);
+        ASSERT(TKLogOpen(store, TKSimFlash()) == TK_OK);
+    }
+
+    return 0;
+}
+
+int IapFlashBounds(void) {
+    const struct TKFlashOps * flash;
+    uint8_t byte;
+
+    /* Only the reserved sectors are reachable, so none of these touch the
+     * chip.
+     */
+    flash = TKIapFlash();
+    ASSERT(flash->read(flash->sectorCount * flash->sectorSize, &byte, 1) ==
+           TK_FLASH_ERROR);
+    ASSERT(flash->read(flash->sectorSize, &byte, 0xFFFFF001) ==
+           TK_FLASH_ERROR);
+    ASSERT(flash->program(flash->sectorCount * flash->sectorSize, &byte) ==
+           TK_FLASH_ERROR);
+    ASSERT(flash->erase(flash->sectorCount) == TK_FLASH_ERROR);
+
+    return 0;
+}
+
+/* TKSnprintf without the format checking, which rejects a NULL %s. */
+static int FormatUnchecked(char * buffer,
+                           uint32_t size,
+                           const char * format,
+                           ...) {
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = TKVsnprintf(buffer, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+int FormatVerify(void) {
+    char buffer[32];
+    char decimal[TK_DECIMAL_BUFFER_SIZE];
+
+    /* Decimals either side of the 32-bit fast path. */
+    ASSERT(strcmp(TKFormatDecimal(0, decimal), "0") == 0);
+    ASSERT(strcmp(TKFormatDecimal(4294967295ULL, decimal), "4294967295") == 0);
+    ASSERT(strcmp(TKFormatDecimal(4294967296ULL, decimal), "4294967296") == 0);
+    ASSERT(strcmp(TKFormatDecimal(UINT64_MAX, decimal),
+                  "18446744073709551615") == 0);
+
+    ASSERT(TKSnprintf(buffer, sizeof(buffer), "%d|%5d|%-4d|%05d", -12, 34, 5,
+                      -6) == 20);
+    ASSERT(strcmp(buffer, "-12|   34|5   |-0006") == 0);
+    ASSERT(TKSnprintf(buffer, sizeof(buffer), "%lu %llu %x %08lX",
+                      (uint32_t) 7, 10000000000ULL, 0xbeef,
+                      (uint32_t) 0xABC) == 27);
+    ASSERT(strcmp(buffer, "7 10000000000 beef 00000ABC") == 0);
+    ASSERT(TKSnprintf(buffer, sizeof(buffer), "%s %c %3s%%", "ab", 'c',
+                      "d") == 9);
+    ASSERT(strcmp(buffer, "ab c   d%") == 0);
+    ASSERT(FormatUnchecked(buffer, sizeof(buffer), "%s", NULL) == 6);
+    ASSERT(strcmp(buffer, "(null)") == 0);
+
+    /* Output is cut off but still terminated, and the full length returned. */
+    ASSERT(TKSnprintf(buffer, 4, "%lld", -1234567LL) == 8);
+    ASSERT(strcmp(buffer, "-12") == 0);
+
+    return 0;
+}
+
+static void CaptureLog(struct TKIoVec * vec, uint32_t count) {
+    uint32_t n;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        n = vec[i].size;
+        if (logCaptured + n > sizeof(scratch.logCapture)) {
+            n = sizeof(scratch.logCapture) - logCaptured;
+        }
+        if (logCaptured < sizeof(scratch.logCapture)) {
+            memcpy(&scratch.logCapture[logCaptured], vec[i].buffer, n);
+        }
+        logCaptured += vec[i].size;
+    }
+}
+
+int LogRingVerify(void) {
+    static const char * const message[] = { "a", NULL, "bc" };
+    static const char * const tooMany[TK_LOG_MAX_STRINGS + 1] = { "a" };
+    /* A sixteenth of the ring. */
+    static char line[TK_LOG_RING_SIZE / 16 + 1];
+    struct TKLogStats stats;
+    int i;
+
+    TKInitLog();
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+
+    TKLog("hello ");
+    TKLogStrings(message, ARRAYLEN(message));
+    logCaptured = 0;
+    ASSERT(_TKLogDrain(CaptureLog) == 9);
+    ASSERT(logCaptured == 9 && memcmp(scratch.logCapture, "hello abc", 9) == 0);
+    ASSERT(_TKLogDrain(CaptureLog) == 0);
+
+    /* Fill the ring exactly, across its end; the next message is dropped
+     * whole, and the drain reports it.
+     */
+    for (i = 0; i < 16; i++) {
+        TKLog(line);
+    }
+    TKLogStrings(message, ARRAYLEN(message));
+    TKLogGetStats(&stats);
+    ASSERT(stats.messages == 18 && stats.bytes == 9 + TK_LOG_RING_SIZE);
+    ASSERT(stats.droppedMessages == 1 && stats.droppedBytes == 3);
+
+    logCaptured = 0;
+    ASSERT(_TKLogDrain(CaptureLog) == TK_LOG_RING_SIZE);
+    ASSERT(logCaptured ==
+           TK_LOG_RING_SIZE + strlen("[log: 1 messages dropped]\n"));
+    ASSERT(scratch.logCapture[0] == 'x');
+
+    /* The drop is only reported once. */
+    logCaptured = 0;
+    ASSERT(_TKLogDrain(CaptureLog) == 0);
+    ASSERT(logCaptured == 0);
+
+    /* A message of too many strings is dropped rather than cut short. */
+    TKLogStrings(tooMany, ARRAYLEN(tooMany));
+    TKLogGetStats(&stats);
+    ASSERT(stats.droppedMessages == 2);
+    ASSERT(_TKLogDrain(CaptureLog) == 0);
+
+    return 0;
+}
+
+int TraceVerify(void) {
+    uint32_t words[6];
+    int i;
+
+    TKInitTrace();
+    TK_TRACE("no arguments");
+    TK_TRACE("two arguments %d %x", -1, 0xABCD);
+
+    logCaptured = 0;
+    ASSERT(_TKTraceDrain(CaptureLog) == 6 * sizeof(uint32_t));
+    ASSERT(logCaptured == 6 * sizeof(uint32_t));
+    memcpy(words, scratch.logCapture, sizeof(words));
+    ASSERT((words[0] & 0xFF) == TK_TRACE_MARKER);
+    ASSERT((words[2] & 0xFF) == (TK_TRACE_MARKER | 2));
+    ASSERT((words[0] >> 8) != (words[2] >> 8));
+    ASSERT(words[4] == 0xFFFFFFFF && words[5] == 0xABCD);
+    ASSERT(!TKTracePending());
+
+    /* Fill the ring; the rest are dropped and reported once. */
+    for (i = 0; i < TK_TRACE_RING_WORDS / 4 + 2; i++) {
+        TK_TRACE("%d %d", i, i);
+    }
+    ASSERT(TKTraceDropped() == 2);
+    logCaptured = 0;
+    ASSERT(_TKTraceDrain(CaptureLog) ==
+           TK_TRACE_RING_WORDS * sizeof(uint32_t));
+    ASSERT(logCaptured == (TK_TRACE_RING_WORDS + 3) * sizeof(uint32_t));
+    ASSERT(!TKTracePending());
+
+    return 0;
+}
+
+static void PrintRawSerial(struct TKIoVec * vec, uint32_t count) {
+    CaptureLog(vec, count);
+    rawSent += TKDriverWriteRawv(rawSerial, &rawStatus, vec, count);
+}
+
+int TraceSerialRawVerify(void) {
+    struct TKDriverStats stats;
+    struct TKIoVec vec;
+    uint32_t words[3];
+    TKStatus status;
+
+    TKInitDrivers();
+    rawSerial = TKDriverOpen(TK_SERIAL_MAJOR, TK_SERIAL_MINOR);
+    ASSERT(rawSerial != NULL);
+
+    /* Every byte of the argument is a newline, which Write would send as
+     * "\n\r"; the raw path must send the record as it is.
+     */
+    TKInitTrace();
+    TK_TRACE("newlines %x", 0x0A0A0A0A);
+    logCaptured = 0;
+    rawSent = 0;
+    ASSERT(_TKTraceDrain(PrintRawSerial) == sizeof(words));
+    ASSERT(rawStatus == TK_OK);
+    ASSERT(rawSent == (int) sizeof(words));
+    memcpy(words, scratch.logCapture, sizeof(words));
+    ASSERT((words[0] & 0xFF) == (TK_TRACE_MARKER | 1));
+    ASSERT(words[2] == 0x0A0A0A0A);
+
+    ASSERT(TKDriverIoctl(rawSerial,
+                         TK_DDF_IOCTL_STATS,
+                         NULL,
+                         0,
+                         &stats,
+                         sizeof(stats)) == TK_OK);
+    ASSERT(stats.writes == 1 && stats.errors == 0);
+    ASSERT(stats.bytesWritten == sizeof(words));
+
+    /* Segments are checked as for TKDriverWritev. */
+    vec.buffer = NULL;
+    vec.size = 1;
+    ASSERT(TKDriverWriteRawv(rawSerial, &status, &vec, 1) == -1);
+    ASSERT(status == TK_NULL);
+
+    ASSERT(TKDriverClose(rawSerial) == TK_OK);
+    TKInitDrivers();
+
+    return 0;
+}
+
+int InstrumentHistogramVerify(void) {
+    struct TKInstrumentData * data;
+    struct TKInstrumentData * snapshot;
+    uint32_t i;
+
+    data = &scratch.instrument.data;
+    snapshot = &scratch.instrument.snapshot;
+    TKInitInstrumentData("test", data);
+    TKSnapshotInstrumentData(data, snapshot, false);
+    ASSERT(snapshot->count == 0);
+    ASSERT(TKInstrumentPercentile(snapshot, 500) == 0);
+
+    for (i = 0; i < 98; i++) {
+        _TKRecordInstrumentSample(data, 10);
+    }
+    _TKRecordInstrumentSample(data, 1000);
+    _TKRecordInstrumentSample(data, 5000);
+
+    /* 10 is in the bucket up to 15, 1000 up to 1023, and 5000 up to 8191,
+     * which is capped at the maximum.
+     */
+    TKSnapshotInstrumentData(data, snapshot, true);
+    ASSERT(snapshot->count == 100);
+    ASSERT(snapshot->sum == 6980);
+    ASSERT(snapshot->min == 10 && snapshot->max == 5000);
+    ASSERT(snapshot->buckets[4] == 98);
+    ASSERT(TKInstrumentPercentile(snapshot, 500) == 15);
+    ASSERT(TKInstrumentPercentile(snapshot, 990) == 1023);
+    ASSERT(TKInstrumentPercentile(snapshot, 999) == 5000);
+    ASSERT((data->sequence & 1) == 0);
+
+    /* The reset is carried out by the next measurement, but snapshots taken
+     * before then already see it.
+     */
+    TKSnapshotInstrumentData(data, snapshot, false);
+    ASSERT(snapshot->count == 0);
+    ASSERT(snapshot->min == UINT32_MAX);
+
+    _TKRecordInstrumentSample(data, 0);
+    _TKRecordInstrumentSample(data, UINT32_MAX);
+    TKSnapshotInstrumentData(data, snapshot, false);
+    ASSERT(snapshot->count == 2);
+    ASSERT(snapshot->buckets[0] == 1);
+    ASSERT(snapshot->buckets[TK_INSTRUMENT_BUCKETS - 1] == 1);
+    ASSERT(TKInstrumentPercentile(snapshot, 500) == 0);
+    ASSERT(TKInstrumentPercentile(snapshot, 999) == UINT32_MAX);
+
+    return 0;
+}
+
+int CycleCounterVerify(void) {
+    uint64_t hz;
+    uint64_t ns;
+    uint64_t us;
+    uint64_t first;
+
+    /* main starts the counter before the tests. */
+    hz = TKGetCyclesHz();
+    ASSERT(hz != 0);
+    first = TKGetCycles();
+    ASSERT(TKGetCycles() > first);
+
+    /* Conversions round down, by a part per million at most. */
+    ns = TKCyclesToNs(hz);
+    ASSERT(ns <= 1000000000ULL && ns >= 1000000000ULL - 1000);
+    us = TKCyclesToUs(hz * 3600);
+    ASSERT(us <= 3600000000ULL && us >= 3600000000ULL - 3600);
+    ASSERT(TKCyclesToNs(0) == 0);
+
+    return 0;
+}
+
+static void RecordHrTimer(void * data) {
+    if (hrTimerFiredCount < ARRAYLEN(hrTimerFired)) {
+        hrTimerFired[hrTimerFiredCount] = (uint32_t) data;
+    }
+    hrTimerFiredCount++;
+}
+
+/* Restart the timer with a deadline that has passed, a few times over. */
+static void RestartHrTimer(void * data) {
+    hrTimerDepth++;
+    if (hrTimerDepth > hrTimerMaxDepth) {
+        hrTimerMaxDepth = hrTimerDepth;
+    }
+    RecordHrTimer(data);
+    if (hrTimerFiredCount < 3) {
+        TKStartHrTimerAt(data, 0, RestartHrTimer, data);
+    }
+    hrTimerDepth--;
+}
+
+int HrTimerVerify(void) {
+    struct TKHrTimer timers[3];
+    uint64_t now;
+
+    TKInitHrTimers();
+    memset(timers, 0, sizeof(timers));
+    hrTimerFiredCount = 0;
+    now = TKGetCycles();
+
+    /* Far enough out not to come due during the test. */
+    ASSERT(TKStartHrTimerAt(&timers[0], now + 3000000000ULL, RecordHrTimer,
+                            (void *) 0) == TK_OK);
+    ASSERT(TKStartHrTimerAt(&timers[1], now + 1000000000ULL, RecordHrTimer,
+                            (void *) 1) == TK_OK);
+    ASSERT(TKStartHrTimerAt(&timers[2], now + 2000000000ULL, RecordHrTimer,
+                            (void *) 2) == TK_OK);
+    ASSERT(TKStartHrTimerAt(&timers[1], now, RecordHrTimer, NULL) == TK_BUSY);
+    ASSERT(TKStartHrTimer(NULL, 10, RecordHrTimer, NULL) == TK_NULL);
+    ASSERT(hrTimerFiredCount == 0);
+
+    /* Timers fire in deadline order, whatever order they were started in. */
+    ASSERT(_TKExpireHrTimers(now + 1500000000ULL) == 1);
+    ASSERT(hrTimerFired[0] == 1);
+    ASSERT(TKCancelHrTimer(&timers[0]) == TK_OK);
+    ASSERT(TKCancelHrTimer(&timers[0]) == TK_UNEXPECTED);
+    ASSERT(TKCancelHrTimer(&timers[1]) == TK_UNEXPECTED);
+    ASSERT(_TKExpireHrTimers(now + 4000000000ULL) == 1);
+    ASSERT(hrTimerFired[1] == 2);
+
+    /* A deadline that has passed fires when the timer is started. */
+    ASSERT(TKStartHrTimerAt(&timers[0], 0, RecordHrTimer, (void *) 3) == TK_OK);
+    ASSERT(hrTimerFiredCount == 3 && hrTimerFired[2] == 3);
+    ASSERT(!timers[0].pending);
+
+    /* A callback that restarts its timer runs again after it returns, not
+     * from inside itself.
+     */
+    hrTimerFiredCount = 0;
+    hrTimerDepth = 0;
+    hrTimerMaxDepth = 0;
+    ASSERT(TKStartHrTimerAt(&timers[0], 0, RestartHrTimer, &timers[0]) ==
+           TK_OK);
+    ASSERT(hrTimerFiredCount == 3);
+    ASSERT(hrTimerMaxDepth == 1);
+    ASSERT(!timers[0].pending);
+
+    return 0;
+}
+
+#ifdef TK_PROBES
+TK_PROBE_DEFINE(Test);
+
+int ProbeRegistryVerify(void) {
+    const struct TKProbe * probe;
+
+    TKInitProbes();
+    probe = TKFindProbe("Test");
+    ASSERT(probe == &TestProbe);
+    ASSERT(TKFindProbe("NoSuchProbe") == NULL);
+
+    /* Kernel probes are registered too. */
+    ASSERT(TKFindProbe("SemaphoreUp") != NULL);
+
+    TK_PROBE_START(Test);
+    TK_PROBE_STOP(Test);
+    TKProbeStop(probe, TKProbeStart() - 100);
+    ASSERT(probe->data->count == 2);
+    ASSERT(probe->data->max >= 100);
+
+    TKInitProbes();
+    ASSERT(probe->data->count == 0);
+
+    return 0;
+}
+#endif
+
+#ifdef TK_PROFILING
+static struct TKProfileEntry profileEntries[TK_PROFILE_ENTRIES];
+
+int ProfileVerify(void) {
+    uint32_t dropped;
+    uint32_t total;
+    uint32_t n;
+    uint32_t i;
+
+    TKResetProfile();
+    ASSERT(TKStartProfiler(0) == TK_UNSUPPORTED);
+    ASSERT(TKStartProfiler(TK_PROFILE_MAX_HZ + 1) == TK_UNSUPPORTED);
+
+    /* Samples are counted together only if PC, LR and thread all match. */
+    ASSERT(_TKRecordProfileSample(0x1000, 0x2000, 1));
+    ASSERT(_TKRecordProfileSample(0x1000, 0x2000, 1));
+    ASSERT(_TKRecordProfileSample(0x1000, 0x2004, 1));
+    ASSERT(_TKRecordProfileSample(0x1000, 0x2000, 2));
+    n = TKGetProfile(profileEntries, TK_PROFILE_ENTRIES, &dropped);
+    ASSERT(n == 3 && dropped == 0);
+    for (i = 0; i < n; i++) {
+        ASSERT(profileEntries[i].pc == 0x1000);
+        if (profileEntries[i].lr == 0x2000 && profileEntries[i].thread == 1) {
+            ASSERT(profileEntries[i].count == 2);
+        }
+        else {
+            ASSERT(profileEntries[i].count == 1);
+        }
+    }
+
+    /* Once the table fills, new samples are dropped, but every sample is
+     * either counted or dropped, and known ones still count.
+     */
+    for (i = 0; i < TK_PROFILE_ENTRIES; i++) {
+        _TKRecordProfileSample(0x4000 + 4 * i, 0x2000, 1);
+    }
+    ASSERT(_TKRecordProfileSample(0x1000, 0x2000, 1));
+    n = TKGetProfile(profileEntries, TK_PROFILE_ENTRIES, &dropped);
+    ASSERT(dropped > 0);
+    total = dropped;
+    for (i = 0; i < n; i++) {
+        total += profileEntries[i].count;
+    }
+    ASSERT(total == 5 + TK_PROFILE_ENTRIES);
+
+    TKResetProfile();
+    ASSERT(TKGetProfile(profileEntries, TK_PROFILE_ENTRIES, &dropped) == 0);
+    ASSERT(dropped == 0);
+
+    return 0;
+}
+#endif
+
+#ifdef TK_EVENT_TRACING
+int EventTraceVerify(void) {
+    struct TKEvent events[8];
+    struct TKSemaphore sem;
+    TKDriverHandle handle;
+    TKStatus status;
+    uint8_t buffer[4];
+    uint32_t lost;
+    uint32_t n;
+    int i;
+
+    TKInitDrivers();
+    TKCreateSemaphore(&sem, 1);
+    TKResetEvents();
+
+    ASSERT(TKDownSemaphore(&sem) == TK_OK);
+    ASSERT(TKUpSemaphore(&sem) == TK_OK);
+    ASSERT(TKTakeEvents(events, ARRAYLEN(events), &lost) == 2 && lost == 0);
+    ASSERT(events[0].type == TK_EVENT_SEM_DOWN && events[0].detail == 0);
+    ASSERT(events[0].object == TK_EVENT_OBJECT(&sem));
+    ASSERT(events[1].type == TK_EVENT_SEM_UP && events[1].detail == 0);
+    ASSERT(events[1].timestamp - events[0].timestamp < 0x80000000);
+
+    /* A driver operation is bracketed by enter and exit, with its locking in
+     * between.
+     */
+    handle = TKDriverOpen(TK_NULL_MAJOR, TK_NULL_MINOR);
+    ASSERT(handle != NULL);
+    TKDriverRead(handle, &status, buffer, sizeof(buffer));
+    ASSERT(status == TK_OK);
+    n = TKTakeEvents(events, ARRAYLEN(events), &lost);
+    ASSERT(n >= 2 && lost == 0);
+    ASSERT(events[0].type == TK_EVENT_DRIVER_ENTER);
+    ASSERT(events[0].detail == TK_EVENT_DRIVER_READ);
+    ASSERT(events[0].object == (TK_NULL_MAJOR << 8 | TK_NULL_MINOR));
+    ASSERT(events[n - 1].type == TK_EVENT_DRIVER_EXIT);
+    ASSERT(events[n - 1].object == events[0].object);
+    ASSERT(TKDriverClose(handle) == TK_OK);
+
+    /* Only the newest events are kept. */
+    TKResetEvents();
+    for (i = 0; i < TK_EVENT_RING_SIZE + 3; i++) {
+        TKRecordEvent(TK_EVENT_WAKE, 0, i);
+    }
+    ASSERT(TKTakeEvents(events, 1, &lost) == 1 && lost == 3);
+    ASSERT(events[0].object == 3);
+    ASSERT(TKTakeEvents(events, ARRAYLEN(events), &lost) ==
+           ARRAYLEN(events) && lost == 0);
+    ASSERT(events[0].object == 4);
+
+    TKResetEvents();
+    return 0;
+}
+
+int FlightRecordVerify(void) {
+    const struct TKFlightRecord * record;
+    int i;
+
+    /* Leave a record from before the last reset for main to report. */
+    if (TKGetFlightRecord() != NULL) {
+        return 0;
+    }
+
+    TKResetEvents();
+    for (i = 0; i < 3; i++) {
+        TKRecordEvent(TK_EVENT_WAKE, 0, i);
+    }
+
+    /* Disabled triggers never fire. */
+    TKCheckFlightTrigger(TK_FLIGHT_SCHEDULE, UINT32_MAX);
+    ASSERT(TKGetFlightRecord() == NULL);
+
+    TKFreezeEvents(TK_FLIGHT_MANUAL, 7);
+    record = TKGetFlightRecord();
+    ASSERT(record != NULL);
+    ASSERT(record->trigger == TK_FLIGHT_MANUAL && record->value == 7);
+    ASSERT(record->count == 3 && record->events[2].object == 2);
+
+    /* The first record is kept until it is cleared. */
+    for (i = 0; i < TK_EVENT_RING_SIZE + 1; i++) {
+        TKRecordEvent(TK_EVENT_WAKE, 0, i);
+    }
+    TKFreezeEvents(TK_FLIGHT_FATAL, 0);
+    ASSERT(TKGetFlightRecord()->trigger == TK_FLIGHT_MANUAL);
+
+    /* Only the last events are kept. */
+    TKClearFlightRecord();
+    ASSERT(TKGetFlightRecord() == NULL);
+    TKFreezeEvents(TK_FLIGHT_FATAL, 0);
+    record = TKGetFlightRecord();
+    ASSERT(record != NULL && record->count == TK_FLIGHT_RECORD_SIZE);
+    ASSERT(record->events[0].object ==
+           TK_EVENT_RING_SIZE + 1 - TK_FLIGHT_RECORD_SIZE);
+    ASSERT(record->events[TK_FLIGHT_RECORD_SIZE - 1].object ==
+           TK_EVENT_RING_SIZE);
+
+    TKClearFlightRecord();
+    TKResetEvents();
+    return 0;
+}
+#endif
+
 /**
  * Runs all the unit tests.
  */
@@ -759,6 +2387,10 @@ void RunTests(void) {
         { CreateThreadNullEntryPoint, "create a thread with a NULL entry point" },
         { CreateThreadNoFreeSlots, "create a thread when there's no free slots" },
         { CreateThreadValidateNormalCase, "create a thread and validate correct TCB entry" },
+        { SemaphoreWakesHighestPriority, "semaphore wakes waiters in priority order" },
+        { SemaphoreWakesEqualPriorityInOrder, "semaphore wakes equal priority waiters in order" },
+        { SemaphoreTimeouts, "semaphore waiters time out and are removed" },
+        { CriticalSectionTimeout, "critical section entry times out" },
         { DriverNullOp, "do operations on NULL driver handle" },
         { DriverClosedOp, "do operations on closed handle" },
         { DriverPoweredDownOps, "do operations on a powered down driver" },
@@ -766,6 +2398,8 @@ void RunTests(void) {
         { DriverNullStatusWrite, "do write with a NULL status pointer" },
         { DriverNullPowerState, "power state with NULL state pointer" },
         { DriverDoubleOpen, "open an already opened handle" },
+        { DriverOpenLookup, "open drivers by major and minor number" },
+        { DriverContextPerMinor, "each minor gets its own driver context" },
         { DriverIoctlBadCode, "ioctl with unknown code" },
         { DriverIoctlBadBufferSizes, "ioctl with required buffers that are too small" },
         { DriverIoctlNullBuffers, "ioctl with required buffers that are NULL" },
@@ -773,14 +2407,52 @@ void RunTests(void) {
         { DriverDoublePowerDown, "power down twice" },
         { DriverPowerStatesNotSupported, "try power operations when not supported" },
         { DriverReadWriteVerify, "write, read, and verify" },
+        { DriverWritevReadvVerify, "vectored write, vectored read, and verify" },
+        { DriverVectorFallback, "vectored operations on a driver without vector ops" },
+        { DriverVectorNullSegment, "vectored operations with a NULL segment" },
+        { DriverBufferLoanVerify, "fill and drain loaned buffers and verify" },
+        { DriverBufferLoanErrors, "misuse of loaned buffers" },
+        { DriverPerDirectionLocks, "reads and writes do not block each other per-direction" },
+        { DriverNoLocking, "operations on a driver that does its own locking" },
+        { DriverLockTimeout, "operations time out waiting for the driver lock" },
+        { DriverPollVerify, "poll a handle for readiness" },
         { DriverCloseVerify, "close a handle and verify" },
         { DriverPowerStateVerify, "verify power state transitions" },
         { DriverIoctlNoBuf, "ioctl with no buffers used" },
         { DriverIoctlInBuf, "ioctl with an in buffer" },
         { DriverIoctlOutBuf, "ioctl with an out buffer" },
-        { DriverIoctlInOutBuf, "ioctl with an in and an out buffer" }
+        { DriverIoctlInOutBuf, "ioctl with an in and an out buffer" },
+        { DriverIoctlBatchVerify, "batch of ioctls under one lock" },
+        { DriverStatsVerify, "DDF counts operations per device" },
+        { DriverAutosuspendVerify, "idle devices are suspended and resumed" },
+        { DriverNullZeroVerify, "null and zero drivers" },
+        { DriverLoopbackVerify, "loopback driver round-trips data" },
+        { DriverPipeVerify, "pipes report partial transfers and readiness" },
+        { BlockCacheVerify, "block reads and writes through the cache" },
+        { BlockMergeVerify, "block requests are merged" },
+        { LogStoreRecover, "log store recovers its records after a reopen" },
+        { LogStoreWrap, "log store wraps around and levels wear" },
+        { IapFlashBounds, "on-chip flash rejects offsets past its sectors" },
+        { FormatVerify, "printf style formatting" },
+        { LogRingVerify, "deferred log ring drains and counts drops" },
+        { TraceVerify, "trace records are queued raw and drained" },
+        { TraceSerialRawVerify, "trace records go out over serial as is" },
+        { InstrumentHistogramVerify, "latency histograms and percentiles" },
+        { CycleCounterVerify, "cycle counter runs and converts to time" },
+        { HrTimerVerify, "high resolution timers fire in deadline order" },
+#ifdef TK_PROBES
+        { ProbeRegistryVerify, "probes register themselves by name" },
+#endif
+#ifdef TK_PROFILING
+        { ProfileVerify, "profiler counts samples by PC, LR and thread" },
+#endif
+#ifdef TK_EVENT_TRACING
+        { EventTraceVerify, "kernel events are recorded in order" },
+        { FlightRecordVerify, "flight record freezes the last events" },
+#endif
     };
 
+    threads = TKGetThread(0);
     passCount = 0;
     testCount = ARRAYLEN(Tests);
     for (i = 0; i < testCount; i++) {
@@ -796,6 +2468,7 @@ void RunTests(void) {
         }
         TKRawPrintString("\n");
     }
+    memset(threads, 0, MAX_TEST_THREADS * sizeof(*threads));
 
     if (passCount == testCount) {
         TKRawPrintString("All tests pass!");
@@ -3,6 +3,9 @@
 
 #include "tk/common.h"
 #include "tk/data.h"
+#include "tk/events.h"
+#include "tk/hrtimer.h"
+#include "tk/profile.h"
 #include "tk/thread.h"
 #include "tk/timing.h"
 #include "tk/thread.h"
@@ -80,11 +83,13 @@ int TKRemoveThread(struct TKThread * thread) {
         return 0;
     }
 
-    /* Normal case of two or more items. */
+    /* Normal case of two or more items. The next thread becomes the head, so
+     * the rest of the queue keeps its order.
+     */
     prev->next = next;
     next->prev = prev;
     if (queue->head == thread) {
-        queue->head = prev;
+        queue->head = next;
     }
 
    return 0;
@@ -132,7 +137,74 @@ struct TKThread * TKPickThread(struct TKThreadQueue * queue) {
     return bestThread;
 }
 
+void TKAddTimeout(struct TKTimeoutList * list, struct TKThread * thread) {
+    thread->timedOut = false;
+    thread->timeoutNext = list->head;
+    list->head = thread;
+}
+
+void TKRemoveTimeout(struct TKTimeoutList * list, struct TKThread * thread) {
+    struct TKThread ** p;
+
+    for (p = &list->head; *p != NULL; p = &(*p)->timeoutNext) {
+        if (*p == thread) {
+            *p = thread->timeoutNext;
+            thread->timeoutNext = NULL;
+            return;
+        }
+    }
+}
+
+void _TKExpireTimeouts(struct TKTimeoutList * list,
+                       struct TKThreadQueue * runQueue,
+                       TKTickCount tickCount) {
+    struct TKThread ** p;
+    struct TKThread * thread;
+
+    p = &list->head;
+    while (*p != NULL) {
+        thread = *p;
+        if (tickCount < thread->deadline) {
+            p = &thread->timeoutNext;
+            continue;
+        }
+
+        /* Unlink, then pull the thread off whatever it was blocked on. */
+        *p = thread->timeoutNext;
+        thread->timeoutNext = NULL;
+        thread->timedOut = true;
+        TKRemoveThread(thread);
+        TKAddThread(runQueue, thread);
+        TK_EVENT_WAKE(thread);
+    }
+}
+
+void TKSetTimeout(uint32_t timeout) {
+    if (CurrentThread == NULL) {
+        return;
+    }
+
+    CurrentThread->timeoutStart = TickCount;
+    CurrentThread->timeout = timeout;
+}
+
+uint32_t TKTimeoutRemaining(void) {
+    uint32_t elapsed;
+
+    if (CurrentThread == NULL || CurrentThread->timeout == TK_WAIT_FOREVER) {
+        return TK_WAIT_FOREVER;
+    }
+
+    elapsed = TickCount - CurrentThread->timeoutStart;
+    if (elapsed >= CurrentThread->timeout) {
+        return 0;
+    }
+
+    return CurrentThread->timeout - elapsed;
+}
+
 void TKSchedule(void) {
+    _TKExpireTimeouts(&TimeoutList, &RunQueue, TickCount);
     CurrentThread = _TKSchedule(&RunQueue, &SleepQueue, TickCount);
 }
 
@@ -141,22 +213,23 @@ struct TKThread * _TKSchedule(struct TKThreadQueue * runQueue,
                               TKTickCount tickCount) {
     struct TKThread * next;
     struct TKThread * thread;
+    bool last;
+
+    /* Check for any sleeping threads that are ready to wake up. Removing a
+     * thread can move the head, so note whether each thread is the last one
+     * before it is removed.
+     */
+    thread = sleepQueue->head;
+    while (thread != NULL) {
+        next = thread->next;
+        last = next == sleepQueue->head;
+        if (tickCount >= thread->sleepTarget) {
+            TKRemoveThread(thread);
+            TKAddThread(runQueue, thread);
+            TK_EVENT_WAKE(thread);
+        }
 
-    /* Check for any sleeping threads that are ready to wake up. */
-    if (sleepQueue->head != NULL) {
-        thread = sleepQueue->head;
-        do {
-            next = thread->next;
-            if (tickCount >= thread->sleepTarget) {
-                TKRemoveThread(thread);
-                TKAddThread(runQueue, thread);
-                if (sleepQueue->head == NULL) {
-                    break;
-                }
-            }
-
-            thread = next;
-        } while (thread != sleepQueue->head);
+        thread = last ? NULL : next;
     }
 
     thread = TKPickThread(runQueue);
@@ -170,18 +243,64 @@ struct TKThread * _TKSchedule(struct TKThreadQueue * runQueue,
 }
 
 void TKSwitchThread(void * stackPointer) {
+    struct TKThread * previous;
+
+    previous = CurrentThread;
     CurrentThread->stackPointer = stackPointer;
     TKSchedule();
+    if (CurrentThread != previous) {
+        TK_EVENT_SWITCH(CurrentThread);
+    }
 }
 
+/* Called from the tick interrupt. */
 void TKInstrumentedSwitchThread(void * stackPointer) {
+    /* The counter restarted from 0 when it matched and raised the interrupt,
+     * so it now holds how late the interrupt is being handled. Timer0 runs at
+     * the cycle counter's rate.
+     */
+    TK_FLIGHT_CHECK(TK_FLIGHT_IRQ_LATENCY, READREG32(T0TC));
+    TK_EVENT(TK_EVENT_ISR_ENTER, VIC_TIMER0, 0);
+    TKRunHrTimers();
     TKStartInstrumenting(&scheduleInstrumentData);
     TKSwitchThread(stackPointer);
-    TKStopInstrumenting(&scheduleInstrumentData);
+    TK_FLIGHT_CHECK(TK_FLIGHT_SCHEDULE,
+                    TKStopInstrumenting(&scheduleInstrumentData));
+    TK_EVENT(TK_EVENT_ISR_EXIT, VIC_TIMER0, 0);
 }
 
 void TKIncrementTick(void) {
     TickCount++;
+
+    /* Keep the cycle count's high word current. */
+    TKGetCycles();
+}
+
+/* Called from the timer interrupt with the match flags that raised it, which
+ * it has cleared.
+ */
+void TKTimerInterrupt(void * stackPointer, uint32_t matches) {
+    TK_PROFILE_INTERRUPT(stackPointer, matches);
+
+    if (matches & TK_TIMER_TICK_MATCH) {
+        TKInstrumentedSwitchThread(stackPointer);
+        TKIncrementTick();
+        return;
+    }
+
+    if (!(matches & TK_TIMER_HRTIMER_MATCH)) {
+        /* Only a profiler sample; go back to the interrupted thread. */
+        CurrentThread->stackPointer = stackPointer;
+        return;
+    }
+
+    /* Only a high resolution timer is due. Schedule right away, in case it
+     * woke a thread, but leave the tick alone.
+     */
+    TK_EVENT(TK_EVENT_ISR_ENTER, VIC_TIMER0, 0);
+    TKRunHrTimers();
+    TKSwitchThread(stackPointer);
+    TK_EVENT(TK_EVENT_ISR_EXIT, VIC_TIMER0, 0);
 }
 
 int * TKInitStack(int * stack, TKThreadEntry entryPoint, void * data) {
@@ -251,6 +370,14 @@ TKStatus _TKCreateThread(struct TKThreadQueue * freeQueue,
     thread->queue = NULL;
     thread->prev = NULL;
     thread->next = NULL;
+    thread->deadline = 0;
+    thread->timedOut = false;
+    thread->timeoutNext = NULL;
+    thread->timeoutStart = 0;
+    thread->timeout = TK_WAIT_FOREVER;
+#ifdef TK_EVENT_TRACING
+    thread->woken = false;
+#endif
 
     cpsr = TKDisableInterrupts();
     TKAddThread(runQueue, thread);
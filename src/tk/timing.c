@@ -4,6 +4,7 @@
 #include "lpc/lpc2378.h"
 #include "lpc/bsp.h"
 
+#include "tk/common.h"
 #include "tk/data.h"
 #include "tk/utility.h"
 
@@ -15,7 +16,22 @@
 #define MCR_MR0_INTERRUPT_BIT BIT(0)
 #define MCR_MR0_RESET_BIT BIT(1)
 
-#define US_PER_S (1000000UL)
+#define NS_PER_S (1000000000ULL)
+#define US_PER_S (1000000ULL)
+
+/* Never an even sequence, so it marks a reset request as carried out. */
+#define RESET_DONE (1)
+
+/* The last Timer1 count read and the number of times it has wrapped. */
+static uint32_t CyclesLow;
+static uint32_t CyclesHigh;
+static uint32_t CyclesHz;
+/* Nanoseconds and microseconds per cycle and cycles per microsecond, in 32.32
+ * fixed point.
+ */
+static uint64_t NsPerCycle;
+static uint64_t UsPerCycle;
+static uint64_t CyclesPerUs;
 
 void TKInitTimer(uint32_t hz) {
     int frequency;
@@ -50,30 +66,157 @@ void TKStartTimer(void) {
     WRITEREG32(T0TCR, TCR_ENABLE_BIT);
 }
 
-void TKInitInstrumentData(const char * name, struct TKInstrumentData * data) {
-    data->name = name;
-    data->start = READREG32(T0TC);
-    data->last = 0;
+void TKInitCycleCounter(void) {
+    /* Reset and then disable the timer counter. */
+    WRITEREG32(T1TCR, TCR_RESET_BIT);
+    WRITEREG32(T1TCR, 0);
+
+    /* Count every PCLK edge, with no match actions, so the counter runs
+     * through all 32 bits and wraps.
+     */
+    WRITEREG32(T1CTCR, 0);
+    WRITEREG32(T1PR, 0);
+    WRITEREG32(T1PC, 0);
+    WRITEREG16(T1MCR, 0);
+    WRITEREG32(T1CCR, 0);
+    WRITEREG32(T1EMR, 0);
+
+    CyclesLow = 0;
+    CyclesHigh = 0;
+
+    /* The only divides; conversions multiply by these instead. */
+    CyclesHz = BSP_CPU_PclkFreq(PCLKINDX_TIMER1);
+    NsPerCycle = (NS_PER_S << 32) / CyclesHz;
+    UsPerCycle = (US_PER_S << 32) / CyclesHz;
+    CyclesPerUs = ((uint64_t) CyclesHz << 32) / US_PER_S;
+
+    WRITEREG32(T1TCR, TCR_ENABLE_BIT);
+}
+
+uint64_t TKGetCycles(void) {
+    uint32_t cpsr;
+    uint32_t high;
+    uint32_t low;
+
+    cpsr = TKDisableInterrupts();
+    low = READREG32(T1TC);
+    if (low < CyclesLow) {
+        CyclesHigh++;
+    }
+    CyclesLow = low;
+    high = CyclesHigh;
+    TKEnableInterrupts(cpsr);
+
+    return ((uint64_t) high << 32) | low;
+}
+
+uint32_t TKGetCyclesHz(void) {
+    return CyclesHz;
+}
+
+/* Multiply by a 32.32 fixed point scale. The full product needs 96 bits, so
+ * it is put together from 32-bit pieces.
+ */
+static uint64_t Scale(uint64_t cycles, uint64_t scale) {
+    uint32_t cyclesHigh;
+    uint32_t cyclesLow;
+    uint32_t whole;
+    uint32_t fraction;
+
+    cyclesHigh = cycles >> 32;
+    cyclesLow = cycles;
+    whole = scale >> 32;
+    fraction = scale;
+
+    return cycles * whole +
+           (uint64_t) cyclesHigh * fraction +
+           (((uint64_t) cyclesLow * fraction) >> 32);
+}
+
+uint64_t TKCyclesToNs(uint64_t cycles) {
+    return Scale(cycles, NsPerCycle);
+}
+
+uint64_t TKCyclesToUs(uint64_t cycles) {
+    return Scale(cycles, UsPerCycle);
+}
+
+uint64_t TKUsToCycles(uint32_t us) {
+    return Scale(us, CyclesPerUs);
+}
+
+uint64_t TKGetTimeNs(void) {
+    return TKCyclesToNs(TKGetCycles());
+}
+
+/* The histogram bucket for a time: the number of bits needed to hold it. The
+ * ARM7TDMI has no count leading zeros instruction, so this is a binary search.
+ */
+static uint32_t Bucket(uint32_t delta) {
+    uint32_t bits;
+
+    bits = 0;
+    if (delta >= 1UL << 16) {
+        delta >>= 16;
+        bits += 16;
+    }
+    if (delta >= 1UL << 8) {
+        delta >>= 8;
+        bits += 8;
+    }
+    if (delta >= 1UL << 4) {
+        delta >>= 4;
+        bits += 4;
+    }
+    if (delta >= 1UL << 2) {
+        delta >>= 2;
+        bits += 2;
+    }
+    if (delta >= 1UL << 1) {
+        delta >>= 1;
+        bits += 1;
+    }
+    /* delta is now 0 or 1. */
+    bits += delta;
+
+    if (bits >= TK_INSTRUMENT_BUCKETS) {
+        bits = TK_INSTRUMENT_BUCKETS - 1;
+    }
+    return bits;
+}
+
+static void ClearStats(struct TKInstrumentData * data) {
     data->count = 0;
     data->sum = 0;
     data->min = UINT32_MAX;
     data->max = 0;
+    memset(data->buckets, 0, sizeof(data->buckets));
 }
 
-void TKStartInstrumenting(struct TKInstrumentData * data) {
-    data->last = READREG32(T0TC);
+void TKInitInstrumentData(const char * name, struct TKInstrumentData * data) {
+    data->name = name;
+    data->start = TKGetCycles();
+    data->last = 0;
+    ClearStats(data);
+    data->sequence = 0;
+    data->resetSequence = RESET_DONE;
 }
 
-void TKStopInstrumenting(struct TKInstrumentData * data) {
-    uint32_t current;
-    uint32_t delta;
+void TKStartInstrumenting(struct TKInstrumentData * data) {
+    data->last = READREG32(T1TC);
+}
 
-    current = READREG32(T0TC);
+void _TKRecordInstrumentSample(struct TKInstrumentData * data, uint32_t delta) {
+    data->sequence++;
+    TK_COMPILER_BARRIER();
 
-    /* Compute delta. Since the timer counter is reset after every interrupt, we
-     * should not have to deal with overflow here.
+    /* A reader took a snapshot and asked for a reset, and nothing has been
+     * recorded since, so the snapshot holds everything being thrown away.
      */
-    delta = current - data->last;
+    if (data->resetSequence == data->sequence - 1) {
+        ClearStats(data);
+        data->resetSequence = RESET_DONE;
+    }
 
     if (delta < data->min) {
         data->min = delta;
@@ -84,61 +227,144 @@ void TKStopInstrumenting(struct TKInstrumentData * data) {
 
     data->sum += delta;
     data->count++;
+    data->buckets[Bucket(delta)]++;
+
+    TK_COMPILER_BARRIER();
+    data->sequence++;
+}
+
+uint32_t TKStopInstrumenting(struct TKInstrumentData * data) {
+    uint32_t current;
+    uint32_t delta;
+
+    current = READREG32(T1TC);
+
+    /* Compute delta. The cycle counter runs freely, so this is right even if
+     * it wrapped in between, as long as it didn't wrap twice.
+     */
+    delta = current - data->last;
+
+    _TKRecordInstrumentSample(data, delta);
+
+    return delta;
 }
-uint32_t Normalize(uint64_t n, uint32_t hz, uint32_t unit_per_s) {
-    return unit_per_s * n / hz;
+
+void TKSnapshotInstrumentData(struct TKInstrumentData * data,
+                              struct TKInstrumentData * snapshot,
+                              bool reset) {
+    uint32_t sequence;
+
+    for (;;) {
+        /* Don't copy from the middle of an update. */
+        sequence = data->sequence;
+        if (sequence & 1) {
+            continue;
+        }
+        TK_COMPILER_BARRIER();
+        memcpy(snapshot, data, sizeof(*snapshot));
+        TK_COMPILER_BARRIER();
+        if (data->sequence != sequence) {
+            continue;
+        }
+
+        /* An earlier reset that the writer hasn't gotten to yet. */
+        if (snapshot->resetSequence == sequence) {
+            ClearStats(snapshot);
+        }
+
+        if (!reset) {
+            return;
+        }
+
+        /* Ask the writer to clear the data before its next update, but only
+         * if it is still as copied. If the writer got in before the request,
+         * the copy is missing a measurement and it has to be taken again; if
+         * it got in after, it has already done the reset.
+         */
+        data->resetSequence = sequence;
+        TK_COMPILER_BARRIER();
+        if (data->sequence == sequence || data->resetSequence == RESET_DONE) {
+            return;
+        }
+    }
+}
+
+uint32_t TKInstrumentPercentile(const struct TKInstrumentData * snapshot,
+                                uint32_t perMille) {
+    uint64_t rank;
+    uint32_t bound;
+    uint32_t i;
+    uint32_t seen;
+
+    if (snapshot->count == 0) {
+        return 0;
+    }
+
+    /* The rank of the measurement at the percentile, counting from 1. */
+    rank = ((uint64_t) snapshot->count * perMille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    seen = 0;
+    for (i = 0; i < TK_INSTRUMENT_BUCKETS - 1; i++) {
+        seen += snapshot->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    /* The last bucket has no upper bound of its own. */
+    bound = (1UL << i) - 1;
+    if (i == TK_INSTRUMENT_BUCKETS - 1 || bound > snapshot->max) {
+        bound = snapshot->max;
+    }
+    return bound;
 }
 
 void TKPrintInstrumentationData(struct TKInstrumentData * data) {
     uint32_t average;
-    uint32_t cpsr;
-    uint32_t frequency;
     uint32_t max;
     uint32_t min;
-    TKTickCount tickCount;
+    uint32_t p50;
+    uint32_t p99;
+    uint32_t p999;
     struct TKInstrumentData tmp;
     uint64_t sum;
     uint64_t total;
 
-    /* Disable interrupts so we can safely get metrics atomically. */
-    cpsr = TKDisableInterrupts();
-    memcpy(&tmp, data, sizeof(tmp));
-    tickCount = TickCount;
-    TKEnableInterrupts(cpsr);
+    TKSnapshotInstrumentData(data, &tmp, false);
+
+    /* Normalize all metrics. */
+    min = TKCyclesToUs(tmp.min);
+    max = TKCyclesToUs(tmp.max);
+    sum = TKCyclesToUs(tmp.sum);
 
-    /* Compute average. */
-    if (tmp.count != 0) {
-        average = tmp.sum / tmp.count;
+    /* Compute average. The sum in microseconds fits in 32 bits for over an
+     * hour of measured time, so the 64-bit divide, a library call on this
+     * core, is almost never needed.
+     */
+    if (tmp.count == 0) {
+        average = 0;
+    }
+    else if (sum <= 0xFFFFFFFF) {
+        average = (uint32_t) sum / tmp.count;
     }
     else {
-        average = 0;
+        average = sum / tmp.count;
     }
-
-    /* Normalize all metrics. */
-    frequency = BSP_CPU_PclkFreq(PCLKINDX_TIMER0);
-    average = Normalize(average, frequency, US_PER_S);
-    min = Normalize(tmp.min, frequency, US_PER_S);
-    max = Normalize(tmp.max, frequency, US_PER_S);
-    sum = Normalize(tmp.sum, frequency, US_PER_S);
+    p50 = TKCyclesToUs(TKInstrumentPercentile(&tmp, 500));
+    p99 = TKCyclesToUs(TKInstrumentPercentile(&tmp, 990));
+    p999 = TKCyclesToUs(TKInstrumentPercentile(&tmp, 999));
 
     /* Compute total time in us since we first started instrumenting. */
-    total = 1000000ULL * tickCount / TickHz;
-
-    TKPrintString("Time spent ");
-    TKPrintString(tmp.name);
-    TKPrintString(":\n");
-    TKPrintString("Average: ");
-    TKPrintDecimal(average);
-    TKPrintString(" us\n");
-    TKPrintString("Min: ");
-    TKPrintDecimal(min);
-    TKPrintString(" us\n");
-    TKPrintString("Max: ");
-    TKPrintDecimal(max);
-    TKPrintString(" us\n");
-    TKPrintString("Ratio of scheduling to total: ");
-    TKPrintDecimal(sum);
-    TKPrintString("/");
-    TKPrintDecimal(total);
-    TKPrintString("\n");
+    total = TKCyclesToUs(TKGetCycles() - tmp.start);
+
+    TKPrintf("Time spent %s:\n"
+             "Average: %lu us\n"
+             "Min: %lu us\n"
+             "Max: %lu us\n"
+             "p50/p99/p99.9: %lu/%lu/%lu us\n"
+             "Ratio of scheduling to total: %llu/%llu\n",
+             tmp.name, average, min, max, p50, p99, p999, sum, total);
 }
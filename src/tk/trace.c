@@ -0,0 +1,97 @@
+#include <stddef.h>
+
+#include "tk/timing.h"
+#include "tk/trace.h"
+#include "tk/utility.h"
+
+static uint32_t Ring[TK_TRACE_RING_WORDS];
+/* Free-running word counts; TKTrace moves tail with interrupts disabled, and
+ * only the drain moves head.
+ */
+static volatile uint32_t Head;
+static volatile uint32_t Tail;
+static volatile uint32_t Dropped;
+/* The dropped count at the last dropped record. */
+static uint32_t ReportedDrops;
+
+void TKInitTrace(void) {
+    Head = 0;
+    Tail = 0;
+    Dropped = 0;
+    ReportedDrops = 0;
+}
+
+void TKTrace(uint32_t id, const uint32_t * args, uint32_t count) {
+    uint32_t cpsr;
+    uint32_t tail;
+    uint32_t i;
+
+    cpsr = TKDisableInterrupts();
+    tail = Tail;
+    if (count + 2 > TK_TRACE_RING_WORDS - (tail - Head)) {
+        Dropped++;
+        TKEnableInterrupts(cpsr);
+        return;
+    }
+
+    Ring[tail++ % TK_TRACE_RING_WORDS] = (id << 8) | TK_TRACE_MARKER | count;
+    Ring[tail++ % TK_TRACE_RING_WORDS] = (uint32_t) TKGetCycles();
+    for (i = 0; i < count; i++) {
+        Ring[tail++ % TK_TRACE_RING_WORDS] = args[i];
+    }
+    Tail = tail;
+    TKEnableInterrupts(cpsr);
+}
+
+uint32_t TKTraceDropped(void) {
+    return Dropped;
+}
+
+bool TKTracePending(void) {
+    return Tail != Head || Dropped != ReportedDrops;
+}
+
+uint32_t _TKTraceDrain(void (*print)(struct TKIoVec * vec, uint32_t count)) {
+    uint32_t record[3];
+    struct TKIoVec vec[2];
+    uint32_t dropped;
+    uint32_t offset;
+    uint32_t first;
+    uint32_t n;
+
+    /* Records are only ever added past tail, so everything up to this snapshot
+     * stays put while it is printed. A record may wrap around the end of the
+     * ring, but the bytes still go out in order.
+     */
+    n = Tail - Head;
+    if (n > 0) {
+        offset = Head % TK_TRACE_RING_WORDS;
+        first = TK_TRACE_RING_WORDS - offset;
+        if (first > n) {
+            first = n;
+        }
+        vec[0].buffer = (uint8_t *) &Ring[offset];
+        vec[0].size = first * sizeof(Ring[0]);
+        vec[1].buffer = (uint8_t *) Ring;
+        vec[1].size = (n - first) * sizeof(Ring[0]);
+        print(vec, vec[1].size > 0 ? 2 : 1);
+        Head += n;
+    }
+
+    dropped = Dropped;
+    if (dropped != ReportedDrops) {
+        record[0] = (TK_TRACE_DROPPED_ID << 8) | TK_TRACE_MARKER | 1;
+        record[1] = (uint32_t) TKGetCycles();
+        record[2] = dropped - ReportedDrops;
+        vec[0].buffer = (uint8_t *) record;
+        vec[0].size = sizeof(record);
+        print(vec, 1);
+        ReportedDrops = dropped;
+    }
+
+    return n * sizeof(Ring[0]);
+}
+
+uint32_t TKTraceDrain(void) {
+    return _TKTraceDrain(TKPrintRawv);
+}
@@ -1,9 +1,13 @@
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "lpc/uarts.h"
 
 #include "tk/common.h"
 #include "tk/ddf.h"
+#include "tk/events.h"
 #include "tk/utility.h"
 
 #include "tk/drivers/serial.h"
@@ -69,18 +73,270 @@ void TKRawPrintHex(uint32_t x) {
     _TKPrintHex(x, TKRawPrintString);
 }
 
-void _TKPrintDecimal(uint64_t x, void (*print)(const char *)) {
-    char buffer[21];
-    char *p = &buffer[sizeof(buffer) - 1];
+/* The high 64 bits of a 64x64-bit product, from 32x32-bit multiplies, which
+ * the ARM7TDMI does in a few cycles with UMULL.
+ */
+static uint64_t MultiplyHigh(uint64_t a, uint64_t b) {
+    uint64_t low;
+    uint64_t cross1;
+    uint64_t cross2;
+    uint64_t high;
+    uint64_t middle;
+
+    low = (uint64_t) (uint32_t) a * (uint32_t) b;
+    cross1 = (uint64_t) (uint32_t) a * (uint32_t) (b >> 32);
+    cross2 = (uint64_t) (uint32_t) (a >> 32) * (uint32_t) b;
+    high = (uint64_t) (uint32_t) (a >> 32) * (uint32_t) (b >> 32);
+
+    middle = (low >> 32) + (uint32_t) cross1 + (uint32_t) cross2;
+    return high + (cross1 >> 32) + (cross2 >> 32) + (middle >> 32);
+}
+
+/* Divide by 10 by multiplying by its reciprocal, scaled so the result is exact
+ * for every input. The core has no divider, so / and % would call into libgcc,
+ * which takes a long loop for 64-bit operands.
+ */
+static uint64_t DivideBy10(uint64_t x) {
+    if ((x >> 32) == 0) {
+        return ((uint64_t) (uint32_t) x * 0xCCCCCCCDUL) >> 35;
+    }
+
+    return MultiplyHigh(x, 0xCCCCCCCCCCCCCCCDULL) >> 3;
+}
+
+char * TKFormatDecimal(uint64_t x, char * buffer) {
+    char *p = &buffer[TK_DECIMAL_BUFFER_SIZE - 1];
+    uint64_t quotient;
+
+    *p = '\0';
+    do {
+        p--;
+        quotient = DivideBy10(x);
+        *p = (uint32_t) (x - quotient * 10) + '0';
+        x = quotient;
+    } while (x > 0);
+
+    return p;
+}
+
+/* Where TKVsnprintf is writing. Output past the end is counted but dropped. */
+struct FormatOutput {
+    char * buffer;
+    uint32_t size;
+    uint32_t length;
+};
+
+static void PutChar(struct FormatOutput * out, char c) {
+    if (out->length + 1 < out->size) {
+        out->buffer[out->length] = c;
+    }
+    out->length++;
+}
+
+/* Put a field, padded to width. */
+static void PutField(struct FormatOutput * out,
+                     const char * s,
+                     uint32_t length,
+                     uint32_t width,
+                     bool left,
+                     char pad) {
+    uint32_t i;
+
+    /* Zero padding goes after the sign. */
+    if (pad == '0' && length > 0 && *s == '-') {
+        PutChar(out, *s++);
+        length--;
+        width = width > 0 ? width - 1 : 0;
+    }
+    if (!left) {
+        for (i = length; i < width; i++) {
+            PutChar(out, pad);
+        }
+    }
+    for (i = 0; i < length; i++) {
+        PutChar(out, s[i]);
+    }
+    if (left) {
+        for (i = length; i < width; i++) {
+            PutChar(out, ' ');
+        }
+    }
+}
+
+static char * FormatHex(uint64_t x, char * buffer, bool upper) {
+    const char * digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = &buffer[TK_DECIMAL_BUFFER_SIZE - 1];
 
     *p = '\0';
     do {
         p--;
-        *p = (x % 10) + '0';
-        x /= 10;
+        *p = digits[x & 0xF];
+        x >>= 4;
     } while (x > 0);
 
-    print(p);
+    return p;
+}
+
+int TKVsnprintf(char * buffer,
+                uint32_t size,
+                const char * format,
+                va_list args) {
+    char number[TK_DECIMAL_BUFFER_SIZE + 1];
+    struct FormatOutput out;
+    const char * s;
+    char * p;
+    uint32_t width;
+    uint32_t longs;
+    uint64_t u;
+    int64_t d;
+    char pad;
+    bool left;
+    char c;
+
+    out.buffer = buffer;
+    out.size = size;
+    out.length = 0;
+
+    for (; *format != '\0'; format++) {
+        if (*format != '%') {
+            PutChar(&out, *format);
+            continue;
+        }
+        format++;
+
+        left = false;
+        pad = ' ';
+        for (; *format == '-' || *format == '0'; format++) {
+            if (*format == '-') {
+                left = true;
+            }
+            else {
+                pad = '0';
+            }
+        }
+        if (left) {
+            pad = ' ';
+        }
+
+        width = 0;
+        for (; *format >= '0' && *format <= '9'; format++) {
+            width = width * 10 + (*format - '0');
+        }
+
+        longs = 0;
+        for (; *format == 'l'; format++) {
+            longs++;
+        }
+
+        c = *format;
+        switch (c) {
+            case 'd':
+            case 'i':
+                if (longs >= 2) {
+                    d = va_arg(args, long long);
+                }
+                else if (longs == 1) {
+                    d = va_arg(args, long);
+                }
+                else {
+                    d = va_arg(args, int);
+                }
+                if (d < 0) {
+                    /* Leave room in front for the sign. */
+                    p = TKFormatDecimal(-(uint64_t) d, &number[1]);
+                    *--p = '-';
+                }
+                else {
+                    p = TKFormatDecimal(d, number);
+                }
+                PutField(&out, p, strlen(p), width, left, pad);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                if (longs >= 2) {
+                    u = va_arg(args, unsigned long long);
+                }
+                else if (longs == 1) {
+                    u = va_arg(args, unsigned long);
+                }
+                else {
+                    u = va_arg(args, unsigned int);
+                }
+                if (c == 'u') {
+                    s = TKFormatDecimal(u, number);
+                }
+                else {
+                    s = FormatHex(u, number, c == 'X');
+                }
+                PutField(&out, s, strlen(s), width, left, pad);
+                break;
+            case 'c':
+                number[0] = (char) va_arg(args, int);
+                PutField(&out, number, 1, width, left, ' ');
+                break;
+            case 's':
+                s = va_arg(args, const char *);
+                if (s == NULL) {
+                    s = "(null)";
+                }
+                PutField(&out, s, strlen(s), width, left, ' ');
+                break;
+            case '%':
+                PutChar(&out, '%');
+                break;
+            case '\0':
+                /* A lone % at the end; stop rather than run off the end. */
+                format--;
+                break;
+            default:
+                /* Unsupported; print it as is. */
+                PutChar(&out, '%');
+                PutChar(&out, c);
+                break;
+        }
+    }
+
+    if (size > 0) {
+        buffer[out.length < size ? out.length : size - 1] = '\0';
+    }
+
+    return out.length;
+}
+
+int TKSnprintf(char * buffer, uint32_t size, const char * format, ...) {
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = TKVsnprintf(buffer, size, format, args);
+    va_end(args);
+
+    return length;
+}
+
+void TKPrintf(const char * format, ...) {
+    char buffer[TK_PRINTF_BUFFER_SIZE];
+    struct TKIoVec vec;
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    length = TKVsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (length >= sizeof(buffer)) {
+        length = sizeof(buffer) - 1;
+    }
+    vec.buffer = (uint8_t *) buffer;
+    vec.size = length;
+    TKPrintv(&vec, 1);
+}
+
+void _TKPrintDecimal(uint64_t x, void (*print)(const char *)) {
+    char buffer[TK_DECIMAL_BUFFER_SIZE];
+
+    print(TKFormatDecimal(x, buffer));
 }
 
 void TKPrintDecimal(uint64_t x) {
@@ -92,36 +348,86 @@ void TKRawPrintDecimal(uint64_t x) {
 }
 
 void TKPrintString(const char * s) {
-    uint8_t buffer[128];
-    int bytesRead;
+    TKPrintStrings(&s, 1);
+}
+
+void TKPrintStrings(const char * const * strings, uint32_t count) {
+    struct TKIoVec vec[16];
     uint32_t i;
-    const char * p;
-    TKStatus status;
+    uint32_t n;
 
-    if (s == NULL) {
+    if (strings == NULL) {
         return;
     }
 
-    p = s;
-    while (true) {
-        for (i = 0; i < ARRAYLEN(buffer) && *p != '\0'; i++, p++) {
-            buffer[i] = *p;
+    /* Messages longer than the vector are sent in several writes. */
+    while (count > 0) {
+        n = 0;
+        for (i = 0; i < count && n < ARRAYLEN(vec); i++) {
+            if (strings[i] == NULL) {
+                continue;
+            }
+            vec[n].buffer = (uint8_t *) strings[i];
+            vec[n].size = strlen(strings[i]);
+            n++;
         }
 
-        do {
-            bytesRead = TKDriverWrite(handle, &status, buffer, i);
-            if (status != TK_OK) {
-                TKFatal("Serial driver write failed!");
-            }
-            i -= bytesRead;
-        } while (i != 0);
+        TKPrintv(vec, n);
+
+        strings += i;
+        count -= i;
+    }
+}
+
+/* Write all of vec to the console, translated or raw. */
+static void Printv(struct TKIoVec * vec, uint32_t count, bool raw) {
+    int bytesWritten;
+    TKStatus status;
+
+    while (count > 0) {
+        if (vec->size == 0) {
+            vec++;
+            count--;
+            continue;
+        }
 
-        if (*p == '\0') {
-            break;
+        if (raw) {
+            bytesWritten = TKDriverWriteRawv(handle, &status, vec, count);
+        }
+        else {
+            bytesWritten = TKDriverWritev(handle, &status, vec, count);
+        }
+        if (status != TK_OK) {
+            TKFatal("Serial driver write failed!");
+        }
+        /* Retrying a write that took nothing would spin forever. */
+        if (bytesWritten <= 0) {
+            TKFatal("Serial driver write made no progress!");
+        }
+
+        /* Skip whatever the driver consumed; a short write can leave us in the
+         * middle of a segment.
+         */
+        while (count > 0 && bytesWritten >= vec->size) {
+            bytesWritten -= vec->size;
+            vec++;
+            count--;
+        }
+        if (count > 0) {
+            vec->buffer += bytesWritten;
+            vec->size -= bytesWritten;
         }
     }
 }
 
+void TKPrintv(struct TKIoVec * vec, uint32_t count) {
+    Printv(vec, count, false);
+}
+
+void TKPrintRawv(struct TKIoVec * vec, uint32_t count) {
+    Printv(vec, count, true);
+}
+
 void TKRawPrintString(const char * s) {
     const char *p;
 
@@ -142,6 +448,9 @@ void TKRawPrintString(const char * s) {
 
 void TKFatal(const char * msg) {
     TKDisableInterrupts();
+#ifdef TK_EVENT_TRACING
+    TKFreezeEvents(TK_FLIGHT_FATAL, 0);
+#endif
     if (msg != NULL) {
         TKRawPrintString(msg);
         TKRawPrintString("\n");
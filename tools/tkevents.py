@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""Convert kernel event dumps to Chrome trace JSON.
+
+Build with -DTK_EVENT_TRACING, capture the serial output, and run this on the
+capture. Lines other than event dump lines are ignored. Open the result in
+https://ui.perfetto.dev or chrome://tracing.
+
+Usage:
+    tkevents.py capture.txt > trace.json
+"""
+
+import argparse
+import json
+import sys
+
+# Keep these in sync with include/tk/events.h.
+SWITCH, WAKE, SEM_UP, SEM_DOWN, DRIVER_ENTER, DRIVER_EXIT, ISR_ENTER, \
+    ISR_EXIT = range(8)
+DRIVER_OPS = ["read", "write", "ioctl", "power"]
+FLIGHT_TRIGGERS = ["slow scheduler pass", "wakeup latency", "interrupt latency",
+                   "fatal error", "manual freeze"]
+
+PID = 1
+# Interrupts get a track of their own.
+IRQ_TID = 0
+
+
+class Converter:
+    def __init__(self):
+        self.events = []
+        self.hz = 1
+        self.threads = {}
+        self.devices = {}
+        self.running = None
+        self.last = None
+        self.high = 0
+        self.trigger = None
+
+    def restart(self):
+        if self.running is not None and self.last is not None:
+            self.emit("E", "running", self.timestamp(self.last), self.running)
+        self.running = None
+        self.last = None
+        self.high = 0
+
+    def timestamp(self, count):
+        """Extend a 32-bit cycle count and convert it to microseconds."""
+        if self.last is not None and count < self.last:
+            self.high += 1 << 32
+        self.last = count
+        return (count + self.high) * 1e6 / self.hz
+
+    def emit(self, phase, name, ts, tid, **extra):
+        event = {"ph": phase, "name": name, "ts": ts, "pid": PID, "tid": tid}
+        event.update(extra)
+        self.events.append(event)
+
+    def thread_name(self, tid):
+        return self.threads.get(tid, "thread %04x" % tid)
+
+    def device_name(self, device):
+        name = self.devices.get(device, "device")
+        return "%s %d:%d" % (name, device >> 8, device & 0xFF)
+
+    def event(self, ts, kind, detail, obj):
+        current = self.running if self.running is not None else IRQ_TID
+        if kind == SWITCH:
+            if self.running is not None:
+                self.emit("E", "running", ts, self.running)
+            self.running = obj
+            self.emit("B", "running", ts, obj)
+        elif kind == WAKE:
+            self.emit("i", "wake", ts, obj, s="t",
+                      args={"by": self.thread_name(current)})
+        elif kind in (SEM_UP, SEM_DOWN):
+            if kind == SEM_UP:
+                name = "sem up" + (" (wakes waiter)" if detail else "")
+            else:
+                name = "sem down" + (" (blocks)" if detail else "")
+            self.emit("i", name, ts, current, s="t",
+                      args={"semaphore": "0x%04x" % obj})
+        elif kind in (DRIVER_ENTER, DRIVER_EXIT):
+            op = DRIVER_OPS[detail] if detail < len(DRIVER_OPS) else "op"
+            name = "%s %s" % (self.device_name(obj), op)
+            self.emit("B" if kind == DRIVER_ENTER else "E", name, ts, current)
+        elif kind in (ISR_ENTER, ISR_EXIT):
+            name = "irq %d" % detail
+            self.emit("B" if kind == ISR_ENTER else "E", name, ts, IRQ_TID)
+
+    def line(self, text):
+        fields = text.split()
+        if len(fields) < 2 or fields[0] != "#TKE":
+            return
+
+        kind = fields[1]
+        if kind == "H":
+            self.hz = int(fields[2], 16)
+        elif kind == "T":
+            self.threads[int(fields[2], 16)] = " ".join(fields[3:])
+        elif kind == "D":
+            self.devices[int(fields[2], 16)] = " ".join(fields[3:])
+        elif kind == "L":
+            if self.last is not None:
+                self.emit("i", "%d events lost" % int(fields[2], 16),
+                          self.timestamp(self.last), IRQ_TID, s="g")
+        elif kind == "F":
+            # A flight record from before a reset; mark where it was frozen
+            # once its events are in.
+            trigger, value = (int(f, 16) for f in fields[2:4])
+            name = FLIGHT_TRIGGERS[trigger] \
+                if trigger < len(FLIGHT_TRIGGERS) else "trigger %d" % trigger
+            self.trigger = (name, value)
+            self.restart()
+        elif kind == "E":
+            ts, event, detail, obj = (int(f, 16) for f in fields[2:6])
+            self.event(self.timestamp(ts), event, detail, obj)
+        elif kind == "END" and self.trigger is not None:
+            name, value = self.trigger
+            self.trigger = None
+            if self.last is not None:
+                self.emit("i", "flight record frozen: " + name,
+                          self.timestamp(self.last), IRQ_TID, s="g",
+                          args={"value_us": value * 1e6 / self.hz})
+            # The cycle counter restarted at the reset, so what follows is a new
+            # timeline.
+            self.restart()
+
+    def result(self):
+        metadata = [{"ph": "M", "name": "process_name", "pid": PID,
+                     "args": {"name": "tinykernel"}},
+                    {"ph": "M", "name": "thread_name", "pid": PID,
+                     "tid": IRQ_TID, "args": {"name": "interrupts"}}]
+        for tid, name in self.threads.items():
+            metadata.append({"ph": "M", "name": "thread_name", "pid": PID,
+                             "tid": tid, "args": {"name": name}})
+        return {"traceEvents": metadata + self.events,
+                "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", nargs="?", help="a capture file; default stdin")
+    args = parser.parse_args()
+
+    converter = Converter()
+    source = open(args.input, errors="replace") if args.input else sys.stdin
+    with source:
+        for text in source:
+            converter.line(text)
+
+    json.dump(converter.result(), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
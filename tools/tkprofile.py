@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Symbolize kernel profiler dumps.
+
+Build with -DTK_PROFILING, capture the serial output, and run this on the
+capture with the ELF image. Lines other than profile dump lines are ignored,
+and the samples of every dump in the capture are added up. By default this
+prints the functions that took the most samples; with --folded it prints
+folded stacks (thread;caller;function count) for flamegraph.pl or
+https://www.speedscope.app.
+
+The caller comes from the sampled LR, so it is only right for leaf functions
+and for functions that hadn't saved LR yet; it is left out when it names the
+sampled function itself.
+
+Usage:
+    tkprofile.py tinykernel.elf capture.txt
+    tkprofile.py --folded tinykernel.elf capture.txt | flamegraph.pl > cpu.svg
+"""
+
+import argparse
+import bisect
+import collections
+import struct
+import sys
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+
+
+def read_functions(path):
+    """Return the function symbols of an ELF32 file as sorted (address, size,
+    name) tuples."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a little-endian ELF32 file" % path)
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum = struct.unpack_from("<HH", elf, 0x2E)
+
+    def section(index):
+        return struct.unpack_from("<IIIIIIIIII", elf, shoff + index * shentsize)
+
+    for i in range(shnum):
+        _, kind, _, _, offset, size, link, _, _, entsize = section(i)
+        if kind == SHT_SYMTAB:
+            break
+    else:
+        raise SystemExit("%s: no symbol table; was it stripped?" % path)
+
+    strings = section(link)[4]
+    functions = []
+    for start in range(offset, offset + size, entsize):
+        name, value, length, info = struct.unpack_from("<IIIB", elf, start)
+        if info & 0xF == STT_FUNC:
+            end = elf.index(b"\0", strings + name)
+            # Bit 0 marks Thumb code.
+            functions.append((value & ~1, length,
+                              elf[strings + name:end].decode()))
+    functions.sort()
+    return functions
+
+
+class Symbolizer:
+    def __init__(self, functions):
+        self.functions = functions
+        self.addresses = [f[0] for f in functions]
+
+    def name(self, address):
+        i = bisect.bisect_right(self.addresses, address) - 1
+        if i >= 0:
+            start, size, name = self.functions[i]
+            if address < start + max(size, 1):
+                return name
+        return "0x%08x" % address
+
+
+class Profile:
+    def __init__(self):
+        self.hz = 0
+        self.threads = {}
+        self.samples = collections.Counter()
+        self.dropped = 0
+
+    def line(self, text):
+        fields = text.split()
+        if len(fields) < 2 or fields[0] != "#TKP":
+            return
+
+        kind = fields[1]
+        if kind == "H":
+            self.hz = int(fields[2], 16)
+        elif kind == "T":
+            self.threads[int(fields[2], 16)] = " ".join(fields[3:])
+        elif kind == "S":
+            pc, lr, thread, count = (int(f, 16) for f in fields[2:6])
+            self.samples[(pc, lr, thread)] += count
+        elif kind == "L":
+            self.dropped += int(fields[2], 16)
+
+    def thread_name(self, thread):
+        if thread == 0:
+            return "startup"
+        return self.threads.get(thread, "thread %04x" % thread)
+
+
+def folded(profile, symbols):
+    stacks = collections.Counter()
+    for (pc, lr, thread), count in profile.samples.items():
+        function = symbols.name(pc)
+        # LR is the return address, so look up the call before it.
+        caller = symbols.name((lr & ~1) - 4) if lr >= 4 else function
+        frames = [profile.thread_name(thread).replace(" ", "_")]
+        if caller != function:
+            frames.append(caller)
+        frames.append(function)
+        stacks[";".join(frames)] += count
+
+    for stack, count in sorted(stacks.items()):
+        print("%s %d" % (stack, count))
+
+
+def flat(profile, symbols, limit):
+    functions = collections.Counter()
+    for (pc, _, _), count in profile.samples.items():
+        functions[symbols.name(pc)] += count
+
+    total = sum(functions.values())
+    seconds = " over %.1fs" % (total / profile.hz) if profile.hz else ""
+    print("%d samples%s" % (total, seconds))
+    print("%8s %6s  %s" % ("samples", "%", "function"))
+    for name, count in functions.most_common(limit):
+        print("%8d %6.2f  %s" % (count, 100.0 * count / total, name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="the ELF image the board is running")
+    parser.add_argument("input", nargs="?",
+                        help="a capture file; default stdin")
+    parser.add_argument("--folded", action="store_true",
+                        help="print folded stacks for a flame graph")
+    parser.add_argument("--top", type=int, default=30,
+                        help="how many functions to list; default 30")
+    args = parser.parse_args()
+
+    symbols = Symbolizer(read_functions(args.elf))
+    profile = Profile()
+    source = open(args.input, errors="replace") if args.input else sys.stdin
+    with source:
+        for text in source:
+            profile.line(text)
+
+    if not profile.samples:
+        raise SystemExit("no profile samples in the capture")
+    if profile.dropped:
+        sys.stderr.write("%d samples didn't fit in the table and were "
+                         "dropped\n" % profile.dropped)
+
+    if args.folded:
+        folded(profile, symbols)
+    else:
+        flat(profile, symbols, args.top)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Decode TK_TRACE records from a serial capture.
+
+The target sends trace records as binary, interleaved with ordinary text
+output. Text is passed through unchanged; each trace record is looked up in
+the .tk_trace_formats section of the ELF and printed formatted.
+
+Usage:
+    tktrace.py tinykernel.elf < capture.bin
+    cat /dev/ttyUSB0 | tktrace.py --hz 48000000 tinykernel.elf
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+# Keep these in sync with include/tk/trace.h.
+MARKER = 0xF0
+MAX_ARGS = 4
+DROPPED_ID = 0xFFFFFF
+
+FORMATS_SECTION = ".tk_trace_formats"
+
+CONVERSION = re.compile(
+    r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|t|j)?([diouxXcps%])")
+
+
+def read_formats(path):
+    """Return (address, contents) of the format section of an ELF32 file."""
+    with open(path, "rb") as f:
+        elf = f.read()
+
+    if elf[:4] != b"\x7fELF" or elf[4] != 1 or elf[5] != 1:
+        raise SystemExit("%s: not a little-endian ELF32 file" % path)
+
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def section(index):
+        return struct.unpack_from("<IIIIIIIIII", elf, shoff + index * shentsize)
+
+    names = section(shstrndx)
+    for i in range(shnum):
+        name, _, _, addr, offset, size = section(i)[:6]
+        start = names[4] + name
+        if elf[start:elf.index(b"\0", start)].decode() == FORMATS_SECTION:
+            return addr, elf[offset:offset + size]
+
+    raise SystemExit("%s: no %s section" % (path, FORMATS_SECTION))
+
+
+def format_record(fmt, args):
+    """Format the raw argument words with a C printf format string."""
+    args = list(args)
+
+    def convert(match):
+        flags, _, kind = match.groups()
+        if kind == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        if kind in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            return ("%" + flags + "d") % value
+        if kind == "u":
+            return ("%" + flags + "d") % value
+        if kind == "p":
+            return "0x%08x" % value
+        if kind == "s":
+            # Only the pointer was recorded.
+            return "<string at 0x%08x>" % value
+        return ("%" + flags + kind) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, formats, hz, out):
+        self.address, self.strings = formats
+        self.hz = hz
+        self.out = out
+        self.pending = b""
+        self.last = None
+        self.high = 0
+
+    def timestamp(self, count):
+        # Timestamps are the low 32 bits of the cycle count; extend them,
+        # assuming records are less than one wrap apart.
+        if self.last is not None and count < self.last:
+            self.high += 1 << 32
+        self.last = count
+        count += self.high
+        if self.hz:
+            return "%.6f" % (count / self.hz)
+        return "%d" % count
+
+    def format(self, fid):
+        offset = fid - self.address
+        if offset < 0 or offset >= len(self.strings):
+            return "<unknown format 0x%06x>" % fid
+        end = self.strings.index(b"\0", offset)
+        return self.strings[offset:end].decode(errors="replace")
+
+    def feed(self, data):
+        data = self.pending + data
+        i = 0
+        text = bytearray()
+        while i < len(data):
+            byte = data[i]
+            if not MARKER <= byte <= MARKER + MAX_ARGS:
+                text.append(byte)
+                i += 1
+                continue
+
+            count = byte - MARKER
+            size = 8 + 4 * count
+            if i + size > len(data):
+                break
+
+            self.out.write(text.decode("latin-1"))
+            text.clear()
+
+            header, stamp = struct.unpack_from("<II", data, i)
+            args = struct.unpack_from("<%dI" % count, data, i + 8)
+            fid = header >> 8
+            if fid == DROPPED_ID:
+                message = "%d trace records dropped" % args[0]
+            else:
+                message = format_record(self.format(fid), args)
+            self.out.write("[%s] %s\n" % (self.timestamp(stamp), message))
+            i += size
+
+        self.out.write(text.decode("latin-1"))
+        self.out.flush()
+        self.pending = data[i:]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="the image the target is running")
+    parser.add_argument("input", nargs="?", help="a capture file; default stdin")
+    parser.add_argument("--hz", type=int, default=0,
+                        help="the cycle rate, to print timestamps in seconds")
+    args = parser.parse_args()
+
+    decoder = Decoder(read_formats(args.elf), args.hz, sys.stdout)
+    source = open(args.input, "rb") if args.input else sys.stdin.buffer
+    with source:
+        while True:
+            data = source.read1(4096)
+            if not data:
+                break
+            decoder.feed(data)
+
+
+if __name__ == "__main__":
+    main()